@@ -0,0 +1,65 @@
+/* asyncVideoWriter.h
+ * VideoWriter that encodes on a background thread: write() copies the frame
+ * into a recycled buffer and returns, so the processing loop is limited by its
+ * own work rather than by the encoder. The queue is bounded to cap memory.
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef ASYNCVIDEOWRITER_H
+#define ASYNCVIDEOWRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "opencv2/core/core.hpp"
+#include "opencv2/videoio/videoio.hpp"
+
+class AsyncVideoWriter
+{
+public:
+    AsyncVideoWriter();
+    ~AsyncVideoWriter();
+
+    /**
+     * Opens the output file (codec picked from the extension: MJPG for .avi,
+     * mp4v otherwise) and starts the encoder thread
+     */
+    bool open(const std::string &filename, double fps, cv::Size frameSize, int maxQueued = 8);
+
+    /** Queues a copy of the frame; only waits if the encoder is maxQueued frames behind */
+    void write(const cv::Mat &frame);
+
+    /** Encodes whatever is still queued, then closes the file */
+    void close();
+
+    bool isOpened() const { return running; }
+    int framesWritten() const { return written; }
+
+private:
+    cv::VideoWriter writer;
+    std::thread encoder;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<cv::Mat> queue;   //frames waiting to be encoded
+    std::vector<cv::Mat> spare;  //encoded frames' buffers, reused by write()
+    int maxQueued;
+    bool running;
+    bool stopping;
+    int written;
+
+    void encodeLoop();
+};
+
+/**
+ * Inserts ".index" before the file extension ("out.avi" -> "out.2.avi"),
+ * for naming one output per stream
+ */
+std::string indexedFilename(const std::string &filename, int index);
+
+#endif
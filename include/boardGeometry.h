@@ -0,0 +1,228 @@
+/* boardGeometry.h
+ * Compile-time chessboard geometry: object points are built at compile time
+ * into std::arrays and corner buffers have a fixed size, so the detection and
+ * pose hot path doesn't allocate and its per-corner loops can be unrolled.
+ * A small dispatch table maps runtime board sizes to the instantiated boards.
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef BOARDGEOMETRY_H
+#define BOARDGEOMETRY_H
+
+#include <array>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include "opencv2/core/core.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/calib3d/calib3d.hpp"
+
+/**
+ * A 3D corner position in units of chessboard squares
+ * (layout matches cv::Point3f, so arrays of these can back a CV_32FC3 Mat)
+ */
+struct BoardPoint
+{
+    float x, y, z;
+};
+
+/**
+ * Builds the corner positions of a board that is W corners wide, row by row,
+ * with x to the right and y going up (so rows are at -i)
+ */
+template <int W, std::size_t... I>
+constexpr std::array<BoardPoint, sizeof...(I)> makeBoardPoints(std::index_sequence<I...>)
+{
+    return {{ BoardPoint{ (float)(I % W), -(float)(I / W), 0.0f }... }};
+}
+
+/**
+ * Pose of one detected board in a frame
+ */
+struct BoardPose
+{
+    bool found;
+    std::vector<cv::Point2f> corners;
+    cv::Mat rvec, tvec;
+    double reprojError; //RMS in pixels, only meaningful if found
+};
+
+/**
+ * Geometry of a chessboard with W x H inner corners
+ */
+template <int W, int H>
+struct BoardGeometry
+{
+    static constexpr int width = W;
+    static constexpr int height = H;
+    static constexpr int numCorners = W * H;
+
+    typedef std::array<BoardPoint, W * H> ObjectPoints;
+    typedef std::array<cv::Point2f, W * H> CornerBuffer;
+
+    static constexpr ObjectPoints objectPoints =
+        makeBoardPoints<W>(std::make_index_sequence<W * H>());
+
+    static cv::Size size() { return cv::Size(W, H); }
+
+    /** Object points as a Mat header over the compile-time array (no copy) */
+    static cv::Mat objectPointMat()
+    {
+        return cv::Mat(numCorners, 1, CV_32FC3, (void *)objectPoints.data());
+    }
+};
+
+template <int W, int H>
+constexpr typename BoardGeometry<W, H>::ObjectPoints BoardGeometry<W, H>::objectPoints;
+
+/**
+ * Detects the board's corners in the given grayscale image into a fixed-size
+ * buffer, refining them with cornerSubPix if subPixIterations > 0
+ */
+template <class Board>
+bool detectBoardCorners(const cv::Mat &gray, typename Board::CornerBuffer &corners,
+                        int subPixIterations)
+{
+    cv::Mat cornerMat(Board::numCorners, 1, CV_32FC2, corners.data());
+    cv::Mat detected = cornerMat;
+    bool found = cv::findChessboardCorners(gray, Board::size(), detected,
+                                           cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE);
+    if (!found)
+    {
+        return false;
+    }
+
+    //the detector may hand back its own buffer rather than filling ours
+    if (detected.data != cornerMat.data)
+    {
+        detected.reshape(2, Board::numCorners).copyTo(cornerMat);
+    }
+
+    if (subPixIterations > 0)
+    {
+        cv::TermCriteria criteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, subPixIterations, 0.001);
+        cv::cornerSubPix(gray, cornerMat, cv::Size(5,5), cv::Size(-1,-1), criteria);
+    }
+    return true;
+}
+
+/**
+ * RMS distance between the detected corners and the board corners projected
+ * with the given pose (fixed trip count, so the loop unrolls)
+ */
+template <class Board>
+double boardReprojectionError(const typename Board::CornerBuffer &corners,
+                              const cv::Mat &rvec, const cv::Mat &tvec,
+                              const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs)
+{
+    typename Board::CornerBuffer projected;
+    cv::Mat projectedMat(Board::numCorners, 1, CV_32FC2, projected.data());
+    cv::projectPoints(Board::objectPointMat(), rvec, tvec, cameraMatrix, distCoeffs, projectedMat);
+
+    float sum = 0;
+    for (int i = 0; i < Board::numCorners; i++)
+    {
+        float dx = corners[i].x - projected[i].x;
+        float dy = corners[i].y - projected[i].y;
+        sum += dx*dx + dy*dy;
+    }
+    return std::sqrt(sum / Board::numCorners);
+}
+
+/**
+ * Solves for the board's pose from an already detected, complete corner list
+ */
+template <class Board>
+bool solveBoardPose(const std::vector<cv::Point2f> &corners, const cv::Mat &cameraMatrix,
+                    const cv::Mat &distCoeffs, BoardPose &pose)
+{
+    pose.rvec = cv::Mat::zeros(1, 3, CV_64F);
+    pose.tvec = cv::Mat::zeros(1, 3, CV_64F);
+    pose.reprojError = 0;
+    pose.found = ((int)corners.size() == Board::numCorners);
+    if (!pose.found)
+    {
+        return false;
+    }
+
+    typename Board::CornerBuffer buffer;
+    std::copy(corners.begin(), corners.end(), buffer.begin());
+    cv::Mat cornerMat(Board::numCorners, 1, CV_32FC2, buffer.data());
+    cv::solvePnP(Board::objectPointMat(), cornerMat, cameraMatrix, distCoeffs, pose.rvec, pose.tvec);
+    pose.reprojError = boardReprojectionError<Board>(buffer, pose.rvec, pose.tvec,
+                                                     cameraMatrix, distCoeffs);
+    if (&pose.corners != &corners)
+    {
+        pose.corners = corners;
+    }
+    return true;
+}
+
+/**
+ * Detects the board in the given grayscale image and, if found, solves for its pose
+ */
+template <class Board>
+bool estimateBoardPose(const cv::Mat &gray, const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs,
+                       BoardPose &pose, int subPixIterations)
+{
+    pose.rvec = cv::Mat::zeros(1, 3, CV_64F);
+    pose.tvec = cv::Mat::zeros(1, 3, CV_64F);
+    pose.reprojError = 0;
+
+    typename Board::CornerBuffer corners;
+    pose.found = detectBoardCorners<Board>(gray, corners, subPixIterations);
+    if (!pose.found)
+    {
+        pose.corners.clear();
+        return false;
+    }
+
+    cv::Mat cornerMat(Board::numCorners, 1, CV_32FC2, corners.data());
+    cv::solvePnP(Board::objectPointMat(), cornerMat, cameraMatrix, distCoeffs, pose.rvec, pose.tvec);
+    pose.reprojError = boardReprojectionError<Board>(corners, pose.rvec, pose.tvec,
+                                                     cameraMatrix, distCoeffs);
+    pose.corners.assign(corners.begin(), corners.end());
+    return true;
+}
+
+typedef bool (*BoardDetectFn)(const cv::Mat &gray, std::vector<cv::Point2f> &corners,
+                              int subPixIterations);
+typedef bool (*BoardPoseFn)(const cv::Mat &gray, const cv::Mat &cameraMatrix,
+                            const cv::Mat &distCoeffs, BoardPose &pose, int subPixIterations);
+typedef bool (*BoardSolveFn)(const std::vector<cv::Point2f> &corners, const cv::Mat &cameraMatrix,
+                             const cv::Mat &distCoeffs, BoardPose &pose);
+
+/**
+ * Runtime handle for one compile-time board size
+ */
+struct BoardOps
+{
+    int width;
+    int height;
+    int numCorners;
+    const BoardPoint *objectPoints;
+    BoardDetectFn detectCorners;
+    BoardPoseFn estimatePose;
+    BoardSolveFn solvePose;
+
+    cv::Size size() const { return cv::Size(width, height); }
+    std::vector<cv::Point3f> pointSet() const;
+};
+
+/**
+ * Looks up the instantiated board of the given size, or returns NULL
+ * if that size isn't compiled in
+ */
+const BoardOps *findBoardOps(cv::Size chessboardSize);
+
+/**
+ * Parses a board size given as "WxH" (e.g. "9x6") and looks it up;
+ * prints the supported sizes and returns NULL if unavailable
+ */
+const BoardOps *parseBoardOps(const char *sizeStr);
+
+#endif
@@ -0,0 +1,31 @@
+/* calibrationProfile.h
+ * Reads and writes calibration.txt files, the camera profiles written by
+ * calibration and read by every program that projects onto a board: three
+ * rows of the camera matrix, then the distortion coefficients on one line.
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef CALIBRATIONPROFILE_H
+#define CALIBRATIONPROFILE_H
+
+#include <string>
+#include "opencv2/core/core.hpp"
+
+/**
+ * Reads a calibration.txt file into a 3x3 CV_64F camera matrix and an Nx1
+ * CV_64F column of distortion coefficients; false if it can't be opened or
+ * is incomplete
+ */
+bool readCalibrationProfile(const std::string &filename, cv::Mat &cameraMatrix, cv::Mat &distCoeffs);
+
+/** Writes a calibration.txt file; false if it can't be written */
+bool writeCalibrationProfile(const std::string &filename, const cv::Mat &cameraMatrix,
+                             const cv::Mat &distCoeffs);
+
+/** Prints the camera matrix and distortion coefficients */
+void printCalibrationProfile(const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs);
+
+#endif
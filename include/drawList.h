@@ -0,0 +1,81 @@
+/* drawList.h
+ * Batched 2D overlay drawing: segments, polylines and filled polygons are
+ * collected for a whole frame, clipped against the frame once, binned into
+ * screen tiles and then rasterized tile by tile in parallel, instead of
+ * paying one cv::line call per edge
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include <vector>
+#include "opencv2/core/core.hpp"
+
+/**
+ * One queued primitive: a thick segment a-b, or (numVertices > 0) a filled
+ * polygon whose vertices are stored in the list's vertex array
+ */
+struct DrawPrimitive
+{
+    cv::Point2f a, b;
+    float radius;           //half the stroke thickness
+    int firstVertex;
+    int numVertices;
+    cv::Rect2f bounds;      //pixels this primitive can touch
+    unsigned char color[4]; //in the target image's channel order
+};
+
+class DrawList
+{
+public:
+    DrawList();
+
+    /** Drops everything queued, keeping the allocated storage for the next frame */
+    void clear();
+
+    void addSegment(cv::Point2f a, cv::Point2f b, const cv::Scalar &color, int thickness = 2);
+
+    /** Adds n-1 segments (n if closed) joining consecutive points */
+    void addPolyline(const cv::Point2f *points, int n, bool closed,
+                     const cv::Scalar &color, int thickness = 2);
+    void addPolyline(const std::vector<cv::Point2f> &points, bool closed,
+                     const cv::Scalar &color, int thickness = 2);
+
+    /** Adds a filled polygon (even-odd rule, so it needn't be convex) */
+    void addFill(const std::vector<cv::Point2f> &polygon, const cv::Scalar &color);
+
+    /**
+     * Draws everything queued into img (8-bit, 1-4 channels) in the order it
+     * was added; antiAlias blends stroke edges by coverage
+     */
+    void render(cv::Mat &img, bool antiAlias = false);
+
+    /**
+     * Sets every pixel render would touch (with the same antiAlias) to 255 in
+     * an 8-bit single-channel mask the size of the frame, leaving the rest
+     */
+    void renderCoverage(cv::Mat &mask, bool antiAlias = false);
+
+    size_t size() const { return primitives.size(); }
+
+    /** Pixels of a frame of the given size that render can touch (empty if none) */
+    cv::Rect bounds(cv::Size frameSize) const;
+
+    int tileSize; //tile edge in pixels
+
+private:
+    std::vector<DrawPrimitive> primitives;
+    std::vector<cv::Point2f> vertices;
+    std::vector<int> visible;           //primitives left after clipping, in order
+    std::vector< std::vector<int> > bins; //per tile: primitives touching it, in order
+
+    void clipToFrame(cv::Size frameSize);
+    void binTiles(int tilesX, int tilesY);
+    void rasterize(cv::Mat &img, bool antiAlias, bool coverageOnly);
+};
+
+#endif
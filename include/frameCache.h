@@ -0,0 +1,68 @@
+/* frameCache.h
+ * Per-frame preprocessing cache: computes the grayscale image, image pyramid
+ * and Sobel gradients of a video frame lazily and at most once, so detection,
+ * refinement, tracking and Harris can all share them
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <vector>
+#include "opencv2/core/core.hpp"
+
+class FrameCache
+{
+public:
+    FrameCache();
+    explicit FrameCache(const cv::Mat &frame);
+
+    /**
+     * Points the cache at a new frame and invalidates everything derived from
+     * the previous one (buffers are kept so same-size frames don't reallocate)
+     */
+    void reset(const cv::Mat &frame);
+
+    /**
+     * Exchanges frames, derived images and buffers with another cache, e.g.
+     * to keep this frame's pyramid for tracking into the next one
+     */
+    void swap(FrameCache &other);
+
+    /** The frame the cache was built from (BGR or already grayscale) */
+    const cv::Mat &color() const { return frame; }
+
+    /** 8-bit grayscale version of the frame */
+    const cv::Mat &gray();
+
+    /**
+     * Gaussian pyramid of the grayscale frame in the layout used by
+     * calcOpticalFlowPyrLK (level 0 is full resolution)
+     */
+    const std::vector<cv::Mat> &pyramid();
+
+    /** Unscaled 3x3 Sobel derivatives (CV_32F) of the grayscale frame */
+    const cv::Mat &gradX();
+    const cv::Mat &gradY();
+
+    static const int pyramidLevels = 3;
+    static const int pyramidWinSize = 21; //LK window size the pyramid is padded for
+
+private:
+    cv::Mat frame;
+    cv::Mat grayImg; //either the frame itself or grayBuf
+    cv::Mat grayBuf;
+    std::vector<cv::Mat> pyr;
+    cv::Mat dx, dy;
+
+    bool hasGray;
+    bool hasPyramid;
+    bool hasGradients;
+
+    void computeGradients();
+};
+
+#endif
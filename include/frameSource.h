@@ -0,0 +1,221 @@
+/* frameSource.h
+ * Deterministic camera input. A raw capture file is a preallocated,
+ * memory-mapped ring of uncompressed frames with their capture timestamps:
+ * recording copies each frame straight into the mapping, and replay hands out
+ * Mats that point into the mapping (no decode, no copy), paced either by the
+ * recorded timestamps or as fast as possible. FrameSource opens a camera,
+ * a video file or a raw capture behind one interface and can record whatever
+ * it reads, so every program can take any of them in place of VideoCapture(0).
+ * V4L2 devices (/dev/videoN) and their file stand-ins go through LumaCapture,
+ * whose luma plane detection can use without waiting for a color frame.
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "opencv2/core/core.hpp"
+#include "opencv2/videoio/videoio.hpp"
+#include "lumaCapture.h"
+
+const char RAW_CAPTURE_MAGIC[8] = {'A', 'R', 'R', 'A', 'W', 'C', 'A', 'P'};
+const uint32_t RAW_CAPTURE_VERSION = 1;
+
+/**
+ * Start of a raw capture file; one page long so every slot is page-aligned
+ */
+struct RawCaptureHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t type;       //OpenCV type of the frames, e.g. CV_8UC3
+    uint64_t frameBytes; //width * height * pixel size
+    uint64_t slotBytes;  //frame header + pixels, rounded up to a page
+    uint64_t capacity;   //slots in the ring
+    uint64_t written;    //frames recorded so far (the ring keeps the last capacity of them)
+    char pad[4096 - 56];
+};
+
+/**
+ * Start of each slot; the frame's pixels follow it, rows packed
+ */
+struct RawFrameHeader
+{
+    uint64_t frameNumber;
+    uint64_t timestampUs; //capture time, steady clock microseconds
+    char pad[64 - 16];
+};
+
+/**
+ * Writes frames into a raw capture file
+ */
+class RawCaptureWriter
+{
+public:
+    RawCaptureWriter();
+    ~RawCaptureWriter();
+
+    /**
+     * Creates the file with room for capacity frames of the given size and
+     * type, allocating all of it up front so recording never extends the file
+     */
+    bool open(const std::string &filename, cv::Size frameSize, int type, int capacity);
+
+    /** Copies the frame into the next slot, overwriting the oldest once full */
+    bool write(const cv::Mat &frame, uint64_t timestampUs);
+
+    void close();
+
+    bool isOpened() const { return header != NULL; }
+
+private:
+    RawCaptureHeader *header;
+    size_t mappedSize;
+};
+
+/**
+ * Replays a raw capture file, oldest frame first
+ */
+class RawCaptureReader
+{
+public:
+    RawCaptureReader();
+    ~RawCaptureReader();
+
+    /** realTime: wait so frames come out with their recorded spacing */
+    bool open(const std::string &filename, bool realTime);
+
+    /**
+     * Points frame at the next recorded frame, without copying; the Mat stays
+     * valid until the reader is closed, and drawing into it only changes this
+     * process's copy-on-write view, never the file. False after the last frame.
+     */
+    bool read(cv::Mat &frame);
+
+    void close();
+
+    bool isOpened() const { return header != NULL; }
+    cv::Size size() const;
+    double fps() const;     //from the recorded timestamps
+    int frameCount() const { return (int)count; }
+    uint64_t timestampUs() const { return lastTimestamp; } //recorded capture time of the last frame read
+
+private:
+    const RawCaptureHeader *header;
+    unsigned char *base;
+    size_t mappedSize;
+    uint64_t first; //index of the oldest frame still in the ring
+    uint64_t count;
+    uint64_t next;
+    bool realTime;
+    uint64_t lastTimestamp;
+    std::chrono::steady_clock::time_point replayStart;
+    uint64_t firstTimestamp;
+
+    const RawFrameHeader *slot(uint64_t index) const;
+};
+
+/**
+ * Where a program gets its frames, set with the shared command line flags
+ */
+struct FrameSourceOptions
+{
+    std::string source;    //camera index, /dev/videoN[@WxH], stand-in file@WxH, video file or .raw capture
+    std::string recordFile; //raw capture to record every frame read into ("" = none)
+    int recordCapacity;    //frames in the recording ring
+    bool fastReplay;       //replay raw captures as fast as possible
+
+    FrameSourceOptions() : source("0"), recordCapacity(600), fastReplay(false) {}
+};
+
+/**
+ * Handles the frame source flags if argv[i] is one, advancing i past any
+ * value; returns false if argv[i] isn't a frame source flag:
+ *   -c source            camera index, /dev/videoN[@WxH] (V4L2, luma zero-copy),
+ *                        frames.nv12@WxH (stand-in device), video file or
+ *                        .raw capture (default 0)
+ *   -r capture.raw[=n]   record raw frames into a ring of n (default 600)
+ *   -F                   replay raw captures and stand-ins as fast as possible
+ */
+bool parseFrameSourceFlag(int argc, char *argv[], int &i, FrameSourceOptions &options);
+
+/** Usage text for the frame source flags */
+extern const char *FRAME_SOURCE_USAGE;
+
+/**
+ * A camera, video file or raw capture, with optional raw recording of what
+ * is read; mirrors the parts of VideoCapture the programs use
+ */
+class FrameSource
+{
+public:
+    FrameSource();
+    explicit FrameSource(const FrameSourceOptions &options);
+
+    /**
+     * Opens the source: all digits means a camera index, /dev/videoN or a
+     * .grey/.nv12/.i420/.yuyv stand-in (with @WxH) goes to LumaCapture, a .raw
+     * file is replayed, anything else goes to VideoCapture
+     */
+    bool open(const FrameSourceOptions &options);
+    bool open(const std::string &source);
+
+    bool isOpened() const;
+
+    /**
+     * Reads the next frame; false at the end of a file or if the camera fails.
+     * VideoCapture decodes into frame itself, so a buffer the caller swaps
+     * away is never written again; a raw capture points frame into the
+     * replayed file without copying
+     */
+    bool read(cv::Mat &frame);
+    FrameSource &operator>>(cv::Mat &frame) { read(frame); return *this; }
+
+    /** Takes the next frame without making a color image of it */
+    bool grab();
+
+    /**
+     * The frame last grabbed in BGR (V4L2 and VideoCapture: converted now, into
+     * frame's own buffer) or as recorded. VideoCapture frames are recorded as
+     * they are retrieved
+     */
+    bool retrieve(cv::Mat &frame);
+
+    /**
+     * Luma plane of the frame last grabbed, pointing into the capture buffer,
+     * if the source has one (V4L2); empty otherwise
+     */
+    const cv::Mat &luma() const { return backend == BACKEND_LUMA ? lumaCapture.luma() : noLuma; }
+
+    /** CAP_PROP_FRAME_WIDTH, CAP_PROP_FRAME_HEIGHT or CAP_PROP_FPS */
+    double get(int propId);
+
+    /** Capture time of the last frame read (the recorded time when replaying) */
+    uint64_t timestampUs() const { return lastTimestamp; }
+
+private:
+    enum Backend { BACKEND_VIDEOCAPTURE, BACKEND_RAW, BACKEND_LUMA };
+
+    cv::VideoCapture capture;
+    RawCaptureReader replay;
+    LumaCapture lumaCapture;
+    RawCaptureWriter recorder;
+    Backend backend;
+    cv::Mat grabbed; //last frame from a raw replay
+    cv::Mat noLuma;
+    std::string recordFile;
+    int recordCapacity;
+    uint64_t lastTimestamp;
+
+    void record(const cv::Mat &frame);
+};
+
+#endif
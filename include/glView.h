@@ -0,0 +1,67 @@
+/* glView.h
+ * Ties the OpenGL view to the camera: a projection matrix from the calibrated
+ * intrinsics, a modelview matrix from the solvePnP pose, and a background
+ * texture that streams each camera frame in through pixel buffer objects
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef GLVIEW_H
+#define GLVIEW_H
+
+#include "retainedRenderer.h" //GL headers with extension prototypes
+#include "opencv2/core/core.hpp"
+
+/**
+ * OpenGL projection matrix (row-major) that reproduces the pinhole camera with
+ * the given intrinsics for an image of the given size, so rendered geometry
+ * lines up with the video frame
+ */
+cv::Matx44f projectionFromIntrinsics(const cv::Mat &cameraMatrix, cv::Size imageSize,
+                                     float nearPlane, float farPlane);
+
+/**
+ * OpenGL modelview matrix (row-major) for a board pose from solvePnP,
+ * converting OpenCV's camera axes (y down, z forward) to OpenGL's (y up, z back)
+ */
+cv::Matx44f modelviewFromPose(const cv::Mat &rvec, const cv::Mat &tvec);
+
+/**
+ * Full-screen textured quad in normalized device coordinates, with texture
+ * coordinates flipped so image row 0 is at the top
+ */
+MeshData makeBackgroundQuad();
+
+/**
+ * Texture that is updated every frame from a BGR Mat. Uploads go through two
+ * pixel buffer objects in turn: the frame is copied into one while the texture
+ * is filled from the other, so the transfer overlaps with rendering and the
+ * texture storage is only allocated when the frame size changes. The texture
+ * therefore shows the previous frame, except right after (re)allocation,
+ * when there is no previous frame and the current one is uploaded directly.
+ */
+class StreamedTexture
+{
+public:
+    StreamedTexture();
+    ~StreamedTexture();
+
+    /** Queues the frame for upload and updates the texture (GL context must be current) */
+    void update(const cv::Mat &frame);
+
+    GLuint id() const { return texture; }
+
+private:
+    GLuint texture;
+    GLuint pixelBuffers[2];
+    cv::Size size;
+    size_t bufferBytes;
+    int next; //pixel buffer that receives the next frame
+
+    void allocate(cv::Size frameSize);
+    void fill(int buffer, const cv::Mat &frame);
+};
+
+#endif
@@ -0,0 +1,28 @@
+/* imageList.h
+ * Turns an image directory or glob pattern into a sorted list of image
+ * files, for arSystem's batch mode and for profileEval's datasets
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef IMAGELIST_H
+#define IMAGELIST_H
+
+#include <string>
+#include <vector>
+
+/** True if the filename has an image extension OpenCV can decode */
+bool hasImageExtension(const std::string &name);
+
+/** True if the name is a directory or a glob pattern rather than one file */
+bool isImageBatch(const std::string &name);
+
+/**
+ * Appends a directory's image files, or the images a glob pattern (or a
+ * single filename) matches, to files in sorted order
+ */
+void listImages(const std::string &name, std::vector<std::string> &files);
+
+#endif
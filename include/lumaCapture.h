@@ -0,0 +1,106 @@
+/* lumaCapture.h
+ * Camera capture straight from V4L2 for programs that detect on grayscale.
+ * The driver's buffers are memory-mapped and each frame's luma (Y) plane is
+ * handed out as a grayscale Mat pointing into the buffer, so detection reads
+ * the camera's own bytes with no color conversion and no copy; a BGR image is
+ * only made (from the same buffer) for frames that are shown or recorded.
+ *
+ * Planar formats (GREY, NV12, YUV420) are zero-copy. Most USB webcams only
+ * stream YUYV, where luma is interleaved with chroma: there the Y bytes are
+ * gathered into one buffer, a single cheap pass instead of YUYV to BGR to
+ * gray.
+ *
+ * A regular file of raw frames (.grey, .nv12, .i420 or .yuyv, e.g. written
+ * by "ffmpeg -i in.mp4 -pix_fmt nv12 -f rawvideo frames.nv12") stands in for
+ * the device on machines without a camera: it is memory-mapped and read
+ * through the same luma and color paths.
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef LUMACAPTURE_H
+#define LUMACAPTURE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "opencv2/core/core.hpp"
+
+class LumaCapture
+{
+public:
+    LumaCapture();
+    ~LumaCapture();
+
+    /**
+     * Opens a V4L2 device (/dev/videoN) or a stand-in file. size asks the
+     * device for a frame size (empty: keep its current one) and is required
+     * for a stand-in; realTime paces a stand-in at 30 fps like a camera.
+     */
+    bool open(const std::string &device, cv::Size size, bool realTime);
+
+    /**
+     * Waits for the next frame and gives the previous buffer back to the
+     * driver; false if the device fails or the stand-in has run out
+     */
+    bool grab();
+
+    /**
+     * Luma plane of the last frame grabbed, pointing into the capture
+     * buffer; valid until the next grab
+     */
+    const cv::Mat &luma() const { return lumaImg; }
+
+    /** Converts the last frame grabbed to BGR */
+    void retrieveColor(cv::Mat &bgr) const;
+
+    void close();
+
+    bool isOpened() const { return device >= 0 || file != NULL; }
+    cv::Size size() const { return cv::Size(width, height); }
+    double fps() const { return frameRate; }
+    int frameCount() const { return (int)fileFrames; } //stand-in only (0 for a device)
+    uint64_t timestampUs() const { return lastTimestamp; } //capture time of the last frame grabbed
+
+    /** True if source names a device or stand-in this class opens */
+    static bool handles(const std::string &source);
+
+private:
+    struct Buffer
+    {
+        unsigned char *start;
+        size_t length;
+    };
+
+    uint32_t pixelFormat; //V4L2 fourcc
+    int width;
+    int height;
+    int stride;           //bytes per luma row
+    double frameRate;
+
+    int device;           //V4L2 file descriptor, -1 if closed
+    std::vector<Buffer> buffers;
+    int dequeued;         //buffer the current frame is in, -1 if none
+
+    unsigned char *file;  //mapped stand-in, NULL if not one
+    size_t fileBytes;
+    size_t frameBytes;
+    uint64_t fileFrames;
+    uint64_t nextFrame;
+    bool realTime;
+    std::chrono::steady_clock::time_point replayStart;
+
+    const unsigned char *frameData; //the current frame, whole
+    cv::Mat lumaImg;
+    cv::Mat lumaBuf;      //gathered Y bytes for interleaved formats
+    uint64_t lastTimestamp;
+
+    bool openDevice(const std::string &path, cv::Size size);
+    bool openStandIn(const std::string &path, cv::Size size);
+    void wrapFrame(const unsigned char *data);
+};
+
+#endif
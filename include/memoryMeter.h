@@ -0,0 +1,52 @@
+/* memoryMeter.h
+ * Measures memory for fitting arSystem into small devices: the process's
+ * peak and current resident set size, and the bytes allocated for Mat
+ * buffers in each frame. Mat allocations are counted by installing a
+ * counting allocator as OpenCV's default, which hands every request on to
+ * the standard one; a pipeline that reuses its buffers allocates nothing
+ * once it has seen its first frames. Allocations inside OpenCV that don't go
+ * through Mat (scratch AutoBuffers, std::vector) aren't counted.
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef MEMORYMETER_H
+#define MEMORYMETER_H
+
+#include <cstdint>
+#include "opencv2/core/core.hpp"
+
+class MemoryMeter
+{
+public:
+    /** Starts counting Mat allocations (for the rest of the process) */
+    MemoryMeter();
+
+    /** Marks the start of a frame */
+    void startFrame();
+
+    /** Ends the frame, adding its allocations to the totals */
+    void endFrame();
+
+    /** Mat bytes and buffers allocated during the last complete frame */
+    uint64_t frameBytes() const { return lastBytes; }
+    uint64_t frameAllocations() const { return lastAllocations; }
+
+    /** Resident set size in kilobytes: the highest so far, and now */
+    static long peakRssKb();
+    static long currentRssKb();
+
+    /** Prints peak RSS and per-frame allocation stats over all frames */
+    void printSummary() const;
+
+private:
+    uint64_t startBytes, startAllocations;
+    uint64_t lastBytes, lastAllocations;
+    uint64_t totalBytes, maxBytes;
+    int frames;
+    int quietFrames; //frames that allocated nothing
+};
+
+#endif
@@ -0,0 +1,70 @@
+/* multiBoardDetector.h
+ * Finds several chessboards, possibly of different sizes, in one frame.
+ * Boards found in the previous frame are re-found inside their own ROIs;
+ * the rest of the frame is searched with every found board masked out,
+ * repeating until nothing new turns up. ROI and per-size searches run in parallel.
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef MULTIBOARDDETECTOR_H
+#define MULTIBOARDDETECTOR_H
+
+#include <vector>
+#include "opencv2/core/core.hpp"
+#include "frameCache.h"
+#include "boardGeometry.h"
+
+/**
+ * One board found in a frame
+ */
+struct DetectedBoard
+{
+    const BoardOps *board;
+    BoardPose pose;
+    cv::Rect roi; //bounding box of the corners in frame coordinates
+};
+
+class MultiBoardDetector
+{
+public:
+    /**
+     * boards: sizes to look for; maxPerSize: how many copies of each size
+     * may be in view; fullSearchInterval: frames between whole-frame searches
+     * while every tracked board is still being found in its ROI
+     */
+    MultiBoardDetector(const std::vector<const BoardOps *> &boards, int maxPerSize = 4,
+                       int fullSearchInterval = 10);
+
+    /**
+     * Detects all boards in the cached frame and solves each one's pose
+     */
+    void detect(FrameCache &cache, const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs,
+                std::vector<DetectedBoard> &found);
+
+    /** Forget all tracked ROIs (e.g. after a scene cut) */
+    void reset();
+
+    int subPixIterations; //refinement iterations per corner (0 = off)
+
+private:
+    std::vector<const BoardOps *> boards;
+    int maxPerSize;
+    int fullSearchInterval;
+    int framesSinceFullSearch;
+    std::vector<DetectedBoard> tracked; //boards found in the previous frame
+    cv::Mat masked; //grayscale frame with found boards blanked out
+
+    void searchROIs(const cv::Mat &gray, std::vector<DetectedBoard> &found);
+    void searchMasked(const cv::Mat &gray, std::vector<DetectedBoard> &found);
+};
+
+/**
+ * Blanks out the area covered by the given board corners (plus a margin
+ * of about one square) so the detector won't find that board again
+ */
+void maskBoard(cv::Mat &gray, const std::vector<cv::Point2f> &corners, const cv::Size &boardSize);
+
+#endif
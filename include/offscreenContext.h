@@ -0,0 +1,59 @@
+/* offscreenContext.h
+ * Headless OpenGL: a surfaceless EGL context rendering into a framebuffer
+ * object, with asynchronous read-back through two pixel buffer objects (frame
+ * N is read into one while frame N-1 is copied out of the other), so no window
+ * or display is needed and reading pixels doesn't stall the pipeline
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef OFFSCREENCONTEXT_H
+#define OFFSCREENCONTEXT_H
+
+#include <EGL/egl.h>
+#include "retainedRenderer.h" //GL headers with extension prototypes
+#include "opencv2/core/core.hpp"
+
+class OffscreenContext
+{
+public:
+    OffscreenContext();
+    ~OffscreenContext();
+
+    /**
+     * Creates the context and a width x height color + depth framebuffer;
+     * returns false if no EGL/OpenGL implementation is usable
+     */
+    bool create(cv::Size frameSize);
+
+    /** Makes the context current and binds the framebuffer for drawing */
+    void beginFrame();
+
+    /**
+     * Starts reading back the frame just drawn and copies the previous one
+     * into out (BGR, top row first); returns false when there is no previous
+     * frame yet, i.e. on the first call
+     */
+    bool readFrame(cv::Mat &out);
+
+    /** Copies out the last frame still in flight; returns false if none */
+    bool finish(cv::Mat &out);
+
+    cv::Size size() const { return frameSize; }
+
+private:
+    EGLDisplay display;
+    EGLContext context;
+    GLuint framebuffer;
+    GLuint colorBuffer;
+    GLuint depthBuffer;
+    GLuint packBuffers[2];
+    cv::Size frameSize;
+    int frameCount;
+
+    void copyOut(GLuint buffer, cv::Mat &out);
+};
+
+#endif
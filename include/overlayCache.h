@@ -0,0 +1,83 @@
+/* overlayCache.h
+ * Skips redrawing the AR overlay while the board holds still. Whenever the
+ * overlay is drawn, the pixels inside its bounding box are kept as a layer,
+ * together with the poses it was drawn at and a coverage mask rendered from
+ * the same draw list, so a hit puts back exactly the pixels a redraw would
+ * write. On later frames, if no
+ * board's pose has moved far enough to shift the overlay by more than
+ * maxShift pixels since then, the layer is copied into the new frame within
+ * that box instead of projecting and rasterizing everything again. Poses are
+ * compared against the ones the layer was drawn at, not the last frame's, so
+ * slow drift still triggers a redraw once it adds up.
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef OVERLAYCACHE_H
+#define OVERLAYCACHE_H
+
+#include <vector>
+#include "opencv2/core/core.hpp"
+#include "drawList.h"
+#include "multiBoardDetector.h"
+
+/**
+ * How often the cached layer stood in for a redraw, and what each path cost
+ */
+struct OverlayCacheStats
+{
+    int hits;       //frames composited from the layer
+    int misses;     //frames drawn from scratch
+    double hitMs;   //total overlay time on hits
+    double missMs;  //total overlay time on misses (projection, drawing and keeping the layer)
+
+    OverlayCacheStats() : hits(0), misses(0), hitMs(0), missMs(0) {}
+
+    double hitRate() const { return hits + misses > 0 ? (double)hits / (hits + misses) : 0; }
+
+    /** Mean overlay time saved per frame drawn, against redrawing every frame */
+    double savedMsPerFrame() const;
+};
+
+class OverlayCache
+{
+public:
+    /** maxShift: estimated overlay motion in pixels that still reuses the layer */
+    explicit OverlayCache(double maxShift = 0.5);
+
+    /**
+     * If the layer was drawn at poses close enough to these boards' (with the
+     * same frame size and level of detail), copies it into frame and returns
+     * true; otherwise the overlay has to be drawn
+     */
+    bool reuse(const std::vector<DetectedBoard> &boards, const cv::Mat &cameraMatrix,
+               float lodScale, cv::Mat &frame);
+
+    /** Renders the overlay into frame and keeps what it drew as the new layer */
+    void render(DrawList &overlay, const std::vector<DetectedBoard> &boards, float lodScale,
+                cv::Mat &frame, bool antiAlias);
+
+    /** Forgets the layer, so the next frame is drawn */
+    void invalidate() { valid = false; }
+
+    /** Adds one frame's overlay time to the stats */
+    void record(bool hit, double ms);
+
+    double maxShift;
+    OverlayCacheStats stats;
+
+private:
+    bool valid;
+    cv::Rect box;              //where the layer goes in the frame
+    cv::Mat layer, mask;       //the overlay's pixels in box, and which of them it drew
+    cv::Mat coverage;          //frame-sized mask the draw list marks its pixels in; mask is its box
+    cv::Size frameSize;
+    int frameType;
+    float layerLod;
+    std::vector<const BoardOps *> layerBoards;
+    std::vector<cv::Mat> layerRotations, layerTranslations;
+};
+
+#endif
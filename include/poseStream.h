@@ -0,0 +1,159 @@
+/* poseStream.h
+ * Binary pose stream: every frame's timestamped pose, reprojection error and
+ * detection status go into a single-writer ring buffer in POSIX shared memory,
+ * so other processes on the machine can read poses at full rate without
+ * parsing text. Each slot is guarded by a sequence counter (seqlock), so the
+ * writer never waits for readers and readers never see half-written records.
+ * The same records can optionally be appended to a compact binary log file.
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef POSESTREAM_H
+#define POSESTREAM_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared-memory ring needs lock-free 64-bit atomics");
+
+const uint32_t POSE_STREAM_MAGIC = 0x41525053; //"ARPS"
+const uint32_t POSE_STREAM_VERSION = 1;
+
+enum PoseStatus
+{
+    POSE_NO_BOARD = 0,
+    POSE_FOUND = 1
+};
+
+/**
+ * One published pose (one per board found, or a single POSE_NO_BOARD
+ * record for frames without a board)
+ */
+struct PoseRecord
+{
+    uint64_t frameNumber;
+    uint64_t timestampUs;  //CLOCK_MONOTONIC microseconds when the frame was processed
+    uint32_t streamId;     //which input stream (camera) the frame came from
+    uint32_t boardIndex;   //board number within the frame
+    int32_t status;        //a PoseStatus
+    int16_t boardWidth;    //inner corners of the board
+    int16_t boardHeight;
+    float reprojError;     //RMS pixels
+    uint32_t reserved;
+    double rvec[3];
+    double tvec[3];
+};
+
+/**
+ * Ring slot: seq is odd while the writer is filling the record and
+ * 2*(index+1) once record number index is complete
+ */
+struct PoseSlot
+{
+    std::atomic<uint64_t> seq;
+    PoseRecord record;
+};
+
+struct PoseRingHeader
+{
+    std::atomic<uint32_t> magic; //set last, once the ring is initialized
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t recordSize;
+    std::atomic<uint64_t> writeIndex; //number of records published so far
+    char pad[64 - 24]; //keep the writer's counter off the first slot's cache line
+};
+
+/** Current CLOCK_MONOTONIC time in microseconds */
+uint64_t poseTimestampUs();
+
+/**
+ * Writer side: owns the shared-memory ring and the optional log file
+ */
+class PosePublisher
+{
+public:
+    PosePublisher();
+    ~PosePublisher();
+
+    /**
+     * Creates (or recreates) the shared-memory ring with the given name,
+     * e.g. "/arPoses"; returns false if shared memory is unavailable
+     */
+    bool open(const char *shmName, uint32_t capacity = 4096);
+
+    /** Also appends every record to the given binary log file */
+    bool openLog(const char *logFilename);
+
+    /** Publishes one record to the ring (and log); never blocks on readers */
+    void publish(const PoseRecord &record);
+
+    void close();
+
+private:
+    PoseRingHeader *header;
+    PoseSlot *slots;
+    size_t mappedSize;
+    uint64_t nextIndex;
+    FILE *logFile;
+    bool logFailed; //a log write failed and was reported; later failures stay quiet
+    char name[256];
+};
+
+/**
+ * Reader side: attaches to a publisher's ring and returns records in order
+ */
+class PoseReader
+{
+public:
+    PoseReader();
+    ~PoseReader();
+
+    /**
+     * Attaches to the named ring; fromOldest starts at the oldest record
+     * still in the ring instead of only returning new ones
+     */
+    bool open(const char *shmName, bool fromOldest = false);
+
+    /**
+     * Copies the next record into record; returns false if there is nothing
+     * new yet. If the reader fell more than a ring behind, it skips ahead
+     * and counts the lost records in dropped().
+     */
+    bool next(PoseRecord &record);
+
+    uint64_t dropped() const { return droppedCount; }
+
+    void close();
+
+private:
+    const PoseRingHeader *header;
+    const PoseSlot *slots;
+    size_t mappedSize;
+    uint64_t readIndex;
+    uint64_t droppedCount;
+};
+
+/**
+ * Binary log file layout: a PoseLogHeader followed by raw PoseRecords
+ */
+struct PoseLogHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t reserved;
+};
+
+/**
+ * Reads the next record from a binary pose log opened with fopen(..., "rb")
+ * (checks the file header on the first call); returns false at end of file
+ * or if the header is from another version or record layout
+ */
+bool readPoseLog(FILE *logFile, PoseRecord &record);
+
+#endif
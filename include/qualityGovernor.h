@@ -0,0 +1,129 @@
+/* qualityGovernor.h
+ * Holds a frame rate (or per-frame latency budget) on slower machines by
+ * trading quality for time at runtime. Each frame's capture, detection,
+ * overlay and display times are measured; while detection, overlay and
+ * display together run over budget, the knob belonging to the most
+ * expensive stage is stepped down one level (fewer corner refinement
+ * iterations, then tracking between detections, then detection resolution;
+ * overlay level of detail; display rate). Every knob's full-quality level is
+ * the setting arSystem uses without a governor. Capture is only measured,
+ * since the knobs can't speed it up and from a camera it is mostly time
+ * spent waiting for the next frame. When there is headroom again the most
+ * recent step is undone, but only if the time it saved still fits. Every
+ * decision is printed and optionally logged to a CSV file with the timings
+ * behind it.
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef QUALITYGOVERNOR_H
+#define QUALITYGOVERNOR_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "opencv2/core/core.hpp"
+
+enum GovernorStage
+{
+    STAGE_CAPTURE,
+    STAGE_DETECT,  //detection, tracking and pose
+    STAGE_OVERLAY, //projecting and compositing the AR objects
+    STAGE_DISPLAY, //showing or encoding the frame
+    NUM_STAGES
+};
+
+enum QualityKnob
+{
+    KNOB_SUBPIX,          //corner refinement iterations
+    KNOB_DETECT_INTERVAL, //frames per full detection (tracked between)
+    KNOB_DETECT_SCALE,    //resolution detection runs at
+    KNOB_LOD,             //scene level-of-detail tolerance
+    KNOB_DISPLAY,         //frames per displayed frame
+    NUM_KNOBS
+};
+
+/**
+ * Detection and drawing settings for one frame; the defaults are the fixed
+ * quality arSystem runs at without a governor
+ */
+struct QualitySettings
+{
+    float detectScale;    //detection runs on the grayscale frame scaled by this
+    int detectInterval;   //full detection every this many frames, optical flow tracking between
+    int subPixIterations; //cornerSubPix iterations at full resolution (0 = off)
+    float lodScale;       //multiplies the scene's level-of-detail pixel tolerance
+    int displayInterval;  //show every this many frames
+
+    QualitySettings()
+        : detectScale(1), detectInterval(1), subPixIterations(5), lodScale(1), displayInterval(1) {}
+};
+
+class QualityGovernor
+{
+public:
+    /** budgetMs: time per frame to stay under (1000 / target fps) */
+    explicit QualityGovernor(double budgetMs);
+    ~QualityGovernor();
+
+    /** Also writes every decision to this CSV file; false if it can't be created */
+    bool openLog(const char *filename);
+
+    /** Keeps a knob at full quality (e.g. level of detail with no scene loaded) */
+    void disableKnob(QualityKnob knob);
+
+    /** Marks the start of a frame, before it is captured */
+    void startFrame();
+
+    /** Charges the time since the last mark to the given stage */
+    void endStage(GovernorStage stage);
+
+    /**
+     * Ends the frame and, if a change is due, steps one knob down or up;
+     * returns true if the settings changed
+     */
+    bool endFrame();
+
+    const QualitySettings &settings() const { return current; }
+    double budget() const { return budgetMs; }
+
+    /** "30" is a frame rate, "40ms" a latency budget; returns the budget in ms, or 0 if invalid */
+    static double parseTarget(const char *target);
+
+private:
+    struct Step
+    {
+        QualityKnob knob;
+        double frameMsBefore; //smoothed frame time just before stepping down
+        double savedMs;       //how much the step saved once settled (-1 until measured)
+    };
+
+    double budgetMs;
+    QualitySettings current;
+    int level[NUM_KNOBS]; //0 = full quality
+    bool enabled[NUM_KNOBS];
+    std::vector<Step> steps; //steps down still in effect, most recent last
+
+    double stageMs[NUM_STAGES]; //smoothed
+    double frameStageMs[NUM_STAGES]; //this frame so far
+    bool haveTimings;
+    int64 lastMark;
+    long frameNumber;
+    long lastChange;
+    int framesOver;
+    bool reportedFloor; //already said there is nothing left to lower
+
+    FILE *log;
+
+    int numLevels(QualityKnob knob) const;
+    void apply();
+    double frameMs() const;
+    bool stepDown();
+    bool stepUp();
+    void record(const char *direction, QualityKnob knob, int fromLevel, const std::string &reason);
+    std::string describe(QualityKnob knob, int atLevel) const;
+};
+
+#endif
@@ -0,0 +1,97 @@
+/* retainedRenderer.h
+ * Retained-mode OpenGL renderer: geometry is uploaded once into vertex and
+ * index buffer objects and drawn with indexed calls, with instanced draws for
+ * repeated objects (hardware instancing when GL_ARB_instanced_arrays is
+ * available, otherwise one glDrawElements per instance on already-bound buffers).
+ * Only needs GL 1.5 + GLSL 1.20, so it also runs on Mesa's software
+ * rasterizer (LIBGL_ALWAYS_SOFTWARE=1) on machines without a GPU.
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef RETAINEDRENDERER_H
+#define RETAINEDRENDERER_H
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <vector>
+#include "opencv2/core/core.hpp"
+
+/**
+ * Interleaved vertex layout of every uploaded mesh
+ */
+struct MeshVertex
+{
+    GLfloat position[3];
+    GLfloat normal[3];
+    GLfloat texCoord[2];
+};
+
+/**
+ * Mesh data on the CPU side, before upload
+ */
+struct MeshData
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<GLuint> indices; //triangle list
+};
+
+/**
+ * Builds a cube of the given edge length centered on the origin, with
+ * per-face normals and a full texture on each face
+ */
+MeshData makeCubeMesh(float size);
+
+class RetainedRenderer
+{
+public:
+    RetainedRenderer();
+    ~RetainedRenderer();
+
+    /**
+     * Sets up instancing support; call once with the GL context current
+     */
+    void init();
+
+    /** Uploads a mesh into buffer objects and returns its handle */
+    int uploadMesh(const MeshData &mesh);
+
+    /** Draws the mesh once with the current modelview matrix */
+    void draw(int meshId);
+
+    /**
+     * Draws the mesh once per 4x4 model matrix, each applied on top of the
+     * current modelview matrix; matrices are row-major like any Matx, with
+     * the translation in the last column, and are transposed for GL here
+     */
+    void drawInstanced(int meshId, const std::vector<cv::Matx44f> &instances);
+
+    /** Resets the per-frame counters below */
+    void beginFrame();
+
+    int drawCalls;      //GL draw calls issued this frame
+    long trianglesDrawn; //triangles submitted this frame
+
+    bool hardwareInstancing() const { return instanceProgram != 0; }
+
+private:
+    struct GpuMesh
+    {
+        GLuint vertexBuffer;
+        GLuint indexBuffer;
+        GLsizei indexCount;
+    };
+
+    std::vector<GpuMesh> meshes;
+    GLuint instanceBuffer;  //per-instance model matrices
+    GLuint instanceProgram; //0 if hardware instancing is unavailable
+    GLint instanceAttrib;   //first of the four matrix column attributes
+
+    void bindMesh(const GpuMesh &mesh);
+    void unbindMesh();
+};
+
+#endif
@@ -0,0 +1,108 @@
+/* saddleDetector.h
+ * Chessboard detection from saddle points instead of findChessboardCorners'
+ * quads. Peaks of the Harris response (built from the frame cache's Sobel
+ * gradients) are refined to subpixel saddles, and a ring of samples around
+ * each keeps only X-junctions: light and dark alternating twice around it,
+ * opposite sides matching. The ring also gives the directions of the two
+ * edges crossing there. Starting from a strong saddle, the grid is grown
+ * one neighbor at a time along those edges, predicting each next corner from
+ * the step to the last. Finally the grid is placed on the board by which
+ * squares are dark and where the white margin shows, so a board that is
+ * partly hidden or partly out of frame still comes back, with each corner's
+ * index on the board, as long as where it sits on the board is unambiguous.
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef SADDLEDETECTOR_H
+#define SADDLEDETECTOR_H
+
+#include <vector>
+#include "opencv2/core/core.hpp"
+#include "frameCache.h"
+#include "boardGeometry.h"
+
+/**
+ * Computes the Harris corner response of the cached frame into dst, building the
+ * structure tensor from the cache's Sobel gradients instead of re-deriving them
+ * (same scaling as cornerHarris, so thresholds carry over)
+ */
+void harrisResponse(FrameCache &cache, cv::Mat &dst, int blockSize, int apertureSize, double k);
+
+/**
+ * An X-junction found in the frame
+ */
+struct SaddlePoint
+{
+    cv::Point2f pos;
+    float axisA, axisB; //directions of the two edges crossing here, radians in [0, pi)
+    float response;     //Harris response at the peak it was refined from
+};
+
+/**
+ * A board found by the saddle detector, possibly only part of it
+ */
+struct SaddleBoard
+{
+    std::vector<cv::Point2f> corners; //in increasing index order
+    std::vector<int> indices;         //board index of each corner (row * width + column)
+    bool complete;                    //every corner was found (corners are then in object point order)
+};
+
+class SaddleDetector
+{
+public:
+    explicit SaddleDetector(const BoardOps *board);
+
+    /**
+     * Finds the board in the cached frame; false if no grid of at least
+     * minCorners saddles was found or its place on the board is ambiguous.
+     * subPixIterations > 0 refines the corners further with cornerSubPix.
+     */
+    bool detect(FrameCache &cache, SaddleBoard &result, int subPixIterations = 0);
+
+    /** X-junctions found by the last detect, board or not */
+    const std::vector<SaddlePoint> &saddles() const { return points; }
+
+    int minCorners; //fewest corners accepted as a board (default 8, at least 2 rows and columns)
+    int blockSize;  //structure tensor window (default 5)
+
+private:
+    struct GridNode
+    {
+        int saddle;
+        int gx, gy;
+        cv::Point2f stepX, stepY; //local grid steps, for predicting the next neighbors
+    };
+
+    const BoardOps *board;
+    int gridRadius; //grid coordinates range over [-gridRadius, gridRadius]
+
+    //per-frame workspace, kept so same-size frames don't reallocate
+    cv::Mat response;
+    std::vector<cv::Point2f> peaks;
+    std::vector<cv::Point> peakPixels;
+    std::vector<SaddlePoint> points;
+    std::vector<int> order;
+    std::vector<GridNode> nodes, bestNodes;
+    std::vector<int> cellNode;
+    std::vector<char> used;
+
+    void findSaddles(FrameCache &cache);
+    bool classify(const cv::Mat &gray, cv::Point2f pos, SaddlePoint &saddle) const;
+    void growGrid(int seed);
+    bool placeOnBoard(const cv::Mat &gray, SaddleBoard &result);
+    int &cell(int gx, int gy) { return cellNode[(gy + gridRadius) * (2 * gridRadius + 1) + gx + gridRadius]; }
+};
+
+/**
+ * Solves for a board's pose from the corners with the given board indices
+ * (empty indices: a complete board in object point order)
+ */
+bool solvePartialBoardPose(const BoardOps *board, const std::vector<cv::Point2f> &corners,
+                           const std::vector<int> &indices, const cv::Mat &cameraMatrix,
+                           const cv::Mat &distCoeffs, BoardPose &pose);
+
+#endif
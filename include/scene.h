@@ -0,0 +1,125 @@
+/* scene.h
+ * AR overlay content loaded from a scene file instead of compiled in:
+ * wireframe meshes read from OBJ files, placed in board coordinates by a
+ * text manifest. Each frame, objects outside the camera frustum or smaller
+ * than a pixel are culled, the rest get a level of detail from their
+ * projected size, and only what survives is projected and drawn.
+ *
+ * Manifest format (one entry per line, # starts a comment, paths are
+ * relative to the manifest):
+ *   mesh <name> <file.obj> [<coarser.obj>...]
+ *   object <mesh name> <x> <y> <z> [<rx> <ry> <rz> [<scale> [<b> <g> <r> [<thickness>]]]]
+ * Positions are in board squares, rotations are degrees about x, y, z.
+ * A mesh given a single file gets coarser levels generated by vertex clustering.
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <string>
+#include <vector>
+#include "opencv2/core/core.hpp"
+#include "drawList.h"
+
+/**
+ * One level of detail of a mesh, as the edges of its wireframe
+ */
+struct SceneLOD
+{
+    std::vector<cv::Point3f> vertices;
+    std::vector<cv::Vec2i> edges;
+    float cellSize; //largest detail removed, in mesh units (0 = full detail)
+};
+
+struct SceneMesh
+{
+    std::string name;
+    std::vector<SceneLOD> lods; //finest first
+    cv::Point3f center;         //bounding sphere
+    float radius;
+};
+
+struct SceneObject
+{
+    int mesh;
+    cv::Matx33f transform; //rotation and scale, mesh -> board
+    cv::Vec3f position;    //in board coordinates
+    float scale;
+    cv::Scalar color;
+    int thickness;
+};
+
+/**
+ * What happened to the scene's objects in the last drawn frame
+ */
+struct SceneStats
+{
+    int objects;
+    int outsideFrustum;
+    int tooSmall;
+    int drawn;
+    int edges;
+    int lodCounts[4]; //objects drawn at levels 0, 1, 2 and 3+
+};
+
+/**
+ * Per-caller scratch space for Scene::draw, so one loaded scene can be drawn
+ * from several threads
+ */
+struct SceneWorkspace
+{
+    std::vector<int> lodChoice;         //per object: level to draw, or -1 if culled
+    std::vector<int> pointOffsets;      //per object: first projected vertex
+    std::vector<cv::Point3f> camPoints; //vertices of drawn objects, camera coordinates
+    std::vector<cv::Point2f> imgPoints;
+    SceneStats stats;
+    float lodScale; //multiplies the scene's lodPixelError for this caller (1 = as loaded)
+
+    SceneWorkspace() : lodScale(1) {}
+};
+
+class Scene
+{
+public:
+    Scene();
+
+    /** Reads the manifest and every mesh it names; returns false on any error */
+    bool load(const std::string &manifestFile);
+
+    /**
+     * Culls, picks levels of detail for and queues the wireframes of all
+     * objects for the given board pose
+     */
+    void draw(DrawList &overlay, SceneWorkspace &work, const cv::Mat &rvec, const cv::Mat &tvec,
+              const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs, cv::Size imageSize) const;
+
+    size_t numObjects() const { return objects.size(); }
+
+    float lodPixelError; //coarsest level whose removed detail projects below this many pixels
+                         //(default 4: about two stroke widths, finer detail just fills in)
+    float minPixelSize;  //objects whose bounding sphere projects smaller than this are skipped
+    float nearPlane;     //in board squares
+
+private:
+    std::vector<SceneMesh> meshes;
+    std::vector<SceneObject> objects;
+
+    int findMesh(const std::string &name) const;
+};
+
+/**
+ * Reads the vertices and the edges of the faces and lines of an OBJ file
+ */
+bool loadObjWireframe(const std::string &filename, SceneLOD &lod);
+
+/**
+ * Builds a coarser version of a wireframe by merging all vertices within each
+ * cellSize cube and dropping the edges that collapse
+ */
+SceneLOD simplifyWireframe(const SceneLOD &lod, float cellSize);
+
+#endif
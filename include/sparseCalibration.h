@@ -0,0 +1,54 @@
+/* sparseCalibration.h
+ * Camera calibration from many views of a planar board, with a
+ * Levenberg-Marquardt solver built for the problem's block structure: the
+ * intrinsics (one focal length, since the aspect ratio is fixed, the
+ * principal point and k1 k2 p1 p2 k3) are shared by every view, and each
+ * view adds only its own 6-DOF pose. Each step solves the small intrinsic
+ * system left after eliminating the poses (Schur complement), then each
+ * pose on its own, so a step costs time linear in the number of views
+ * instead of cubic as in calibrateCamera's dense solver. Residuals and
+ * Jacobians are evaluated for all views in parallel.
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef SPARSECALIBRATION_H
+#define SPARSECALIBRATION_H
+
+#include <string>
+#include <vector>
+#include "opencv2/core/core.hpp"
+
+struct SparseCalibrationOptions
+{
+    bool useInitialGuess; //start from the given camera matrix and distortion (e.g. a saved profile)
+    int maxIterations;
+    double epsilon;       //stop once an accepted step lowers the error by less than this fraction
+
+    SparseCalibrationOptions() : useInitialGuess(false), maxIterations(100), epsilon(1e-10) {}
+};
+
+struct SparseCalibrationReport
+{
+    int iterations;
+    double initialError; //RMS reprojection error in pixels, before and after
+    double finalError;
+};
+
+/**
+ * Calibrates with the aspect ratio fixed at fy/fx of the initial camera
+ * matrix (1 without an initial guess) and five distortion coefficients,
+ * like calibrateCamera with CALIB_FIX_ASPECT_RATIO; returns the RMS
+ * reprojection error. The camera matrix is 3x3 and distCoeffs 5x1, both
+ * CV_64F; one rvec and tvec come out per view.
+ */
+double calibrateSparse(const std::vector<std::vector<cv::Point3f> > &objectPoints,
+                       const std::vector<std::vector<cv::Point2f> > &imagePoints,
+                       cv::Size imageSize, cv::Mat &cameraMatrix, cv::Mat &distCoeffs,
+                       std::vector<cv::Mat> &rvecs, std::vector<cv::Mat> &tvecs,
+                       const SparseCalibrationOptions &options = SparseCalibrationOptions(),
+                       SparseCalibrationReport *report = NULL);
+
+#endif
@@ -0,0 +1,65 @@
+/* subPixRefiner.h
+ * Sub-pixel chessboard corner refinement specialized for refining a whole
+ * board at once. It solves the same least-squares problem as cornerSubPix
+ * (every gradient in the window is perpendicular to the vector from the
+ * corner to that pixel), but:
+ *  - each corner's gradient products are computed once, over the window
+ *    plus a 2 pixel margin for it to drift in, instead of resampling the
+ *    window every iteration (a window that walks further moves the region)
+ *  - all corners iterate together over flat float arrays (structure of
+ *    arrays, fixed window width), each leaving the batch as soon as it converges
+ *  - while the board is held still (as it is while calibrating), a corner
+ *    starts from its refined position in the previous frame, shifted by how
+ *    far its detection moved; once the board moves the refined positions
+ *    no longer carry over, so corners start from their detections again
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef SUBPIXREFINER_H
+#define SUBPIXREFINER_H
+
+#include <vector>
+#include "opencv2/core/core.hpp"
+
+class SubPixRefiner
+{
+public:
+    /**
+     * halfWindow, maxIterations and epsilon (pixels) mean the same as
+     * cornerSubPix's winSize, max iterations and epsilon
+     */
+    SubPixRefiner(int halfWindow = 5, int maxIterations = 40, float epsilon = 0.001f);
+
+    /** Refines the corners in place */
+    void refine(const cv::Mat &gray, std::vector<cv::Point2f> &corners);
+
+    /** Forgets the previous frame, so the next refine starts from the detections */
+    void reset();
+
+    /** Average iterations per corner in the last refine */
+    double meanIterations() const { return lastMeanIterations; }
+
+    bool warmStart;    //start from the previous frame's refined corners when tracking
+    float trackRadius; //detections that moved further than this (pixels, default 0.5) start fresh
+
+private:
+    int halfWindow;
+    int regionHalf; //half-size of the precomputed region: the window plus room to drift
+    int maxIterations;
+    float epsilon;
+
+    //per corner, per region pixel: gx*gx, gx*gy, gy*gy and the right-hand side terms
+    std::vector<float> gxx, gxy, gyy, bx, by;
+    std::vector<float> patch; //scratch: the region plus a 1 pixel border, as floats
+
+    std::vector<cv::Point2f> prevDetected;
+    std::vector<cv::Point2f> prevRefined;
+    double lastMeanIterations;
+
+    void precompute(const cv::Mat &gray, int corner, cv::Point center);
+};
+
+#endif
@@ -0,0 +1,61 @@
+/* tripleBuffer.h
+ * Lock-free triple buffer for handing the latest frame (and whatever goes
+ * with it) from one writer thread to one reader. The writer fills its back
+ * slot and publishes it by swapping it with the middle slot; the reader takes
+ * the middle slot by swapping it with its front slot. Each side only ever
+ * touches its own slot, so large values such as Mats are handed over without
+ * copying, and neither side ever blocks.
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+template <class T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : back(0), middle(1), front(2) {}
+
+    /** The slot the writer fills next (single writer only) */
+    T &writeSlot() { return slots[back]; }
+
+    /** Publishes the write slot; the writer gets a slot the reader isn't holding */
+    void publish()
+    {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    /**
+     * Takes the latest published slot as the read slot, if one was published
+     * since the last call; returns false (keeping the old read slot) otherwise
+     */
+    bool update()
+    {
+        if ((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+        {
+            return false;
+        }
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    /** The slot the reader took last (single reader only) */
+    T &readSlot() { return slots[front]; }
+
+private:
+    static const int INDEX = 3;
+    static const int FRESH = 4; //set in middle while it holds a slot the reader hasn't taken
+
+    T slots[3];
+    int back;
+    std::atomic<int> middle;
+    int front;
+};
+
+#endif
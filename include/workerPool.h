@@ -0,0 +1,63 @@
+/* workerPool.h
+ * Work-stealing thread pool: each worker has its own task deque, runs its own
+ * newest tasks first and steals the oldest tasks of other workers when idle,
+ * so work spreads over the cores without one shared queue becoming a hot spot
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool
+{
+public:
+    /** numThreads <= 0 uses one worker per hardware thread */
+    explicit WorkerPool(int numThreads = 0);
+    ~WorkerPool();
+
+    /**
+     * Queues a task; tasks submitted from a worker go onto that worker's own
+     * deque, others are dealt round-robin across the workers
+     */
+    void submit(std::function<void()> task);
+
+    /** Blocks until every submitted task has finished */
+    void waitIdle();
+
+    int size() const { return (int)threads.size(); }
+
+private:
+    struct Worker
+    {
+        std::deque< std::function<void()> > tasks;
+        std::mutex lock;
+    };
+
+    std::vector< std::unique_ptr<Worker> > workers;
+    std::vector<std::thread> threads;
+
+    std::mutex sleepLock;
+    std::condition_variable wake; //signals workers that tasks arrived
+    std::condition_variable idle; //signals waitIdle that everything finished
+    int queued;   //tasks sitting in deques (guarded by sleepLock)
+    int running;  //tasks currently executing (guarded by sleepLock)
+    bool stopping;
+    std::atomic<unsigned> nextWorker;
+
+    void run(int index);
+    bool takeTask(int index, std::function<void()> &task);
+};
+
+#endif
@@ -22,9 +22,32 @@
 #include <fstream> //for writing out to file
 #include <iomanip> //for string formatting via a stream
 #include <cstring> //for strtok
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <csignal>
+#include <condition_variable>
+#include <sys/stat.h>
 #include "opencv2/opencv.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/calib3d/calib3d.hpp"
+#include "frameCache.h"
+#include "boardGeometry.h"
+#include "calibrationProfile.h"
+#include "imageList.h"
+#include "multiBoardDetector.h"
+#include "workerPool.h"
+#include "poseStream.h"
+#include "asyncVideoWriter.h"
+#include "drawList.h"
+#include "scene.h"
+#include "overlayCache.h"
+#include "memoryMeter.h"
+#include "frameSource.h"
+#include "qualityGovernor.h"
+#include "saddleDetector.h"
 
 using namespace std;
 using namespace cv;
@@ -35,107 +58,39 @@ Scalar blue = Scalar(255, 0, 0);
 
 /**
  * Reads in the given calibration file (in the format written out by calibration.cpp)
- * and writes the camera parameters into the given Mats
+ * and writes the camera parameters into the given Mats; exits if it can't
  */
-void readCalibrationFile(char* calibrationFilename, Mat &cameraMatrix, Mat &distCoeffs)
+void readCalibrationFile(const char* calibrationFilename, Mat &cameraMatrix, Mat &distCoeffs)
 {
-    ifstream paramFile (calibrationFilename);
-
-    if (paramFile.is_open())
-    {
-        string line;
-        char *lineArr = new char[line.length()+1]; //line as char array for strtok
-
-        for (int i = 0; i < 3; i++) //loop for 3 rows of camera matrix
-        {
-            getline(paramFile, line);
-            strcpy(lineArr, line.c_str());
-
-            //for 3 columns in each row
-            cameraMatrix.at<double>(i, 0) = atof( strtok(lineArr, " ") );
-            cameraMatrix.at<double>(i, 1) = atof( strtok(NULL, " ") ); //NULL b/c continuing on same line
-            cameraMatrix.at<double>(i, 2) = atof( strtok(NULL, " ") );
-        }
-
-        //read in distortion coeffs
-        getline(paramFile, line);
-
-        strcpy(lineArr, line.c_str());
-        char *word = strtok(lineArr, " "); //line as char array for strtok
-        int i = 0;
-        while (word != NULL) //loop while there are more words to read in on the line
-        {
-            distCoeffs.at<double>(i, 0) = atof( word );
-            word = strtok(NULL, " ");
-            i++;
-        }
-        
-        paramFile.close();
-    }
-    else
+    if (!readCalibrationProfile(calibrationFilename, cameraMatrix, distCoeffs))
     {
-        cout << "unable to open calibration file\n";
+        cout << "unable to read calibration file " << calibrationFilename << "\n";
         exit(-1);
     }
-
-    cout << "\ncamera matrix:\n";
-    for (int i = 0; i < cameraMatrix.rows; i++)
-    {
-        for (int j = 0; j < cameraMatrix.cols; j++)
-        {
-            cout << cameraMatrix.at<double>(i, j) << " ";
-        }
-        cout << "\n";
-    }
-
-    cout << "\ndistortion coefficients:\n";
-    for (int i = 0; i < distCoeffs.rows; i++)
-    {
-        cout << distCoeffs.at<double>(i, 0) << " ";
-    }
-    cout << "\n";
-}
-
-/**
- * Builds a set of 3D-space points for the corners of a chessboard of the given size,
- * with coordinates in units of chessboard squares
- */
-vector<Point3f> buildPointSet(Size chessboardSize)
-{
-    vector<Point3f> points;
-    
-    for (int i = 0; i < chessboardSize.height; i++)
-    {
-        for (int j = 0; j < chessboardSize.width; j++)
-        {
-            points.push_back(Point3f(j, -i, 0));
-        }
-    }
-    
-    return points;
+    printCalibrationProfile(cameraMatrix, distCoeffs);
 }
 
 /**
- * Projects and draws a set of axes into the given image at the origin,
+ * Projects and queues a set of axes at the origin into the given draw list,
  * using the given camera parameters and chessboard pose information
  */
-void drawAxes(Mat &img, Mat &rvec, Mat &tvec, Mat &cameraMatrix, Mat &distCoeffs)
+void drawAxes(DrawList &overlay, Mat &rvec, Mat &tvec, Mat &cameraMatrix, Mat &distCoeffs)
 {
     vector<Point3f> axesPoints{{0, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 0, 1}};
     vector<Point2f> axesImgPoints;
     projectPoints(axesPoints, rvec, tvec, cameraMatrix, distCoeffs, axesImgPoints);
             
     //draw axis lines
-    line(img, axesImgPoints[0], axesImgPoints[1], red, 2); //thickness = 2
-    line(img, axesImgPoints[0], axesImgPoints[2], green, 2);
-    line(img, axesImgPoints[0], axesImgPoints[3], blue, 2);
+    overlay.addSegment(axesImgPoints[0], axesImgPoints[1], red, 2); //thickness = 2
+    overlay.addSegment(axesImgPoints[0], axesImgPoints[2], green, 2);
+    overlay.addSegment(axesImgPoints[0], axesImgPoints[3], blue, 2);
 }
 
 /**
- * Projects and draws a rectangular prism into the given image at the origin,
- * using the given camera parameters and chessboard pose information
+ * Projects and queues a rectangular prism at the origin into the given draw
+ * list, using the given camera parameters and chessboard pose information
  */
-void drawRectPrism(Mat &img, Mat &rvec, Mat &tvec, Mat &cameraMatrix, Mat &distCoeffs)
+void drawRectPrism(DrawList &overlay, Mat &rvec, Mat &tvec, Mat &cameraMatrix, Mat &distCoeffs)
 {
     vector<Point3f> points{{0, 0, 0}, {0, 0, 3}, {4, 0, 3}, {4, 0, 0},
                            {0, -1, 0}, {0, -1, 3}, {4, -1, 3}, {4, -1, 0}};
@@ -143,26 +98,20 @@ void drawRectPrism(Mat &img, Mat &rvec, Mat &tvec, Mat &cameraMatrix, Mat &distC
     projectPoints(points, rvec, tvec, cameraMatrix, distCoeffs, imgPoints);
             
     //draw lines
-    line(img, imgPoints[0], imgPoints[1], red, 2); //thickness = 2
-    line(img, imgPoints[1], imgPoints[2], red, 2);
-    line(img, imgPoints[2], imgPoints[3], red, 2);
-    line(img, imgPoints[3], imgPoints[0], red, 2);
-    line(img, imgPoints[0], imgPoints[4], green, 2); //thickness = 2
-    line(img, imgPoints[1], imgPoints[5], green, 2);
-    line(img, imgPoints[2], imgPoints[6], green, 2);
-    line(img, imgPoints[3], imgPoints[7], green, 2);
-    line(img, imgPoints[4], imgPoints[5], blue, 2); //thickness = 2
-    line(img, imgPoints[5], imgPoints[6], blue, 2);
-    line(img, imgPoints[6], imgPoints[7], blue, 2);
-    line(img, imgPoints[7], imgPoints[4], blue, 2);
+    overlay.addPolyline(&imgPoints[0], 4, true, red, 2); //thickness = 2
+    for (int i = 0; i < 4; i++)
+    {
+        overlay.addSegment(imgPoints[i], imgPoints[i + 4], green, 2);
+    }
+    overlay.addPolyline(&imgPoints[4], 4, true, blue, 2);
 }
 
 /**
- * Projects and draws a fish into the given image at the given coordinates,
- * in the given color, using the given camera parameters and chessboard pose
- * information
+ * Projects and queues a fish at the given coordinates into the given draw
+ * list, in the given color, using the given camera parameters and chessboard
+ * pose information
  */
-void drawFish(Mat &img, Scalar &color, float x, float y, Mat &rvec, Mat &tvec, Mat &cameraMatrix, Mat &distCoeffs)
+void drawFish(DrawList &overlay, Scalar &color, float x, float y, Mat &rvec, Mat &tvec, Mat &cameraMatrix, Mat &distCoeffs)
 {
     float centerZ = 0.5;
     vector<Point3f> points{//body
@@ -177,69 +126,469 @@ void drawFish(Mat &img, Scalar &color, float x, float y, Mat &rvec, Mat &tvec, M
     vector<Point2f> imgPoints;
     projectPoints(points, rvec, tvec, cameraMatrix, distCoeffs, imgPoints);
 
-    //draw lines
-    //body
-    line(img, imgPoints[0], imgPoints[1], color, 2); //thickness = 2
-    line(img, imgPoints[1], imgPoints[2], color, 2);
-    line(img, imgPoints[2], imgPoints[3], color, 2);
-    line(img, imgPoints[3], imgPoints[0], color, 2);
+    //draw lines: body, upper fin, tail, lower fin, each a closed quadrilateral
+    for (int part = 0; part < 4; part++)
+    {
+        overlay.addPolyline(&imgPoints[part * 4], 4, true, color, 2); //thickness = 2
+    }
+}
 
-    //upper fin
-    line(img, imgPoints[4], imgPoints[5], color, 2); //thickness = 2
-    line(img, imgPoints[5], imgPoints[6], color, 2);
-    line(img, imgPoints[6], imgPoints[7], color, 2);
-    line(img, imgPoints[7], imgPoints[4], color, 2);
+/**
+ * Camera parameters and detection settings shared by every input mode
+ */
+struct ARContext
+{
+    Mat cameraMatrix;
+    Mat distCoeffs;
+    const BoardOps *board; //board to look for in single-board mode
+    vector<const BoardOps *> boards; //all board sizes to look for
+    MultiBoardDetector *multiDetector; //NULL unless tracking several boards
+    SaddleDetector *saddleDetector; //single-board detection from saddle points (NULL: findChessboardCorners)
+    PosePublisher *publisher; //NULL unless publishing poses
+    uint32_t streamId;
+    uint64_t frameNumber;
+    const char *outputName; //headless mode: write frames here instead of showing them
+    DrawList overlay; //this frame's AR drawing, composited in one pass
+    bool antiAlias; //blend overlay edges
+    const Scene *scene; //NULL: draw the built-in fish
+    SceneWorkspace sceneWork;
+    OverlayCache *overlayCache; //NULL: draw the overlay every frame
+    bool overlayReused; //the last frame's overlay came from the cache, so nothing was drawn
+    QualitySettings quality; //detection and drawing settings (the governor changes them)
+    QualityGovernor *governor; //NULL: fixed quality
+    FrameCache prevCache; //last frame and its pyramid, to track the board from between full detections
+    vector<Point2f> prevCorners; //board corners in prevCache (empty: not tracking)
+    vector<int> prevIndices; //their board indices if only part of the board was found
+    int framesSinceDetect;
+    Mat smallGray; //downscaled frame for detection
+    float previewScale; //low-memory mode: the overlay goes into a preview this much smaller (0: off)
+    Mat previewMatrix; //camera matrix for the preview (empty: draw at full size)
+    Size previewSource; //frame size previewMatrix was scaled from
+    MemoryMeter *memory; //NULL unless reporting memory use
+};
+
+volatile sig_atomic_t stopRequested = 0; //set by Ctrl-C; every capture and wait loop checks it
+
+void requestStop(int)
+{
+    stopRequested = 1;
+}
 
-    //tail
-    line(img, imgPoints[8], imgPoints[9], color, 2); //thickness = 2
-    line(img, imgPoints[9], imgPoints[10], color, 2);
-    line(img, imgPoints[10], imgPoints[11], color, 2);
-    line(img, imgPoints[11], imgPoints[8], color, 2);
+/**
+ * In headless mode, starts encoding the composited frames of the given capture
+ * to the output file in the background; returns false if that fails
+ */
+bool startRecorder(AsyncVideoWriter &recorder, FrameSource &capture, Size frameSize,
+                   const string &filename)
+{
+    double fps = capture.get(CAP_PROP_FPS);
+    if (!recorder.open(filename, fps, frameSize))
+    {
+        return false;
+    }
+    cout << "Writing output to " << filename << "\n";
+    return true;
+}
 
-    //lower fin
-    line(img, imgPoints[12], imgPoints[13], color, 2); //thickness = 2
-    line(img, imgPoints[13], imgPoints[14], color, 2);
-    line(img, imgPoints[14], imgPoints[15], color, 2);
-    line(img, imgPoints[15], imgPoints[12], color, 2);
+/**
+ * Projects and queues the AR objects for one board pose into the given draw list
+ */
+void drawOverlay(DrawList &overlay, BoardPose &pose, ARContext &ctx, Size frameSize)
+{
+    //a preview is drawn into directly, through a camera matrix scaled to it
+    Mat &drawMatrix = ctx.previewMatrix.empty() ? ctx.cameraMatrix : ctx.previewMatrix;
+    if (ctx.scene != NULL)
+    {
+        ctx.scene->draw(overlay, ctx.sceneWork, pose.rvec, pose.tvec, drawMatrix,
+                        ctx.distCoeffs, frameSize);
+        return;
+    }
+    //drawAxes(overlay, pose.rvec, pose.tvec, drawMatrix, ctx.distCoeffs);
+    //drawRectPrism(overlay, pose.rvec, pose.tvec, drawMatrix, ctx.distCoeffs);
+    drawFish(overlay, red, 3, 0, pose.rvec, pose.tvec, drawMatrix, ctx.distCoeffs);
+    drawFish(overlay, green, 1, -2, pose.rvec, pose.tvec, drawMatrix, ctx.distCoeffs);
+    drawFish(overlay, blue, 6, -4, pose.rvec, pose.tvec, drawMatrix, ctx.distCoeffs);
 }
 
 /**
- * Project onto a saved image using the given camera parameters
+ * Size of the low-memory preview of a frame of the given size
  */
-int openImgFile(char* imgName, Mat cameraMatrix, Mat distCoeffs)
+Size previewSize(ARContext &ctx, Size frameSize)
 {
-    cout << "Opening image file " << string(imgName) << "\n";
+    return Size(max(1, cvRound(frameSize.width * ctx.previewScale)),
+                max(1, cvRound(frameSize.height * ctx.previewScale)));
+}
 
-    // read the image
-    Mat src;
-    src = imread( string(imgName) );
+/**
+ * Shrinks a BGR or grayscale frame into the low-memory preview (always BGR,
+ * so the overlay keeps its colors), reusing the preview's buffers, and keeps
+ * the camera matrix scaled to match
+ */
+void makePreview(ARContext &ctx, const Mat &source, Mat &preview, Mat &previewGray)
+{
+    Size size = previewSize(ctx, source.size());
+    if (source.channels() == 1)
+    {
+        resize(source, previewGray, size, 0, 0, INTER_AREA);
+        cvtColor(previewGray, preview, COLOR_GRAY2BGR);
+    }
+    else
+    {
+        resize(source, preview, size, 0, 0, INTER_AREA);
+    }
 
-    // test if the read was successful
-    if(src.data == NULL) 
+    if (ctx.previewMatrix.empty() || ctx.previewSource != source.size())
     {
-        cout << "Unable to read image" << imgName << "\n";
-        exit(-1);
+        //scale about pixel centers, as resize does
+        double sx = (double)size.width / source.cols;
+        double sy = (double)size.height / source.rows;
+        ctx.previewMatrix = ctx.cameraMatrix.clone();
+        ctx.previewMatrix.at<double>(0, 0) *= sx;
+        ctx.previewMatrix.at<double>(0, 2) = (ctx.cameraMatrix.at<double>(0, 2) + 0.5) * sx - 0.5;
+        ctx.previewMatrix.at<double>(1, 1) *= sy;
+        ctx.previewMatrix.at<double>(1, 2) = (ctx.cameraMatrix.at<double>(1, 2) + 0.5) * sy - 0.5;
+        ctx.previewSource = source.size();
+    }
+}
+
+/**
+ * Fills records with every board's pose for this frame, or a single no-board record
+ */
+void makePoseRecords(ARContext &ctx, vector<DetectedBoard> &boards, uint64_t timestampUs,
+                     vector<PoseRecord> &records)
+{
+    PoseRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.frameNumber = ctx.frameNumber;
+    rec.timestampUs = timestampUs;
+    rec.streamId = ctx.streamId;
+    rec.status = POSE_NO_BOARD;
+
+    records.clear();
+    if (boards.empty())
+    {
+        records.push_back(rec);
+        return;
+    }
+
+    for (size_t b = 0; b < boards.size(); b++)
+    {
+        BoardPose &pose = boards[b].pose;
+        rec.boardIndex = b;
+        rec.status = POSE_FOUND;
+        rec.boardWidth = boards[b].board->width;
+        rec.boardHeight = boards[b].board->height;
+        rec.reprojError = pose.reprojError;
+        for (int i = 0; i < 3; i++)
+        {
+            rec.rvec[i] = pose.rvec.at<double>(i);
+            rec.tvec[i] = pose.tvec.at<double>(i);
+        }
+        records.push_back(rec);
+    }
+}
+
+/**
+ * Publishes every board's pose for this frame, or a single no-board record
+ */
+void publishPoses(ARContext &ctx, vector<DetectedBoard> &boards, uint64_t timestampUs)
+{
+    vector<PoseRecord> records;
+    makePoseRecords(ctx, boards, timestampUs, records);
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        ctx.publisher->publish(records[i]);
+    }
+}
+
+/**
+ * Finds the single board in the cached frame at the current quality settings:
+ * between full detections the last frame's corners are followed with optical
+ * flow, full detection may run on a downscaled frame, and corners are refined
+ * at full resolution. The saddle detector may find only part of the board,
+ * whose pose then comes from the corners it did find. While tracking, the
+ * cache is swapped with the previous frame's, so it must be reset before the
+ * next frame. Returns false if the board wasn't found.
+ */
+bool findSingleBoard(ARContext &ctx, FrameCache &cache, DetectedBoard &d)
+{
+    const QualitySettings &q = ctx.quality;
+    const Mat &gray = cache.gray();
+    d.board = ctx.board;
+    if (ctx.saddleDetector == NULL && q.detectScale == 1 && q.detectInterval == 1)
+    {
+        ctx.prevCorners.clear();
+        return ctx.board->estimatePose(gray, ctx.cameraMatrix, ctx.distCoeffs, d.pose, q.subPixIterations);
+    }
+
+    bool found = false;
+    vector<Point2f> corners;
+    vector<int> indices = ctx.prevIndices; //empty: the whole board
+    if (!ctx.prevCorners.empty() && ctx.framesSinceDetect < q.detectInterval)
+    {
+        vector<uchar> status;
+        vector<float> err;
+        calcOpticalFlowPyrLK(ctx.prevCache.pyramid(), cache.pyramid(), ctx.prevCorners, corners, status, err,
+                             Size(FrameCache::pyramidWinSize, FrameCache::pyramidWinSize),
+                             FrameCache::pyramidLevels);
+        //a corner that slid off its neighbors shows up as a pose that no longer fits
+        found = find(status.begin(), status.end(), 0) == status.end() &&
+                solvePartialBoardPose(ctx.board, corners, indices, ctx.cameraMatrix, ctx.distCoeffs, d.pose) &&
+                d.pose.reprojError < 2;
+        ctx.framesSinceDetect++;
+    }
+    if (!found)
+    {
+        indices.clear();
+        if (ctx.saddleDetector != NULL)
+        {
+            //runs on the cache's full-resolution gradients, so detectScale doesn't apply
+            SaddleBoard saddleBoard;
+            found = ctx.saddleDetector->detect(cache, saddleBoard, q.subPixIterations);
+            corners.swap(saddleBoard.corners);
+            if (!saddleBoard.complete)
+            {
+                indices.swap(saddleBoard.indices);
+            }
+        }
+        else if (q.detectScale < 1)
+        {
+            resize(gray, ctx.smallGray, Size(), q.detectScale, q.detectScale, INTER_AREA);
+            found = ctx.board->detectCorners(ctx.smallGray, corners, 0);
+            for (size_t i = 0; found && i < corners.size(); i++)
+            {
+                corners[i] = (corners[i] + Point2f(0.5f, 0.5f)) * (1 / q.detectScale) - Point2f(0.5f, 0.5f);
+            }
+            if (found && q.subPixIterations > 0)
+            {
+                TermCriteria criteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, q.subPixIterations, 0.001);
+                cornerSubPix(gray, corners, Size(5,5), Size(-1,-1), criteria);
+            }
+        }
+        else
+        {
+            found = ctx.board->detectCorners(gray, corners, q.subPixIterations);
+        }
+        found = found && solvePartialBoardPose(ctx.board, corners, indices, ctx.cameraMatrix,
+                                               ctx.distCoeffs, d.pose);
+        ctx.framesSinceDetect = 1;
+    }
+
+    //keep this frame's pyramid to track from; swapping hands the caller the
+    //older cache's buffers to reset for the next frame, so nothing is copied
+    ctx.prevCorners.clear();
+    ctx.prevIndices.clear();
+    if (found && q.detectInterval > 1)
+    {
+        cache.pyramid();
+        ctx.prevCache.swap(cache);
+        ctx.prevCorners = corners;
+        ctx.prevIndices = indices;
+    }
+    return found;
+}
+
+/**
+ * Charges the time since the last mark to a stage, if a governor is running
+ */
+void markStage(ARContext &ctx, GovernorStage stage)
+{
+    if (ctx.governor != NULL)
+    {
+        ctx.governor->endStage(stage);
     }
+}
+
+/**
+ * Starts a frame for the governor and the memory meter, if running
+ */
+void beginFrame(ARContext &ctx)
+{
+    if (ctx.governor != NULL)
+    {
+        ctx.governor->startFrame();
+    }
+    if (ctx.memory != NULL)
+    {
+        ctx.memory->startFrame();
+    }
+}
+
+/**
+ * Ends a frame for the governor, picking up any change it makes, and for the
+ * memory meter
+ */
+void endFrame(ARContext &ctx)
+{
+    if (ctx.memory != NULL)
+    {
+        ctx.memory->endFrame();
+    }
+    if (ctx.governor != NULL && ctx.governor->endFrame())
+    {
+        ctx.quality = ctx.governor->settings();
+    }
+}
+
+/**
+ * Finds the board(s) in the cached frame and solves their poses, publishing
+ * them if a publisher is open; returns false if no board was found
+ */
+bool detectBoards(ARContext &ctx, FrameCache &cache, vector<DetectedBoard> &boards)
+{
+    uint64_t timestamp = poseTimestampUs();
+    boards.clear();
+    if (ctx.multiDetector != NULL)
+    {
+        ctx.multiDetector->subPixIterations = ctx.quality.subPixIterations;
+        ctx.multiDetector->detect(cache, ctx.cameraMatrix, ctx.distCoeffs, boards);
+    }
+    else
+    {
+        DetectedBoard d;
+        if (findSingleBoard(ctx, cache, d))
+        {
+            d.roi = boundingRect(d.pose.corners);
+            boards.push_back(d);
+        }
+    }
+
+    if (ctx.publisher != NULL)
+    {
+        publishPoses(ctx, boards, timestamp);
+    }
+    ctx.frameNumber++;
+    markStage(ctx, STAGE_DETECT);
+    return !boards.empty();
+}
+
+/**
+ * Draws each board's overlay into the frame, or reuses the last overlay drawn
+ * if the boards haven't moved since
+ */
+void drawBoards(ARContext &ctx, vector<DetectedBoard> &boards, Mat &frame)
+{
+    int64 overlayStart = getTickCount();
+    if (ctx.overlayCache != NULL && !boards.empty() &&
+        ctx.overlayCache->reuse(boards, ctx.previewMatrix.empty() ? ctx.cameraMatrix : ctx.previewMatrix,
+                                ctx.quality.lodScale, frame))
+    {
+        ctx.overlayReused = true;
+        ctx.overlayCache->record(true, (getTickCount() - overlayStart) * 1000.0 / getTickFrequency());
+        markStage(ctx, STAGE_OVERLAY);
+        return;
+    }
+
+    //project every board's objects, then draw them into the frame in one pass
+    ctx.overlayReused = false;
+    ctx.overlay.clear();
+    ctx.sceneWork.lodScale = ctx.quality.lodScale;
+    for (size_t i = 0; i < boards.size(); i++)
+    {
+        drawOverlay(ctx.overlay, boards[i].pose, ctx, frame.size());
+    }
+    if (ctx.overlayCache == NULL)
+    {
+        ctx.overlay.render(frame, ctx.antiAlias);
+    }
+    else if (boards.empty())
+    {
+        ctx.overlayCache->invalidate();
+    }
+    else
+    {
+        ctx.overlayCache->render(ctx.overlay, boards, ctx.quality.lodScale, frame, ctx.antiAlias);
+        ctx.overlayCache->record(false, (getTickCount() - overlayStart) * 1000.0 / getTickFrequency());
+    }
+    markStage(ctx, STAGE_OVERLAY);
+}
+
+/**
+ * Finds the board(s) in the cached frame, solves their poses and, if render
+ * is set, draws each board's overlay into the frame; returns false if no
+ * board was found
+ */
+bool processFrame(ARContext &ctx, FrameCache &cache, Mat &frame, vector<DetectedBoard> &boards,
+                  bool render = true)
+{
+    bool found = detectBoards(ctx, cache, boards);
+    if (render)
+    {
+        drawBoards(ctx, boards, frame);
+    }
+    return found;
+}
 
-    Size chessboardSize(9,6);
+/**
+ * Prints how many scene objects were culled and at what detail the rest were
+ * drawn, for the last board drawn
+ */
+void printSceneStats(ARContext &ctx)
+{
+    if (ctx.scene == NULL)
+    {
+        return;
+    }
+    if (ctx.overlayReused)
+    {
+        cout << "scene: cached overlay reused, nothing drawn\n";
+        return;
+    }
+    const SceneStats &s = ctx.sceneWork.stats;
+    cout << "scene: " << s.drawn << " of " << s.objects << " objects drawn ("
+         << s.outsideFrustum << " outside view, " << s.tooSmall << " too small), "
+         << s.edges << " edges, LOD 0/1/2/3+: " << s.lodCounts[0] << "/" << s.lodCounts[1]
+         << "/" << s.lodCounts[2] << "/" << s.lodCounts[3] << "\n";
+}
 
-    vector<Point2f> corner_set;
-    vector<Point3f> point_set = buildPointSet(chessboardSize);
-    Mat rvec = Mat::zeros(1, 3, DataType<double>::type);
-    Mat tvec = Mat::zeros(1, 3, DataType<double>::type);
+/**
+ * Prints the resident set size and what the last frame allocated, if measuring memory
+ */
+void printMemoryStats(ARContext &ctx)
+{
+    if (ctx.memory == NULL)
+    {
+        return;
+    }
+    printf("memory: RSS %.1f MB (peak %.1f MB), last frame allocated %.1f KB in %d Mat buffers\n",
+           MemoryMeter::currentRssKb() / 1024.0, MemoryMeter::peakRssKb() / 1024.0,
+           ctx.memory->frameBytes() / 1024.0, (int)ctx.memory->frameAllocations());
+}
 
-    bool chessboardFound = findChessboardCorners(src, chessboardSize, corner_set);
+/**
+ * Prints how often the cached overlay stood in for a redraw and the time that saved
+ */
+void printOverlayCacheStats(const char *name, const OverlayCache *cache)
+{
+    if (cache == NULL)
+    {
+        return;
+    }
+    const OverlayCacheStats &s = cache->stats;
+    printf("%soverlay cache: %d of %d frames reused (%.1f%%), %.3f ms on a hit vs %.3f ms on a redraw, "
+           "%.3f ms saved per frame\n", name, s.hits, s.hits + s.misses, 100 * s.hitRate(),
+           s.hits > 0 ? s.hitMs / s.hits : 0.0, s.misses > 0 ? s.missMs / s.misses : 0.0,
+           s.savedMsPerFrame());
+}
 
-    if (chessboardFound)
+/**
+ * Prints out the rotation and translation vectors of each board found
+ * (zeros if there were none)
+ */
+void printPoses(vector<DetectedBoard> &boards)
+{
+    Mat zero = Mat::zeros(1, 3, CV_64F);
+    size_t count = max(boards.size(), (size_t)1);
+    for (size_t b = 0; b < count; b++)
     {
-        solvePnP(point_set, corner_set, cameraMatrix, distCoeffs, rvec, tvec);
-        
-        //drawAxes(src, rvec, tvec, cameraMatrix, distCoeffs);
-        //drawRectPrism(src, rvec, tvec, cameraMatrix, distCoeffs);
-        drawFish(src, red, 3, 0, rvec, tvec, cameraMatrix, distCoeffs);
-        drawFish(src, green, 1, -2, rvec, tvec, cameraMatrix, distCoeffs);
-        drawFish(src, blue, 6, -4, rvec, tvec, cameraMatrix, distCoeffs);
+        const Mat &rvec = boards.empty() ? zero : boards[b].pose.rvec;
+        const Mat &tvec = boards.empty() ? zero : boards[b].pose.tvec;
 
+        if (boards.size() > 1)
+        {
+            cout << "board " << b << " (" << boards[b].board->width << "x"
+                 << boards[b].board->height << ")\n";
+        }
         cout << "rvec: ";
         for (int i = 0; i < 3; i++)
         {
@@ -253,12 +602,56 @@ int openImgFile(char* imgName, Mat cameraMatrix, Mat distCoeffs)
         }
         cout << "\n";
     }
+}
+
+/**
+ * Project onto a saved image using the given camera parameters
+ */
+int openImgFile(char* imgName, ARContext &ctx)
+{
+    cout << "Opening image file " << string(imgName) << "\n";
+
+    // read the image
+    Mat src;
+    src = imread( string(imgName) );
+
+    // test if the read was successful
+    if(src.data == NULL) 
+    {
+        cout << "Unable to read image" << imgName << "\n";
+        exit(-1);
+    }
+
+    FrameCache cache(src);
+    vector<DetectedBoard> boards;
+    if (processFrame(ctx, cache, src, boards))
+    {
+        printPoses(boards);
+    }
+
+    if (ctx.outputName != NULL) //headless: save instead of display
+    {
+        bool saved = false;
+        try
+        {
+            saved = imwrite(ctx.outputName, src);
+        }
+        catch (const cv::Exception &e) //no writer for the extension, e.g. a video name
+        {
+        }
+        if (!saved)
+        {
+            cout << "Unable to write image " << ctx.outputName << "\n";
+            exit(-1);
+        }
+        return (0);
+    }
 
     //display result
     imshow("Image", src);
 
-    //check for user keyboard input
-    while (true)
+    //check for user keyboard input (or Ctrl-C)
+    while (!stopRequested)
     {
         char key = waitKey(10);
     
@@ -267,16 +660,19 @@ int openImgFile(char* imgName, Mat cameraMatrix, Mat distCoeffs)
             break;
         }
     }
+    return (0);
 }
 
 /**
- * Project onto a chessboard inside of precaptured video footage
+ * Project onto a chessboard inside of precaptured video footage (a video
+ * file or a raw capture)
  */
-int openVidFile(const char* vidName, Mat cameraMatrix, Mat distCoeffs)
+int openVidFile(const FrameSourceOptions &source, ARContext &ctx)
 {
+    const char *vidName = source.source.c_str();
     cout << "Opening video file " << string(vidName) << "\n";
     
-    VideoCapture *savedVid = new cv::VideoCapture(vidName);
+    FrameSource *savedVid = new FrameSource(source);
 
     // open the video file
 	if( !savedVid->isOpened() ) {
@@ -289,66 +685,97 @@ int openVidFile(const char* vidName, Mat cameraMatrix, Mat distCoeffs)
 
 	printf("Expected size: %d %d\n", refS.width, refS.height);
 
-	namedWindow("Video", 1);
+    AsyncVideoWriter recorder;
+    if (ctx.outputName != NULL)
+    {
+        Size outputSize = ctx.previewScale > 0 ? previewSize(ctx, refS) : refS;
+        if (!startRecorder(recorder, *savedVid, outputSize, ctx.outputName))
+        {
+            return(-1);
+        }
+    }
+    else
+    {
+        namedWindow("Video", 1);
+    }
 	Mat frame;
+    Mat preview, previewGray; //low-memory mode: what the overlay is drawn into
 
-    Size chessboardSize(9,6);
-
+    FrameCache cache;
+    vector<DetectedBoard> boards;
     int printIntervalCount = 0;
 	for(;;) {
-		// read the next frame
+        beginFrame(ctx);
+		// read the next frame (decoders hand over full-size color even in low-memory
+		// mode; only a V4L2 camera's luma plane skips it, in openVideoInput)
         if (savedVid->read(frame) == false)
         {
             cout << "frame empty\n";
             break;            
         }
+        cache.reset(frame);
+        markStage(ctx, STAGE_CAPTURE);
 
-        vector<Point2f> corner_set;
-        vector<Point3f> point_set = buildPointSet(chessboardSize);
-        Mat rvec = Mat::zeros(1, 3, DataType<double>::type);
-        Mat tvec = Mat::zeros(1, 3, DataType<double>::type);
-
-        bool chessboardFound = findChessboardCorners(frame, chessboardSize, corner_set);
-
-        //project/draw into frame if chessboard found
-        if (chessboardFound)
+        //the governor may show only every few frames; skip drawing the rest
+        bool show = recorder.isOpened() || printIntervalCount % ctx.quality.displayInterval == 0;
+        Mat *canvas = &frame;
+        if (ctx.previewScale > 0)
         {
-            solvePnP(point_set, corner_set, cameraMatrix, distCoeffs, rvec, tvec);
-            
-            //drawAxes(frame, rvec, tvec, cameraMatrix, distCoeffs);
-            //drawRectPrism(frame, rvec, tvec, cameraMatrix, distCoeffs);
-            drawFish(frame, red, 3, 0, rvec, tvec, cameraMatrix, distCoeffs);
-            drawFish(frame, green, 1, -2, rvec, tvec, cameraMatrix, distCoeffs);
-            drawFish(frame, blue, 6, -4, rvec, tvec, cameraMatrix, distCoeffs);
+            //the preview is only made to be shown, so it counts as display
+            canvas = &preview;
+            if (show)
+            {
+                makePreview(ctx, frame, preview, previewGray);
+            }
+            markStage(ctx, STAGE_DISPLAY);
+        }
+        processFrame(ctx, cache, *canvas, boards, show);
+
+        if (recorder.isOpened())
+        {
+            recorder.write(*canvas);
+        }
+        else if (show)
+        {
+            imshow("Video", *canvas);
         }
 
-        imshow("Video", frame);
-
         //print out rotation and translation vectors every 5 frames
         printIntervalCount++;
         if (printIntervalCount%5 == 0)
         {
             cout << "frame " << printIntervalCount << "\n";
-            cout << "rvec: ";
-            for (int i = 0; i < 3; i++)
-            {
-                cout << rvec.at<double>(i) << " ";
-            }
+            printPoses(boards);
+            printSceneStats(ctx);
+            printMemoryStats(ctx);
             cout << "\n";
-            cout << "tvec: ";
-            for (int i = 0; i < 3; i++)
-            {
-                cout << tvec.at<double>(i) << " ";
-            }
-            cout << "\n\n";
         }
 
-        //check for user keyboard input
-        char key = waitKey(10);
+        //check for user keyboard input (headless runs go as fast as they can)
+        if (stopRequested)
+        {
+            break;
+        }
+        if (recorder.isOpened() || !show)
+        {
+            markStage(ctx, STAGE_DISPLAY);
+            endFrame(ctx);
+            continue;
+        }
+        //a governed loop doesn't wait on top of its own frame time
+        char key = waitKey(ctx.governor != NULL ? 1 : 10);
+        markStage(ctx, STAGE_DISPLAY);
+        endFrame(ctx);
 		if(key == 'q') {
 		    break;
 		}
 	}
+    recorder.close();
+    printOverlayCacheStats("", ctx.overlayCache);
+    if (ctx.memory != NULL)
+    {
+        ctx.memory->printSummary();
+    }
 
     delete savedVid;
 
@@ -356,15 +783,15 @@ int openVidFile(const char* vidName, Mat cameraMatrix, Mat distCoeffs)
 }
 
 /**
- * Looks for chessboard corners on a live video feed and
- * projects onto the video feed with the given parameters if board found
+ * Looks for chessboard corners on a live video feed (or replayed raw capture)
+ * and projects onto the video feed with the given parameters if board found
  */
-int openVideoInput( Mat cameraMatrix, Mat distCoeffs )
+int openVideoInput( ARContext &ctx, const FrameSourceOptions &source )
 {
-    VideoCapture *capdev;
+    FrameSource *capdev;
 
 	// open the video device
-	capdev = new cv::VideoCapture(0);
+	capdev = new FrameSource(source);
 	if( !capdev->isOpened() ) {
 		printf("Unable to open video device\n");
 		return(-1);
@@ -375,79 +802,807 @@ int openVideoInput( Mat cameraMatrix, Mat distCoeffs )
 
 	printf("Expected size: %d %d\n", refS.width, refS.height);
 
-	namedWindow("Video", 1);
+    AsyncVideoWriter recorder;
+    if (ctx.outputName != NULL)
+    {
+        Size outputSize = ctx.previewScale > 0 ? previewSize(ctx, refS) : refS;
+        if (!startRecorder(recorder, *capdev, outputSize, ctx.outputName))
+        {
+            return(-1);
+        }
+    }
+    else
+    {
+        namedWindow("Video", 1);
+    }
 	Mat frame;
+    Mat preview, previewGray; //low-memory mode: what the overlay is drawn into
 
-    Size chessboardSize(9,6);
-
+    FrameCache cache;
+    vector<DetectedBoard> boards;
     int printIntervalCount = 0;
 	for(;;) {
-		*capdev >> frame; // get a new frame from the camera, treat as a stream
-
-        vector<Point2f> corner_set;
-        vector<Point3f> point_set = buildPointSet(chessboardSize);
-        Mat rvec = Mat::zeros(1, 3, DataType<double>::type);
-        Mat tvec = Mat::zeros(1, 3, DataType<double>::type);
+        beginFrame(ctx);
+        if (!capdev->grab()) //camera failed or replay finished
+        {
+            break;
+        }
 
-        bool chessboardFound = findChessboardCorners(frame, chessboardSize, corner_set);
+        //the governor may show only every few frames; skip drawing the rest
+        bool show = recorder.isOpened() || printIntervalCount % ctx.quality.displayInterval == 0;
 
-        //project/draw into frame if chessboard found
-        if (chessboardFound)
+        //a V4L2 camera's luma plane goes straight to detection; color is only made to be
+        //shown, and in low-memory mode not at all (the preview is made from the luma plane)
+        const Mat &luma = capdev->luma();
+        if (luma.empty() || (show && ctx.previewScale == 0))
         {
-            solvePnP(point_set, corner_set, cameraMatrix, distCoeffs, rvec, tvec);
-            
-            //drawAxes(frame, rvec, tvec, cameraMatrix, distCoeffs);
-            //drawRectPrism(frame, rvec, tvec, cameraMatrix, distCoeffs);
-            drawFish(frame, red, 3, 0, rvec, tvec, cameraMatrix, distCoeffs);
-            drawFish(frame, green, 1, -2, rvec, tvec, cameraMatrix, distCoeffs);
-            drawFish(frame, blue, 6, -4, rvec, tvec, cameraMatrix, distCoeffs);
+            capdev->retrieve(frame);
         }
+        const Mat &detectFrame = luma.empty() ? frame : luma;
+        cache.reset(detectFrame);
+        markStage(ctx, STAGE_CAPTURE);
+        Mat *canvas = &frame;
+        if (ctx.previewScale > 0)
+        {
+            //the preview is only made to be shown, so it counts as display
+            canvas = &preview;
+            if (show)
+            {
+                makePreview(ctx, detectFrame, preview, previewGray);
+            }
+            markStage(ctx, STAGE_DISPLAY);
+        }
+
+        processFrame(ctx, cache, *canvas, boards, show);
 
-        imshow("Video", frame);
+        if (recorder.isOpened())
+        {
+            recorder.write(*canvas);
+        }
+        else if (show)
+        {
+            imshow("Video", *canvas);
+        }
 
         //print out rotation and translation vectors every 5 frames
         printIntervalCount++;
         if (printIntervalCount%5 == 0)
         {
             cout << "frame " << printIntervalCount << "\n";
-            cout << "rvec: ";
-            for (int i = 0; i < 3; i++)
-            {
-                cout << rvec.at<double>(i) << " ";
-            }
+            printPoses(boards);
+            printSceneStats(ctx);
+            printMemoryStats(ctx);
             cout << "\n";
-            cout << "tvec: ";
-            for (int i = 0; i < 3; i++)
-            {
-                cout << tvec.at<double>(i) << " ";
-            }
-            cout << "\n\n";
         }
 
-        //check for user keyboard input
-        char key = waitKey(10);
+        //check for user keyboard input (headless runs go as fast as they can)
+        if (stopRequested)
+        {
+            break;
+        }
+        if (recorder.isOpened() || !show)
+        {
+            markStage(ctx, STAGE_DISPLAY);
+            endFrame(ctx);
+            continue;
+        }
+        //a governed loop doesn't wait on top of its own frame time
+        char key = waitKey(ctx.governor != NULL ? 1 : 10);
+        markStage(ctx, STAGE_DISPLAY);
+        endFrame(ctx);
 		if(key == 'q') {
 		    break;
 		}
 	}
+    recorder.close();
+    printOverlayCacheStats("", ctx.overlayCache);
+    if (ctx.memory != NULL)
+    {
+        ctx.memory->printSummary();
+    }
 
 	// terminate the video capture
 	delete capdev;
     return (0);
 }
 
+/**
+ * One camera or video file being processed in multi-stream mode
+ */
+struct StreamState
+{
+    StreamState();
+    ~StreamState();
+
+    string name;
+    FrameSource capture;
+    ARContext ctx; //its detectors, cache and publisher belong to this stream
+    FrameCache cache;
+    vector<DetectedBoard> boards;
+    Mat frame; //frame being processed by the pool
+    AsyncVideoWriter recorder; //headless mode output
+    WorkerPool *pool; //where the frame's drawing task goes once detection is done
+
+    mutex shownLock;
+    Mat shown; //latest finished frame, for display on the main thread
+
+    atomic<bool> busy; //a frame of this stream is in the pool
+    atomic<bool> finished;
+    atomic<bool> failed; //a task threw, so the stream was stopped
+
+    //stats, only touched by the task currently processing this stream
+    int64 captureTick; //when the frame in flight was grabbed
+    vector<double> latencies; //ms from capture to overlay drawn, for every frame
+    size_t windowStart; //first of latencies since the last report
+};
+
+StreamState::StreamState()
+    : pool(NULL), busy(false), finished(false), failed(false), captureTick(0), windowStart(0)
+{
+    ctx.multiDetector = NULL;
+    ctx.saddleDetector = NULL;
+    ctx.overlayCache = NULL;
+    ctx.publisher = NULL;
+}
+
+StreamState::~StreamState()
+{
+    delete ctx.multiDetector;
+    delete ctx.saddleDetector;
+    delete ctx.overlayCache;
+    delete ctx.publisher;
+}
+
+/**
+ * Stops a stream whose task threw, leaving the other streams running
+ */
+void failStream(StreamState &s, const exception &e)
+{
+    printf("Stream %s failed: %s\n", s.name.c_str(), e.what());
+    s.failed = true;
+    s.finished = true;
+    s.busy = false;
+}
+
+/**
+ * Draws the overlay into a stream's detected frame and publishes the result
+ * (runs on the pool, after detectStreamFrame)
+ */
+void drawStreamFrame(StreamState &s)
+{
+    try
+    {
+        drawBoards(s.ctx, s.boards, s.frame);
+        if (s.recorder.isOpened())
+        {
+            s.recorder.write(s.frame);
+        }
+    }
+    catch (const exception &e)
+    {
+        failStream(s, e);
+        return;
+    }
+    s.latencies.push_back((getTickCount() - s.captureTick) * 1000.0 / getTickFrequency());
+
+    {
+        lock_guard<mutex> guard(s.shownLock);
+        swap(s.frame, s.shown); //the old display buffer becomes the next capture buffer
+    }
+    s.busy = false;
+}
+
+/**
+ * Grabs the next frame of one stream, finds the boards and solves their poses,
+ * then queues the drawing as a task of its own (runs on the pool). Drawing
+ * goes on this worker's deque, where an idle worker can steal it while this
+ * one moves on to another stream's detection.
+ */
+void detectStreamFrame(StreamState &s)
+{
+    try
+    {
+        s.captureTick = getTickCount();
+        if (!s.capture.read(s.frame) || s.frame.empty())
+        {
+            s.finished = true;
+            s.busy = false;
+            return;
+        }
+        s.cache.reset(s.frame);
+        detectBoards(s.ctx, s.cache, s.boards);
+    }
+    catch (const exception &e)
+    {
+        failStream(s, e);
+        return;
+    }
+    StreamState *sp = &s;
+    s.pool->submit([sp] { drawStreamFrame(*sp); });
+}
+
+/**
+ * Value at fraction p of the way through the sorted values (0 if there are none)
+ */
+double percentile(const vector<double> &sorted, double p)
+{
+    return sorted.empty() ? 0 : sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+/**
+ * Prints each stream's frame rate and capture-to-overlay latency percentiles
+ * over the frames finished since windowTick (the last report, or for the
+ * final report the start with whole set), then starts a new window
+ */
+void printStreamStats(vector< unique_ptr<StreamState> > &streams, int64 windowTick, bool whole)
+{
+    double elapsed = (getTickCount() - windowTick) / getTickFrequency();
+    for (size_t i = 0; i < streams.size(); i++)
+    {
+        StreamState &s = *streams[i];
+        vector<double> window(s.latencies.begin() + (whole ? 0 : s.windowStart), s.latencies.end());
+        sort(window.begin(), window.end());
+        printf("%-24s %7.2f fps  latency p50 %6.1f ms  p95 %6.1f ms  max %6.1f ms  (%zu frames)%s\n",
+               s.name.c_str(), window.size() / elapsed, percentile(window, 0.5), percentile(window, 0.95),
+               window.empty() ? 0 : window.back(), window.size(), s.failed ? "  FAILED" : "");
+        s.windowStart = s.latencies.size();
+    }
+    printf("\n");
+}
+
+/**
+ * Processes several cameras/video files at once, each with its own calibration
+ * profile, on one shared work-stealing pool. Each stream keeps at most one frame
+ * in flight, so streams get the pool in turn and frames stay in order; a frame
+ * is a detection task followed by a drawing task, so one stream's drawing can
+ * run beside another's detection.
+ */
+int openStreams(vector<string> &sources, vector<string> &profiles, ARContext &defaults,
+                const FrameSourceOptions &sourceDefaults, const char *shmName, const char *logName)
+{
+    //one pool worker per stream up to the core count; leftover cores go to
+    //OpenCV's own parallel loops so the two don't oversubscribe the machine
+    int cores = max(1, getNumberOfCPUs());
+    int numWorkers = min(cores, (int)sources.size());
+    setNumThreads(max(1, cores / numWorkers));
+    WorkerPool pool(numWorkers);
+
+    vector< unique_ptr<StreamState> > streams;
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        unique_ptr<StreamState> s(new StreamState());
+        s->name = sources[i];
+        s->pool = &pool;
+
+        //camera index, video file or raw capture; each stream records to its own file
+        FrameSourceOptions source = sourceDefaults;
+        source.source = sources[i];
+        if (!sourceDefaults.recordFile.empty())
+        {
+            source.recordFile = indexedFilename(sourceDefaults.recordFile, i);
+        }
+        s->capture.open(source);
+        if (!s->capture.isOpened())
+        {
+            printf("Unable to open stream %s\n", sources[i].c_str());
+            return(-1);
+        }
+
+        //detectors, cache and publisher carry per-stream state, so each stream gets its own
+        s->ctx = defaults;
+        s->ctx.multiDetector = (defaults.multiDetector != NULL) ?
+            new MultiBoardDetector(defaults.boards) : NULL;
+        s->ctx.saddleDetector = (defaults.saddleDetector != NULL) ? new SaddleDetector(defaults.board) : NULL;
+        s->ctx.overlayCache = (defaults.overlayCache != NULL) ?
+            new OverlayCache(defaults.overlayCache->maxShift) : NULL;
+        s->ctx.publisher = NULL;
+        if (!profiles[i].empty())
+        {
+            s->ctx.cameraMatrix = Mat(3, 3, CV_64FC1);
+            s->ctx.distCoeffs = Mat::zeros(8, 1, CV_64F);
+            readCalibrationFile(profiles[i].c_str(), s->ctx.cameraMatrix, s->ctx.distCoeffs);
+        }
+        //one ring (and log) per stream, since each ring has a single writer
+        s->ctx.streamId = i;
+        s->ctx.frameNumber = 0;
+        if (shmName != NULL || logName != NULL)
+        {
+            s->ctx.publisher = new PosePublisher();
+            string ring = (shmName != NULL) ? string(shmName) + "." + to_string(i) : "";
+            string log = (logName != NULL) ? string(logName) + "." + to_string(i) : "";
+            if (shmName != NULL && !s->ctx.publisher->open(ring.c_str()))
+            {
+                printf("Unable to publish poses of stream %s to %s\n", sources[i].c_str(), ring.c_str());
+                exit(-1);
+            }
+            if (logName != NULL && !s->ctx.publisher->openLog(log.c_str()))
+            {
+                printf("Unable to write the pose log of stream %s to %s\n", sources[i].c_str(), log.c_str());
+                exit(-1);
+            }
+        }
+
+        if (defaults.outputName != NULL)
+        {
+            Size frameSize((int)s->capture.get(CAP_PROP_FRAME_WIDTH),
+                           (int)s->capture.get(CAP_PROP_FRAME_HEIGHT));
+            if (!startRecorder(s->recorder, s->capture, frameSize,
+                               indexedFilename(defaults.outputName, i)))
+            {
+                return(-1);
+            }
+        }
+        else
+        {
+            namedWindow(s->name, 1);
+        }
+        streams.push_back(move(s));
+    }
+
+    int64 startTick = getTickCount();
+    int64 lastReport = startTick;
+    for(;;) {
+        //hand every idle stream its next frame
+        bool allFinished = true;
+        for (size_t i = 0; i < streams.size(); i++)
+        {
+            StreamState *s = streams[i].get();
+            if (!s->finished)
+            {
+                allFinished = false;
+                if (!s->busy)
+                {
+                    s->busy = true;
+                    pool.submit([s] { detectStreamFrame(*s); });
+                }
+            }
+        }
+        if (allFinished)
+        {
+            break;
+        }
+
+        //HighGUI has to stay on the main thread
+        for (size_t i = 0; i < streams.size() && defaults.outputName == NULL; i++)
+        {
+            StreamState &s = *streams[i];
+            lock_guard<mutex> guard(s.shownLock);
+            if (!s.shown.empty())
+            {
+                imshow(s.name, s.shown);
+            }
+        }
+
+        if ((getTickCount() - lastReport) / getTickFrequency() > 2.0)
+        {
+            pool.waitIdle(); //stats are written by the tasks
+            printStreamStats(streams, lastReport, false);
+            lastReport = getTickCount();
+        }
+
+        if (stopRequested)
+        {
+            break;
+        }
+        if (defaults.outputName != NULL)
+        {
+            this_thread::sleep_for(chrono::milliseconds(1)); //nothing to display, just keep feeding the pool
+            continue;
+        }
+        char key = waitKey(1);
+        if(key == 'q') {
+            break;
+        }
+    }
+
+    pool.waitIdle();
+    cout << "final stream stats:\n";
+    printStreamStats(streams, startTick, true);
+
+    for (size_t i = 0; i < streams.size(); i++)
+    {
+        printOverlayCacheStats((streams[i]->name + ": ").c_str(), streams[i]->ctx.overlayCache);
+        streams[i]->recorder.close();
+    }
+    return (0);
+}
+
+/**
+ * Per-thread state for batch processing, reused from image to image
+ */
+struct BatchWorker
+{
+    ARContext ctx;
+    FrameCache cache;
+    vector<DetectedBoard> boards;
+};
+
+/**
+ * What batch processing produced for one image
+ */
+struct BatchResult
+{
+    bool processed; //false if the run was stopped before this image
+    bool decoded;
+    vector<PoseRecord> records;
+    double latencyMs; //decode through annotated image written
+    string error; //why processing failed, empty if it didn't
+};
+
+/**
+ * Makes an error message fit in one CSV field
+ */
+string csvField(string text)
+{
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == ',' || text[i] == '\n' || text[i] == '\r')
+        {
+            text[i] = ' ';
+        }
+    }
+    return text;
+}
+
+/**
+ * Writes one CSV row per pose record (images that couldn't be decoded or
+ * processed get found = -1 and the reason in the error column), in image order
+ */
+bool writeBatchCSV(const char *csvName, vector<string> &files, vector<BatchResult> &results)
+{
+    ofstream csv(csvName);
+    if (!csv.is_open())
+    {
+        cout << "Unable to open " << csvName << "\n";
+        return false;
+    }
+    csv << "image,board,width,height,found,rvec0,rvec1,rvec2,tvec0,tvec1,tvec2,reprojError,latencyMs,error\n";
+    csv << setprecision(9);
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        BatchResult &r = results[i];
+        if (!r.processed)
+        {
+            continue;
+        }
+        if (!r.decoded || r.records.empty())
+        {
+            csv << files[i] << ",0,0,0,-1,0,0,0,0,0,0,0," << r.latencyMs << "," << csvField(r.error) << "\n";
+            continue;
+        }
+        for (size_t k = 0; k < r.records.size(); k++)
+        {
+            PoseRecord &rec = r.records[k];
+            csv << files[i] << "," << rec.boardIndex << "," << rec.boardWidth << "," << rec.boardHeight
+                << "," << (rec.status == POSE_FOUND ? 1 : 0);
+            for (int j = 0; j < 3; j++)
+            {
+                csv << "," << rec.rvec[j];
+            }
+            for (int j = 0; j < 3; j++)
+            {
+                csv << "," << rec.tvec[j];
+            }
+            csv << "," << rec.reprojError << "," << r.latencyMs << "," << csvField(r.error) << "\n";
+        }
+    }
+    return true;
+}
+
+/**
+ * Processes a batch of images on a thread pool: the main thread reads files
+ * ahead of the workers (at most two per worker waiting), and the workers decode,
+ * detect, solve, draw and save. Poses go to the CSV file and/or the context's
+ * publisher in image order once everything is done; annotated images go to the
+ * output directory if there is one. Prints throughput and latency percentiles.
+ */
+int openImageBatch(vector<string> &files, ARContext &defaults, const char *csvName)
+{
+    if (files.empty())
+    {
+        cout << "No images to process\n";
+        return(-1);
+    }
+
+    //one worker per core; OpenCV's own loops stay serial inside them
+    int cores = max(1, getNumberOfCPUs());
+    int numWorkers = min(cores, (int)files.size());
+    setNumThreads(1);
+    WorkerPool pool(numWorkers);
+
+    //worker state is checked out per task, so there is never more than one per thread in use
+    vector< unique_ptr<BatchWorker> > workers;
+    vector<BatchWorker *> freeWorkers;
+    for (int i = 0; i < numWorkers; i++)
+    {
+        unique_ptr<BatchWorker> w(new BatchWorker());
+        w->ctx = defaults;
+        w->ctx.publisher = NULL; //published in order at the end
+        w->ctx.multiDetector = (defaults.multiDetector != NULL) ?
+            new MultiBoardDetector(defaults.boards, 4, 1) : NULL; //every image is a new scene
+        w->ctx.saddleDetector = (defaults.saddleDetector != NULL) ? new SaddleDetector(defaults.board) : NULL;
+        w->ctx.overlayCache = NULL; //unrelated images never share an overlay
+        freeWorkers.push_back(w.get());
+        workers.push_back(move(w));
+    }
+
+    if (defaults.outputName != NULL)
+    {
+        //annotated images go in here; fine if it exists
+        struct stat info;
+        if (mkdir(defaults.outputName, 0755) != 0 &&
+            (stat(defaults.outputName, &info) != 0 || !S_ISDIR(info.st_mode)))
+        {
+            cout << "Unable to create output directory " << defaults.outputName << "\n";
+            exit(-1);
+        }
+    }
+
+    vector<BatchResult> results(files.size());
+    mutex lock;
+    condition_variable changed;
+    int inFlight = 0;
+    int maxInFlight = 2 * numWorkers;
+
+    cout << "Processing " << files.size() << " images on " << numWorkers << " threads\n";
+    int64 startTick = getTickCount();
+    for (size_t i = 0; i < files.size() && !stopRequested; i++)
+    {
+        //read ahead: the next file comes off disk while the workers are busy
+        shared_ptr< vector<uchar> > bytes(new vector<uchar>());
+        ifstream in(files[i], ios::binary);
+        if (in.is_open())
+        {
+            bytes->assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        }
+
+        {
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [&] { return inFlight < maxInFlight; });
+            inFlight++;
+        }
+
+        pool.submit([&, i, bytes]
+        {
+            int64 start = getTickCount();
+            BatchWorker *w;
+            {
+                lock_guard<mutex> guard(lock);
+                w = freeWorkers.back();
+                freeWorkers.pop_back();
+            }
+
+            BatchResult &r = results[i];
+            try //one corrupt image mustn't end the whole batch
+            {
+                Mat frame;
+                if (!bytes->empty())
+                {
+                    frame = imdecode(*bytes, IMREAD_COLOR);
+                }
+                r.decoded = !frame.empty();
+                if (!r.decoded)
+                {
+                    r.error = "unreadable";
+                }
+                else
+                {
+                    w->cache.reset(frame);
+                    processFrame(w->ctx, w->cache, frame, w->boards, defaults.outputName != NULL);
+                    w->ctx.frameNumber = i;
+                    makePoseRecords(w->ctx, w->boards, poseTimestampUs(), r.records);
+                    if (defaults.outputName != NULL)
+                    {
+                        size_t slash = files[i].find_last_of('/');
+                        string base = slash == string::npos ? files[i] : files[i].substr(slash + 1);
+                        string annotated = string(defaults.outputName) + "/" + base;
+                        if (!imwrite(annotated, frame))
+                        {
+                            r.error = "unable to write " + annotated;
+                        }
+                    }
+                }
+            }
+            catch (const exception &e)
+            {
+                r.records.clear();
+                r.error = e.what();
+            }
+            r.latencyMs = (getTickCount() - start) * 1000 / getTickFrequency();
+            r.processed = true;
+
+            lock_guard<mutex> guard(lock);
+            freeWorkers.push_back(w);
+            inFlight--;
+            changed.notify_all();
+        });
+    }
+    pool.waitIdle();
+    double elapsed = (getTickCount() - startTick) / getTickFrequency();
+
+    //poses out in image order
+    size_t done = 0, unreadable = 0, failed = 0, withBoard = 0;
+    vector<double> latencies;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        BatchResult &r = results[i];
+        if (!r.processed)
+        {
+            continue;
+        }
+        done++;
+        latencies.push_back(r.latencyMs);
+        if (!r.decoded)
+        {
+            unreadable++;
+            cout << "Unable to read " << files[i] << ": " << csvField(r.error) << "\n";
+            continue;
+        }
+        if (!r.error.empty())
+        {
+            failed++;
+            cout << "Failed on " << files[i] << ": " << csvField(r.error) << "\n";
+        }
+        if (r.records.empty())
+        {
+            continue;
+        }
+        if (r.records[0].status == POSE_FOUND)
+        {
+            withBoard++;
+        }
+        for (size_t k = 0; k < r.records.size() && defaults.publisher != NULL; k++)
+        {
+            defaults.publisher->publish(r.records[k]);
+        }
+    }
+    if (csvName != NULL)
+    {
+        writeBatchCSV(csvName, files, results);
+    }
+
+    sort(latencies.begin(), latencies.end());
+    printf("\n%zu images in %.2f s: %.1f images/s (%zu with a board, %zu unreadable, %zu failed)\n",
+           done, elapsed, done / elapsed, withBoard, unreadable, failed);
+    printf("per-image latency: p50 %.1f ms  p90 %.1f ms  p99 %.1f ms  max %.1f ms\n",
+           percentile(latencies, 0.5), percentile(latencies, 0.9), percentile(latencies, 0.99),
+           latencies.empty() ? 0 : latencies.back());
+
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        delete workers[i]->ctx.multiDetector;
+        delete workers[i]->ctx.saddleDetector;
+    }
+    return (0);
+}
+
 int main(int argc, char *argv[])
 {
     char paramFilename[256];
     char imgOrVidName[256];
 
+    //pull out optional flags, leaving the positional arguments in order
+    vector<const BoardOps *> boardList;
+    bool multiBoard = false;
+    vector<string> streamSources;
+    vector<string> streamProfiles;
+    const char *shmName = NULL;
+    const char *logName = NULL;
+    const char *outputName = NULL;
+    bool antiAlias = false;
+    bool saddle = false;
+    const char *sceneName = NULL;
+    double overlayShift = 0;
+    double previewScale = 0;
+    bool reportMemory = false;
+    double governorBudget = 0;
+    const char *governorLogName = NULL;
+    FrameSourceOptions sourceOptions;
+    vector<char *> args;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) //-b WxH: inner corners of the board (repeatable)
+        {
+            const BoardOps *board = parseBoardOps(argv[++i]);
+            if (board == NULL)
+            {
+                exit(-1);
+            }
+            boardList.push_back(board);
+        }
+        else if (strcmp(argv[i], "-m") == 0) //-m: track several boards per frame
+        {
+            multiBoard = true;
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) //-s camera|video[=profile] (repeatable)
+        {
+            string spec = argv[++i];
+            size_t split = spec.find('=');
+            streamSources.push_back(spec.substr(0, split));
+            streamProfiles.push_back(split == string::npos ? "" : spec.substr(split + 1));
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) //-p /name: publish poses to shared memory
+        {
+            shmName = argv[++i];
+        }
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) //-l file: binary pose log (.csv: text, batch mode)
+        {
+            logName = argv[++i];
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) //-o file: headless, render to a file (batch: a directory)
+        {
+            outputName = argv[++i];
+        }
+        else if (strcmp(argv[i], "-a") == 0) //-a: anti-aliased overlay
+        {
+            antiAlias = true;
+        }
+        else if (strcmp(argv[i], "-x") == 0) //-x: saddle-point detector (faster, finds partly hidden boards)
+        {
+            saddle = true;
+        }
+        else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) //-S file: scene to draw instead of the fish
+        {
+            sceneName = argv[++i];
+        }
+        else if (strcmp(argv[i], "-R") == 0 && i + 1 < argc) //-R px: reuse the overlay while it moves less than this
+        {
+            overlayShift = atof(argv[++i]);
+            if (overlayShift <= 0)
+            {
+                cout << "invalid overlay shift " << argv[i] << " (expected pixels, e.g. 0.5)\n";
+                exit(-1);
+            }
+        }
+        else if (strcmp(argv[i], "-M") == 0 && i + 1 < argc) //-M scale: low memory, overlay drawn into a preview this size
+        {
+            previewScale = atof(argv[++i]);
+            if (previewScale <= 0 || previewScale > 1)
+            {
+                cout << "invalid preview scale " << argv[i] << " (expected 0 to 1, e.g. 0.5)\n";
+                exit(-1);
+            }
+            reportMemory = true;
+        }
+        else if (strcmp(argv[i], "-K") == 0) //-K: report peak RSS and per-frame allocations
+        {
+            reportMemory = true;
+        }
+        else if (strcmp(argv[i], "-G") == 0 && i + 1 < argc) //-G fps|Nms: trade quality to hold this rate
+        {
+            governorBudget = QualityGovernor::parseTarget(argv[++i]);
+            if (governorBudget <= 0)
+            {
+                cout << "invalid target " << argv[i] << " (expected e.g. 30 or 40ms)\n";
+                exit(-1);
+            }
+        }
+        else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc) //-L file.csv: log the governor's decisions
+        {
+            governorLogName = argv[++i];
+        }
+        else if (parseFrameSourceFlag(argc, argv, i, sourceOptions))
+        {
+            //-c, -r, -F: where frames come from
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+    }
+    if (boardList.empty())
+    {
+        boardList.push_back(findBoardOps(Size(9,6)));
+    }
+
 	// If user didn't give parameter file name
-	if(argc < 2) 
+	if(args.size() < 1) 
 	{
-		cout << "Usage: ../bin/arSystem |parameter file name| [Optional image/video file name]\n";
+		cout << "Usage: ../bin/arSystem [-b WxH]... [-m] [-s camera|video|capture.raw[=profile]]... [-p /shmName] [-l poseLog|poses.csv] [-o output] [-a] [-x] [-S scene] [-R px] [-M scale] [-K] [-G fps|Nms] [-L governor.csv] "
+             << FRAME_SOURCE_USAGE << " |parameter file name| [Optional image/video file, image directory or \"glob\"]\n";
 		exit(-1);
 	}
-    strcpy(paramFilename, argv[1]);
+    strcpy(paramFilename, args[0]);
 
     Mat cameraMatrix(3, 3, CV_64FC1);
     Mat distCoeffs = Mat::zeros(8, 1, CV_64F);
@@ -456,26 +1611,143 @@ int main(int argc, char *argv[])
     readCalibrationFile(paramFilename, cameraMatrix, distCoeffs);
     cout << "Read in calibration file...\n";
 
-    if (argc == 3) //if user gave an image/video filename
+    ARContext ctx;
+    ctx.cameraMatrix = cameraMatrix;
+    ctx.distCoeffs = distCoeffs;
+    ctx.board = boardList[0];
+    ctx.boards = boardList;
+    ctx.multiDetector = NULL;
+    ctx.saddleDetector = NULL;
+    ctx.publisher = NULL;
+    ctx.streamId = 0;
+    ctx.frameNumber = 0;
+    ctx.outputName = outputName;
+    ctx.antiAlias = antiAlias;
+    ctx.scene = NULL;
+    ctx.overlayCache = (overlayShift > 0) ? new OverlayCache(overlayShift) : NULL;
+    ctx.overlayReused = false;
+    ctx.governor = NULL;
+    ctx.framesSinceDetect = 0;
+    ctx.previewScale = 0;
+    ctx.memory = NULL;
+    Scene scene;
+    if (sceneName != NULL)
+    {
+        if (!scene.load(sceneName))
+        {
+            exit(-1);
+        }
+        ctx.scene = &scene;
+    }
+    signal(SIGINT, requestStop);
+    if (multiBoard || boardList.size() > 1)
+    {
+        ctx.multiDetector = new MultiBoardDetector(boardList);
+    }
+    else if (saddle)
+    {
+        ctx.saddleDetector = new SaddleDetector(ctx.board);
+    }
+
+    //a directory, a glob, or several files (a glob the shell expanded) is a batch
+    bool batch = streamSources.empty() &&
+        (args.size() > 2 || (args.size() == 2 && isImageBatch(args[1])));
+    const char *csvName = NULL;
+    if (batch && logName != NULL && strstr(logName, ".csv") != NULL)
+    {
+        csvName = logName; //batch poses as text instead of a binary log
+        logName = NULL;
+    }
+
+    //low-memory mode and memory reports cover just the one live or video input
+    MemoryMeter *memory = NULL;
+    if (reportMemory && (!streamSources.empty() || batch || (args.size() == 2 && hasImageExtension(args[1]))))
+    {
+        cout << "-M and -K only apply to a single video or live input\n";
+        exit(-1);
+    }
+    if (reportMemory)
+    {
+        memory = new MemoryMeter();
+        ctx.memory = memory;
+        ctx.previewScale = previewScale;
+    }
+
+    //the governor tunes the one live or video input; streams and batches run at full quality
+    QualityGovernor *governor = NULL;
+    if (governorBudget > 0 && streamSources.empty() && !batch)
+    {
+        governor = new QualityGovernor(governorBudget);
+        if (governorLogName != NULL && !governor->openLog(governorLogName))
+        {
+            exit(-1);
+        }
+        if (ctx.scene == NULL)
+        {
+            governor->disableKnob(KNOB_LOD); //the fish has no levels of detail
+        }
+        if (outputName != NULL)
+        {
+            governor->disableKnob(KNOB_DISPLAY); //every frame is recorded
+        }
+        if (ctx.multiDetector != NULL)
+        {
+            //the multi-board detector tracks on its own; only its refinement is tunable
+            governor->disableKnob(KNOB_DETECT_INTERVAL);
+            governor->disableKnob(KNOB_DETECT_SCALE);
+        }
+        ctx.governor = governor;
+        ctx.quality = governor->settings();
+        printf("governor: holding %.1f ms per frame (%.1f fps)\n", governorBudget, 1000 / governorBudget);
+    }
+
+    PosePublisher publisher;
+    if (streamSources.empty() && (shmName != NULL || logName != NULL))
+    {
+        if ((shmName != NULL && !publisher.open(shmName)) ||
+            (logName != NULL && !publisher.openLog(logName)))
+        {
+            exit(-1);
+        }
+        ctx.publisher = &publisher;
+    }
+
+    if (!streamSources.empty()) //several streams at once
+    {
+        openStreams(streamSources, streamProfiles, ctx, sourceOptions, shmName, logName);
+    }
+    else if (batch)
+    {
+        vector<string> files;
+        if (args.size() == 2)
+        {
+            listImages(args[1], files);
+        }
+        else
+        {
+            files.assign(args.begin() + 1, args.end());
+        }
+        openImageBatch(files, ctx, csvName);
+    }
+    else if (args.size() == 2) //if user gave an image/video filename
     {
-        strcpy(imgOrVidName, argv[2]);
+        strcpy(imgOrVidName, args[1]);
 
         // image
-        if( strstr(imgOrVidName, ".jpg") ||
-            strstr(imgOrVidName, ".png") ||
-            strstr(imgOrVidName, ".ppm") ||
-            strstr(imgOrVidName, ".tif") ) 
+        if (hasImageExtension(imgOrVidName))
         {
-            openImgFile(imgOrVidName, cameraMatrix, distCoeffs);
+            openImgFile(imgOrVidName, ctx);
         }
         // prerecorded video
         else if (strstr(imgOrVidName, ".mp4") ||
             strstr(imgOrVidName, ".m4v") ||
             strstr(imgOrVidName, ".MOV") ||
             strstr(imgOrVidName, ".mov") ||
-            strstr(imgOrVidName, ".avi") )
+            strstr(imgOrVidName, ".avi") ||
+            strstr(imgOrVidName, ".raw") )
         {
-            openVidFile(imgOrVidName, cameraMatrix, distCoeffs);
+            sourceOptions.source = imgOrVidName;
+            openVidFile(sourceOptions, ctx);
         }
         else
         {
@@ -484,8 +1756,13 @@ int main(int argc, char *argv[])
     }
     else // live feed
     {
-        openVideoInput(cameraMatrix, distCoeffs);        
+        openVideoInput(ctx, sourceOptions);
     }
 
+    delete governor;
+    delete memory;
+    delete ctx.overlayCache;
+    delete ctx.multiDetector;
+    delete ctx.saddleDetector;
     return 0;
 }
\ No newline at end of file
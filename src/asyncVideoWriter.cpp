@@ -0,0 +1,117 @@
+/* asyncVideoWriter.cpp
+ * Background-thread video encoding
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <iostream>
+#include "asyncVideoWriter.h"
+
+using namespace std;
+using namespace cv;
+
+AsyncVideoWriter::AsyncVideoWriter()
+    : maxQueued(8), running(false), stopping(false), written(0)
+{
+}
+
+AsyncVideoWriter::~AsyncVideoWriter()
+{
+    close();
+}
+
+bool AsyncVideoWriter::open(const string &filename, double fps, Size frameSize, int maxQueuedFrames)
+{
+    close();
+
+    bool avi = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".avi") == 0;
+    int fourcc = avi ? VideoWriter::fourcc('M','J','P','G') : VideoWriter::fourcc('m','p','4','v');
+    if (!writer.open(filename, fourcc, fps > 0 ? fps : 30, frameSize))
+    {
+        cout << "Unable to open video writer " << filename << "\n";
+        return false;
+    }
+
+    maxQueued = maxQueuedFrames;
+    stopping = false;
+    running = true;
+    written = 0;
+    encoder = thread(&AsyncVideoWriter::encodeLoop, this);
+    return true;
+}
+
+void AsyncVideoWriter::write(const Mat &frame)
+{
+    unique_lock<mutex> guard(lock);
+    changed.wait(guard, [this] { return (int)queue.size() < maxQueued; });
+
+    //reuse an already-encoded frame's buffer instead of allocating a new one
+    Mat buffer;
+    if (!spare.empty())
+    {
+        buffer = spare.back();
+        spare.pop_back();
+    }
+    guard.unlock();
+    frame.copyTo(buffer);
+    guard.lock();
+
+    queue.push_back(buffer);
+    changed.notify_all();
+}
+
+void AsyncVideoWriter::encodeLoop()
+{
+    for (;;)
+    {
+        Mat frame;
+        {
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [this] { return !queue.empty() || stopping; });
+            if (queue.empty())
+            {
+                return; //stopping and drained
+            }
+            frame = queue.front();
+            queue.pop_front();
+        }
+
+        writer.write(frame);
+
+        {
+            lock_guard<mutex> guard(lock);
+            written++;
+            spare.push_back(frame);
+        }
+        changed.notify_all(); //a queue slot freed up
+    }
+}
+
+void AsyncVideoWriter::close()
+{
+    if (!running)
+    {
+        return;
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    encoder.join();
+    writer.release();
+    running = false;
+}
+
+string indexedFilename(const string &filename, int index)
+{
+    size_t dot = filename.find_last_of('.');
+    size_t slash = filename.find_last_of('/');
+    if (dot == string::npos || (slash != string::npos && dot < slash))
+    {
+        return filename + "." + to_string(index);
+    }
+    return filename.substr(0, dot) + "." + to_string(index) + filename.substr(dot);
+}
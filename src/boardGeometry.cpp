@@ -0,0 +1,105 @@
+/* boardGeometry.cpp
+ * Instantiates the compile-time board geometry for the common board sizes
+ * and exposes them through a runtime dispatch table
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <cstdio>
+#include <iostream>
+#include "boardGeometry.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Detects corners for a compile-time board and copies them out for callers
+ * that need a growable list (e.g. for calibrateCamera)
+ */
+template <class Board>
+static bool detectCornersAs(const Mat &gray, vector<Point2f> &corners, int subPixIterations)
+{
+    typename Board::CornerBuffer buffer;
+    bool found = detectBoardCorners<Board>(gray, buffer, subPixIterations);
+    if (found)
+    {
+        corners.assign(buffer.begin(), buffer.end());
+    }
+    else
+    {
+        corners.clear();
+    }
+    return found;
+}
+
+template <class Board>
+static BoardOps makeBoardOps()
+{
+    BoardOps ops;
+    ops.width = Board::width;
+    ops.height = Board::height;
+    ops.numCorners = Board::numCorners;
+    ops.objectPoints = Board::objectPoints.data();
+    ops.detectCorners = detectCornersAs<Board>;
+    ops.estimatePose = estimateBoardPose<Board>;
+    ops.solvePose = solveBoardPose<Board>;
+    return ops;
+}
+
+//board sizes compiled into the hot path; 9x6 is the board the project uses
+static const BoardOps boardTable[] = {
+    makeBoardOps< BoardGeometry<9,6> >(),
+    makeBoardOps< BoardGeometry<8,6> >(),
+    makeBoardOps< BoardGeometry<7,6> >(),
+    makeBoardOps< BoardGeometry<7,5> >(),
+    makeBoardOps< BoardGeometry<6,4> >(),
+    makeBoardOps< BoardGeometry<10,7> >()
+};
+static const int numBoards = sizeof(boardTable) / sizeof(boardTable[0]);
+
+vector<Point3f> BoardOps::pointSet() const
+{
+    vector<Point3f> points;
+    points.reserve(numCorners);
+    for (int i = 0; i < numCorners; i++)
+    {
+        points.push_back(Point3f(objectPoints[i].x, objectPoints[i].y, objectPoints[i].z));
+    }
+    return points;
+}
+
+const BoardOps *findBoardOps(Size chessboardSize)
+{
+    for (int i = 0; i < numBoards; i++)
+    {
+        if (boardTable[i].width == chessboardSize.width &&
+            boardTable[i].height == chessboardSize.height)
+        {
+            return &boardTable[i];
+        }
+    }
+    return NULL;
+}
+
+const BoardOps *parseBoardOps(const char *sizeStr)
+{
+    int width, height;
+    const BoardOps *ops = NULL;
+    if (sscanf(sizeStr, "%dx%d", &width, &height) == 2)
+    {
+        ops = findBoardOps(Size(width, height));
+    }
+
+    if (ops == NULL)
+    {
+        cout << "Unsupported board size " << sizeStr << "; supported sizes:";
+        for (int i = 0; i < numBoards; i++)
+        {
+            cout << " " << boardTable[i].width << "x" << boardTable[i].height;
+        }
+        cout << "\n";
+    }
+    return ops;
+}
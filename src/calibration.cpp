@@ -25,51 +25,38 @@
 #include "opencv2/opencv.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/calib3d/calib3d.hpp"
+#include "frameCache.h"
+#include "boardGeometry.h"
+#include "frameSource.h"
+#include "subPixRefiner.h"
+#include "sparseCalibration.h"
+#include "calibrationProfile.h"
 
 using namespace std;
 using namespace cv;
 
 /**
- * Detects corners of a chessboard of the given size in the given image frame
- * and draws markers into the frame if found
+ * Detects corners of the given chessboard in the cached frame
+ * and draws markers into the given image if found
  */
-vector<Point2f> detectCorners(Mat imageFrame, Size chessboardSize)
+vector<Point2f> detectCorners(FrameCache &cache, Mat &imageFrame, const BoardOps *board,
+                              SubPixRefiner &refiner)
 {
     vector<Point2f> corner_set;
-    bool chessboardFound = findChessboardCorners(imageFrame, chessboardSize, corner_set);
-    
+    //search on the shared grayscale image, then refine the whole board at once
+    //(warm-started from the last frame while the board stays in view)
+    bool chessboardFound = board->detectCorners(cache.gray(), corner_set, 0);
     if (chessboardFound)
     {
-        // refine corners
-        Mat gray;
-        cvtColor(imageFrame, gray, CV_BGR2GRAY);
-        Size searchArea(5,5);
-        Size zeroZone(-1,-1); //unused parameter
-        TermCriteria criteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 40, 0.001);
-        cornerSubPix(gray, corner_set, searchArea, zeroZone, criteria);
+        refiner.refine(cache.gray(), corner_set);
     }
-
-    drawChessboardCorners(imageFrame, chessboardSize, corner_set, chessboardFound);
-    return corner_set;
-}
-
-/**
- * Builds a set of 3D-space points for the corners of a chessboard of the given size,
- * with coordinates in units of chessboard squares
- */
-vector<Point3f> buildPointSet(Size chessboardSize)
-{
-    vector<Point3f> points;
-    
-    for (int i = 0; i < chessboardSize.height; i++)
+    else
     {
-        for (int j = 0; j < chessboardSize.width; j++)
-        {
-            points.push_back(Point3f(j, -i, 0));
-        }
+        refiner.reset();
     }
-    
-    return points;
+
+    drawChessboardCorners(imageFrame, board->size(), corner_set, chessboardFound);
+    return corner_set;
 }
 
 /**
@@ -77,36 +64,21 @@ vector<Point3f> buildPointSet(Size chessboardSize)
  */
 void printCalibrationInfo(Mat cameraMatrix, Mat distCoeffs, double reprojError)
 {
-    cout << "\ncamera matrix:\n";
-    for (int i = 0; i < cameraMatrix.rows; i++)
-    {
-        for (int j = 0; j < cameraMatrix.cols; j++)
-        {
-            cout << cameraMatrix.at<double>(i, j) << " ";
-        }
-        cout << "\n";
-    }
-
-    cout << "\ndistortion coefficients:\n";
-    for (int i = 0; i < distCoeffs.rows; i++)
-    {
-        cout << distCoeffs.at<double>(i, 0) << " ";
-    }
-    cout << "\n";
-
+    printCalibrationProfile(cameraMatrix, distCoeffs);
     cout << "\nre-projection error: " << reprojError << "\n";
 }
 
 /**
- * Looks for chessboard corners on a live video feed and
- * allows the user to run calibration
+ * Looks for chessboard corners on a live video feed (or replayed raw capture)
+ * and allows the user to run calibration, starting from the given profile
+ * if there is one
  */
-int openVideoInput( )
+int openVideoInput( const BoardOps *board, const FrameSourceOptions &source, const char *profileFile )
 {
-    VideoCapture *capdev;
+    FrameSource *capdev;
 
 	// open the video device
-	capdev = new cv::VideoCapture(0);
+	capdev = new FrameSource(source);
 	if( !capdev->isOpened() ) {
 		printf("Unable to open video device\n");
 		return(-1);
@@ -120,8 +92,6 @@ int openVideoInput( )
 	namedWindow("Video", 1);
 	Mat frame;
 
-    Size chessboardSize(9,6);
-
     vector< vector<Point2f> > savedCornerSets; //vector of corner lists for each calib frame
     vector< vector<Point3f> > savedPointSets; //vector of point lists for each calib frame
 
@@ -136,11 +106,31 @@ int openVideoInput( )
     Mat distCoeffs = Mat::zeros(8, 1, CV_64F);
     vector<Mat> rvecs, tvecs;
 
+    //warm start from an existing profile, and later from the last calibration
+    SparseCalibrationOptions solverOptions;
+    if (profileFile != NULL)
+    {
+        if (!readCalibrationProfile(profileFile, cameraMatrix, distCoeffs))
+        {
+            printf("Unable to read calibration profile %s\n", profileFile);
+            delete capdev;
+            return(-1);
+        }
+        solverOptions.useInitialGuess = true;
+    }
+
     int filenameNum = 0; //for saving calibration frames
+    FrameCache cache;
+    SubPixRefiner refiner; //same window, iterations and epsilon as the old cornerSubPix call
 	for(;;) {
-		*capdev >> frame; // get a new frame from the camera, treat as a stream
+        if (!capdev->grab() || !capdev->retrieve(frame)) //camera failed or replay finished
+        {
+            break;
+        }
+        //detect on a V4L2 camera's own luma plane rather than converting back from color
+        cache.reset(capdev->luma().empty() ? frame : capdev->luma());
 
-        vector<Point2f> corners = detectCorners(frame, chessboardSize);
+        vector<Point2f> corners = detectCorners(cache, frame, board, refiner);
 
         imshow("Video", frame);
 
@@ -149,7 +139,7 @@ int openVideoInput( )
         if(key == 's') { //s to select calibration frame
 
 		    savedCornerSets.push_back(corners);
-            savedPointSets.push_back( buildPointSet(chessboardSize) );
+            savedPointSets.push_back( board->pointSet() );
 
             //save calibration frame
             string filename = "calibration_frame_" + to_string(filenameNum) + ".jpg";
@@ -160,10 +150,14 @@ int openVideoInput( )
             //if the user has saved enough calibration frames
             if (savedCornerSets.size() >= 5)
             {
-                double reprojError = calibrateCamera(savedPointSets, savedCornerSets, frame.size(),
+                //same model as calibrateCamera with CV_CALIB_FIX_ASPECT_RATIO
+                SparseCalibrationReport report;
+                double reprojError = calibrateSparse(savedPointSets, savedCornerSets, frame.size(),
                                                      cameraMatrix, distCoeffs, rvecs, tvecs,
-                                                     CV_CALIB_FIX_ASPECT_RATIO);
+                                                     solverOptions, &report);
+                solverOptions.useInitialGuess = true;
                 printCalibrationInfo(cameraMatrix, distCoeffs, reprojError);
+                printf("(%d views, %d iterations)\n", (int)savedCornerSets.size(), report.iterations);
             }
         }
         else if(key == 'f') //f to write camera intrinsic parameters to a file
@@ -171,24 +165,10 @@ int openVideoInput( )
             //if distCoeffs have been set (i.e. if a calibration has been run)
             if (distCoeffs.at<double>(0, 0) != 0)
             {
-                ofstream outfile;
-                outfile.open ("calibration.txt");
-
-                //write in camera matrix
-                for (int i = 0; i < 3; i++)
+                if (!writeCalibrationProfile("calibration.txt", cameraMatrix, distCoeffs))
                 {
-                    outfile << cameraMatrix.at<double>(i, 0) << " "
-                            << cameraMatrix.at<double>(i, 1) << " " 
-                            << cameraMatrix.at<double>(i, 2) << "\n";
+                    printf("Unable to write calibration.txt\n");
                 }
-
-                //write in distortion coeffs
-                for (int i = 0; i < distCoeffs.rows; i++)
-                {
-                    outfile << distCoeffs.at<double>(i, 0) << " ";
-                }
-
-                outfile.close();
             }
         }
 		else if(key == 'q') //q to exit
@@ -205,8 +185,32 @@ int openVideoInput( )
 
 int main( int argc, char *argv[] ) 
 {
+    const BoardOps *board = findBoardOps(Size(9,6));
+    FrameSourceOptions sourceOptions;
+    const char *profileFile = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) //-b WxH: inner corners of the board
+        {
+            board = parseBoardOps(argv[++i]);
+            if (board == NULL)
+            {
+                exit(-1);
+            }
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) //-p calibration.txt: profile to start from
+        {
+            profileFile = argv[++i];
+        }
+        else if (!parseFrameSourceFlag(argc, argv, i, sourceOptions))
+        {
+            cout << "Usage: ../bin/calibration [-b WxH] [-p profile.txt] " << FRAME_SOURCE_USAGE << "\n";
+            exit(-1);
+        }
+    }
+
     cout << "\nOpening live video..\n";
-    openVideoInput();
+    openVideoInput(board, sourceOptions, profileFile);
 		
 	printf("\nTerminating\n");
 
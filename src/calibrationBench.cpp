@@ -0,0 +1,112 @@
+/* calibrationBench.cpp
+ * Times calibrateCamera (CALIB_FIX_ASPECT_RATIO) against calibrateSparse,
+ * cold and warm-started from a profile, on growing numbers of synthetic
+ * views of a board seen by a known camera, and checks they agree
+ *
+ * to compile:
+ * make calibrationBench
+ *
+ * usage: ../bin/calibrationBench [maxViews]
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include "opencv2/calib3d/calib3d.hpp"
+#include "boardGeometry.h"
+#include "sparseCalibration.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Projects the board from random poses that keep it in the frame, with
+ * 0.2 pixel corner noise
+ */
+void makeViews(int numViews, const BoardOps *board, const Mat &cameraMatrix, const Mat &distCoeffs,
+               Size imageSize, vector<vector<Point3f> > &objectPoints,
+               vector<vector<Point2f> > &imagePoints)
+{
+    RNG rng(365);
+    vector<Point3f> boardPoints = board->pointSet();
+    objectPoints.clear();
+    imagePoints.clear();
+    while ((int)objectPoints.size() < numViews)
+    {
+        Mat rvec = (Mat_<double>(3, 1) << rng.uniform(-0.5, 0.5), rng.uniform(-0.5, 0.5), rng.uniform(-0.5, 0.5));
+        Mat tvec = (Mat_<double>(3, 1) << rng.uniform(-5.0, -2.0), rng.uniform(1.0, 4.0), rng.uniform(10.0, 20.0));
+        vector<Point2f> corners;
+        projectPoints(boardPoints, rvec, tvec, cameraMatrix, distCoeffs, corners);
+
+        bool inside = true;
+        for (size_t i = 0; i < corners.size(); i++)
+        {
+            corners[i] += Point2f(rng.gaussian(0.2), rng.gaussian(0.2));
+            inside = inside && corners[i].x > 5 && corners[i].y > 5 &&
+                     corners[i].x < imageSize.width - 5 && corners[i].y < imageSize.height - 5;
+        }
+        if (inside)
+        {
+            objectPoints.push_back(boardPoints);
+            imagePoints.push_back(corners);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int maxViews = argc > 1 ? atoi(argv[1]) : 400;
+    const BoardOps *board = findBoardOps(Size(9,6));
+    Size imageSize(640, 480);
+    Mat trueCamera = (Mat_<double>(3, 3) << 650, 0, 310, 0, 650, 250, 0, 0, 1);
+    Mat trueDist = (Mat_<double>(5, 1) << -0.17, 0.08, 0.003, -0.002, 0.02);
+
+    //the profile a recalibration would start from: a slightly different camera
+    Mat profileCamera = (Mat_<double>(3, 3) << 640, 0, 316, 0, 640, 244, 0, 0, 1);
+    Mat profileDist = (Mat_<double>(5, 1) << -0.15, 0.05, 0, 0, 0);
+
+    printf("%d threads; times in ms, |df| and |dc| are the sparse solution's distance from calibrateCamera's\n",
+           getNumThreads());
+    printf("%6s %12s %10s | %12s %6s %10s | %12s %6s | %8s %8s\n", "views", "calibCamera", "rms",
+           "sparse", "iters", "rms", "sparse warm", "iters", "|df|", "|dc|");
+    for (int numViews = 10; numViews <= maxViews; numViews *= 2)
+    {
+        vector<vector<Point3f> > objectPoints;
+        vector<vector<Point2f> > imagePoints;
+        makeViews(numViews, board, trueCamera, trueDist, imageSize, objectPoints, imagePoints);
+        vector<Mat> rvecs, tvecs;
+
+        Mat cvCamera = Mat::eye(3, 3, CV_64F), cvDist;
+        int64 start = getTickCount();
+        double cvError = calibrateCamera(objectPoints, imagePoints, imageSize, cvCamera, cvDist,
+                                         rvecs, tvecs, CV_CALIB_FIX_ASPECT_RATIO);
+        double cvMs = (getTickCount() - start) * 1000 / getTickFrequency();
+
+        Mat camera, dist;
+        SparseCalibrationReport cold, warm;
+        start = getTickCount();
+        calibrateSparse(objectPoints, imagePoints, imageSize, camera, dist, rvecs, tvecs,
+                        SparseCalibrationOptions(), &cold);
+        double coldMs = (getTickCount() - start) * 1000 / getTickFrequency();
+
+        Mat warmCamera = profileCamera.clone(), warmDist = profileDist.clone();
+        SparseCalibrationOptions warmOptions;
+        warmOptions.useInitialGuess = true;
+        start = getTickCount();
+        calibrateSparse(objectPoints, imagePoints, imageSize, warmCamera, warmDist, rvecs, tvecs,
+                        warmOptions, &warm);
+        double warmMs = (getTickCount() - start) * 1000 / getTickFrequency();
+
+        double df = fabs(camera.at<double>(0, 0) - cvCamera.at<double>(0, 0));
+        double dc = norm(Point2d(camera.at<double>(0, 2) - cvCamera.at<double>(0, 2),
+                                 camera.at<double>(1, 2) - cvCamera.at<double>(1, 2)));
+        printf("%6d %12.1f %10.6f | %12.1f %6d %10.6f | %12.1f %6d | %8.4f %8.4f\n", numViews,
+               cvMs, cvError, coldMs, cold.iterations, cold.finalError, warmMs, warm.iterations, df, dc);
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+/* calibrationProfile.cpp
+ * Reading and writing calibration.txt camera profiles
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <fstream>
+#include <iostream>
+#include "calibrationProfile.h"
+
+using namespace std;
+using namespace cv;
+
+bool readCalibrationProfile(const string &filename, Mat &cameraMatrix, Mat &distCoeffs)
+{
+    ifstream paramFile(filename.c_str());
+    if (!paramFile.is_open())
+    {
+        return false;
+    }
+
+    cameraMatrix = Mat::zeros(3, 3, CV_64F);
+    for (int i = 0; i < 9; i++)
+    {
+        if (!(paramFile >> cameraMatrix.at<double>(i / 3, i % 3)))
+        {
+            return false;
+        }
+    }
+    vector<double> coeffs;
+    double c;
+    while (paramFile >> c)
+    {
+        coeffs.push_back(c);
+    }
+    if (coeffs.size() < 4)
+    {
+        return false;
+    }
+    Mat(coeffs).copyTo(distCoeffs);
+    return true;
+}
+
+bool writeCalibrationProfile(const string &filename, const Mat &cameraMatrix, const Mat &distCoeffs)
+{
+    ofstream outfile(filename.c_str());
+    if (!outfile.is_open())
+    {
+        return false;
+    }
+
+    //camera matrix rows, then the distortion coeffs on one line
+    for (int i = 0; i < 3; i++)
+    {
+        outfile << cameraMatrix.at<double>(i, 0) << " "
+                << cameraMatrix.at<double>(i, 1) << " "
+                << cameraMatrix.at<double>(i, 2) << "\n";
+    }
+    for (int i = 0; i < distCoeffs.rows; i++)
+    {
+        outfile << distCoeffs.at<double>(i, 0) << " ";
+    }
+    return outfile.good();
+}
+
+void printCalibrationProfile(const Mat &cameraMatrix, const Mat &distCoeffs)
+{
+    cout << "\ncamera matrix:\n";
+    for (int i = 0; i < cameraMatrix.rows; i++)
+    {
+        for (int j = 0; j < cameraMatrix.cols; j++)
+        {
+            cout << cameraMatrix.at<double>(i, j) << " ";
+        }
+        cout << "\n";
+    }
+
+    cout << "\ndistortion coefficients:\n";
+    for (int i = 0; i < distCoeffs.rows; i++)
+    {
+        cout << distCoeffs.at<double>(i, 0) << " ";
+    }
+    cout << "\n";
+}
@@ -0,0 +1,419 @@
+/* drawList.cpp
+ * Batched, tiled 2D overlay rasterization
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "drawList.h"
+
+using namespace std;
+using namespace cv;
+
+DrawList::DrawList()
+    : tileSize(64)
+{
+}
+
+void DrawList::clear()
+{
+    primitives.clear();
+    vertices.clear();
+}
+
+/**
+ * Converts a Scalar color to the bytes written into the image
+ */
+static void packColor(const Scalar &color, unsigned char out[4])
+{
+    for (int c = 0; c < 4; c++)
+    {
+        out[c] = saturate_cast<uchar>(color[c]);
+    }
+}
+
+/**
+ * Bounding box of a thick segment, padded by a pixel for anti-aliased edges
+ */
+static Rect2f segmentBounds(Point2f a, Point2f b, float radius)
+{
+    float pad = radius + 1;
+    float x0 = min(a.x, b.x) - pad;
+    float y0 = min(a.y, b.y) - pad;
+    return Rect2f(x0, y0, max(a.x, b.x) + pad - x0, max(a.y, b.y) + pad - y0);
+}
+
+void DrawList::addSegment(Point2f a, Point2f b, const Scalar &color, int thickness)
+{
+    DrawPrimitive p;
+    p.a = a;
+    p.b = b;
+    p.radius = max(thickness, 1) * 0.5f;
+    p.firstVertex = 0;
+    p.numVertices = 0;
+    p.bounds = segmentBounds(a, b, p.radius);
+    packColor(color, p.color);
+    primitives.push_back(p);
+}
+
+void DrawList::addPolyline(const Point2f *points, int n, bool closed, const Scalar &color, int thickness)
+{
+    for (int i = 0; i + 1 < n; i++)
+    {
+        addSegment(points[i], points[i + 1], color, thickness);
+    }
+    if (closed && n > 2)
+    {
+        addSegment(points[n - 1], points[0], color, thickness);
+    }
+}
+
+void DrawList::addPolyline(const vector<Point2f> &points, bool closed, const Scalar &color, int thickness)
+{
+    addPolyline(points.data(), (int)points.size(), closed, color, thickness);
+}
+
+void DrawList::addFill(const vector<Point2f> &polygon, const Scalar &color)
+{
+    if (polygon.size() < 3)
+    {
+        return;
+    }
+    DrawPrimitive p;
+    p.radius = 0;
+    p.firstVertex = (int)vertices.size();
+    p.numVertices = (int)polygon.size();
+    p.bounds = boundingRect(polygon);
+    packColor(color, p.color);
+    vertices.insert(vertices.end(), polygon.begin(), polygon.end());
+    primitives.push_back(p);
+}
+
+/**
+ * Clips segment a-b to the given rectangle (Liang-Barsky); returns false if
+ * none of it is inside
+ */
+static bool clipSegment(Point2f &a, Point2f &b, const Rect2f &rect)
+{
+    float t0 = 0, t1 = 1;
+    float dx = b.x - a.x, dy = b.y - a.y;
+    const float p[4] = {-dx, dx, -dy, dy};
+    const float q[4] = {a.x - rect.x, rect.x + rect.width - a.x,
+                        a.y - rect.y, rect.y + rect.height - a.y};
+    for (int i = 0; i < 4; i++)
+    {
+        if (p[i] == 0)
+        {
+            if (q[i] < 0)
+            {
+                return false; //parallel to and outside this edge
+            }
+            continue;
+        }
+        float t = q[i] / p[i];
+        if (p[i] < 0)
+        {
+            t0 = max(t0, t);
+        }
+        else
+        {
+            t1 = min(t1, t);
+        }
+        if (t0 > t1)
+        {
+            return false;
+        }
+    }
+    Point2f start = a;
+    a = start + t0 * Point2f(dx, dy);
+    b = start + t1 * Point2f(dx, dy);
+    return true;
+}
+
+Rect DrawList::bounds(Size frameSize) const
+{
+    if (primitives.empty())
+    {
+        return Rect();
+    }
+    Rect2f box = primitives[0].bounds;
+    for (size_t i = 1; i < primitives.size(); i++)
+    {
+        box |= primitives[i].bounds;
+    }
+    //round outward, with a pixel of slack
+    Rect pixels((int)floor(box.x) - 1, (int)floor(box.y) - 1, 0, 0);
+    pixels.width = (int)ceil(box.x + box.width) + 2 - pixels.x;
+    pixels.height = (int)ceil(box.y + box.height) + 2 - pixels.y;
+    return pixels & Rect(0, 0, frameSize.width, frameSize.height);
+}
+
+/**
+ * Clips every primitive against the frame once, so no tile has to deal with
+ * geometry far outside the image; leaves the survivors' indices in visible
+ */
+void DrawList::clipToFrame(Size frameSize)
+{
+    Rect2f frameRect(0, 0, frameSize.width, frameSize.height);
+    visible.clear();
+    for (size_t i = 0; i < primitives.size(); i++)
+    {
+        DrawPrimitive &p = primitives[i];
+        if (p.numVertices == 0)
+        {
+            //keep the stroke's width past the border so edge pixels still get its caps
+            float pad = p.radius + 1;
+            Rect2f clipRect(-pad, -pad, frameRect.width + 2 * pad, frameRect.height + 2 * pad);
+            if (!clipSegment(p.a, p.b, clipRect))
+            {
+                continue;
+            }
+            p.bounds = segmentBounds(p.a, p.b, p.radius);
+        }
+        if ((p.bounds & frameRect).area() > 0)
+        {
+            visible.push_back((int)i);
+        }
+    }
+}
+
+/**
+ * Squared distance from point (x, y) to segment a-b
+ */
+static inline float segmentDistanceSq(float x, float y, Point2f a, Point2f d, float lengthSq)
+{
+    float px = x - a.x, py = y - a.y;
+    float t = lengthSq > 0 ? (px * d.x + py * d.y) / lengthSq : 0;
+    t = min(max(t, 0.f), 1.f);
+    float ex = px - t * d.x, ey = py - t * d.y;
+    return ex * ex + ey * ey;
+}
+
+/**
+ * Lists, for every tile, the visible primitives that touch it; a long
+ * diagonal segment only goes in the tiles near its line, not its whole box
+ */
+void DrawList::binTiles(int tilesX, int tilesY)
+{
+    bins.resize(tilesX * tilesY);
+    for (size_t t = 0; t < bins.size(); t++)
+    {
+        bins[t].clear();
+    }
+
+    float halfDiagonal = tileSize * 0.7072f;
+    for (size_t v = 0; v < visible.size(); v++)
+    {
+        const DrawPrimitive &p = primitives[visible[v]];
+        int tx0 = max((int)floor(p.bounds.x / tileSize), 0);
+        int ty0 = max((int)floor(p.bounds.y / tileSize), 0);
+        int tx1 = min((int)floor((p.bounds.x + p.bounds.width) / tileSize), tilesX - 1);
+        int ty1 = min((int)floor((p.bounds.y + p.bounds.height) / tileSize), tilesY - 1);
+        bool segment = p.numVertices == 0;
+        Point2f d = p.b - p.a;
+        float lengthSq = d.dot(d);
+        float reach = halfDiagonal + p.radius + 1;
+
+        for (int ty = ty0; ty <= ty1; ty++)
+        {
+            for (int tx = tx0; tx <= tx1; tx++)
+            {
+                if (segment && (tx1 > tx0 || ty1 > ty0))
+                {
+                    float cx = (tx + 0.5f) * tileSize, cy = (ty + 0.5f) * tileSize;
+                    if (segmentDistanceSq(cx, cy, p.a, d, lengthSq) > reach * reach)
+                    {
+                        continue;
+                    }
+                }
+                bins[ty * tilesX + tx].push_back(visible[v]);
+            }
+        }
+    }
+}
+
+/**
+ * Writes (or, with coverage < 1, blends) one pixel
+ */
+static inline void plot(uchar *pixel, const unsigned char color[4], int channels, float coverage)
+{
+    if (coverage >= 1)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            pixel[c] = color[c];
+        }
+    }
+    else
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            pixel[c] = (uchar)(pixel[c] + (color[c] - pixel[c]) * coverage + 0.5f);
+        }
+    }
+}
+
+/**
+ * Rasterizes a thick segment (round caps) into the part of img inside tile;
+ * pixel centers are at integer coordinates, as with cv::line
+ */
+static void rasterSegment(Mat &img, const Rect &tile, const DrawPrimitive &p, bool antiAlias,
+                          const unsigned char *solidColor)
+{
+    int channels = img.channels();
+    float radius = p.radius;
+    float reach = antiAlias ? radius + 0.5f : radius;
+    Point2f d = p.b - p.a;
+    float lengthSq = d.dot(d);
+    float length = sqrt(lengthSq);
+    float nx = length > 0 ? -d.y / length : 0;
+    float ny = length > 0 ? d.x / length : 1;
+
+    int ys = max(tile.y, (int)ceil(p.bounds.y));
+    int ye = min(tile.y + tile.height - 1, (int)floor(p.bounds.y + p.bounds.height));
+    int boxX0 = max(tile.x, (int)ceil(p.bounds.x));
+    int boxX1 = min(tile.x + tile.width - 1, (int)floor(p.bounds.x + p.bounds.width));
+    for (int y = ys; y <= ye; y++)
+    {
+        //narrow the row to the band around the line, so diagonals don't test their whole box
+        int xs = boxX0, xe = boxX1;
+        if (fabs(nx) > 1e-4f)
+        {
+            float offset = ny * (y - p.a.y);
+            float x0 = p.a.x + (-reach - offset) / nx;
+            float x1 = p.a.x + (reach - offset) / nx;
+            if (x0 > x1)
+            {
+                swap(x0, x1);
+            }
+            xs = max(xs, (int)floor(x0));
+            xe = min(xe, (int)ceil(x1));
+        }
+
+        uchar *row = img.ptr<uchar>(y);
+        for (int x = xs; x <= xe; x++)
+        {
+            float distSq = segmentDistanceSq(x, y, p.a, d, lengthSq);
+            if (distSq > reach * reach)
+            {
+                continue;
+            }
+            if (solidColor != NULL)
+            {
+                plot(row + x * channels, solidColor, channels, 1.f);
+                continue;
+            }
+            float coverage = antiAlias ? min(reach - sqrt(distSq), 1.f) : 1.f;
+            plot(row + x * channels, p.color, channels, coverage);
+        }
+    }
+}
+
+/**
+ * Fills a polygon (even-odd rule) into the part of img inside tile, one
+ * scanline at a time; crossings is scratch space reused across calls
+ */
+static void rasterFill(Mat &img, const Rect &tile, const DrawPrimitive &p,
+                       const Point2f *poly, vector<float> &crossings, const unsigned char *solidColor)
+{
+    const unsigned char *color = solidColor != NULL ? solidColor : p.color;
+    int channels = img.channels();
+    int ys = max(tile.y, (int)ceil(p.bounds.y));
+    int ye = min(tile.y + tile.height - 1, (int)floor(p.bounds.y + p.bounds.height));
+    for (int y = ys; y <= ye; y++)
+    {
+        crossings.clear();
+        for (int i = 0, j = p.numVertices - 1; i < p.numVertices; j = i++)
+        {
+            const Point2f &u = poly[i], &v = poly[j];
+            if ((u.y <= y) != (v.y <= y))
+            {
+                crossings.push_back(u.x + (y - u.y) * (v.x - u.x) / (v.y - u.y));
+            }
+        }
+        sort(crossings.begin(), crossings.end());
+
+        uchar *row = img.ptr<uchar>(y);
+        for (size_t k = 0; k + 1 < crossings.size(); k += 2)
+        {
+            int xs = max(tile.x, (int)ceil(crossings[k]));
+            int xe = min(tile.x + tile.width - 1, (int)floor(crossings[k + 1]));
+            for (int x = xs; x <= xe; x++)
+            {
+                plot(row + x * channels, color, channels, 1.f);
+            }
+        }
+    }
+}
+
+void DrawList::render(Mat &img, bool antiAlias)
+{
+    if (img.depth() != CV_8U || img.channels() > 4)
+    {
+        cout << "DrawList only renders into 8-bit images with up to 4 channels\n";
+        return;
+    }
+    rasterize(img, antiAlias, false);
+}
+
+void DrawList::renderCoverage(Mat &mask, bool antiAlias)
+{
+    if (mask.type() != CV_8UC1)
+    {
+        cout << "DrawList coverage goes into 8-bit single-channel masks\n";
+        return;
+    }
+    rasterize(mask, antiAlias, true);
+}
+
+/**
+ * Clips, bins and draws everything queued; with coverageOnly, every pixel
+ * touched is set to 255 instead of the primitive's (blended) color
+ */
+void DrawList::rasterize(Mat &img, bool antiAlias, bool coverageOnly)
+{
+    static const unsigned char covered[4] = {255, 255, 255, 255};
+    const unsigned char *solidColor = coverageOnly ? covered : NULL;
+    if (primitives.empty() || img.empty())
+    {
+        return;
+    }
+
+    clipToFrame(img.size());
+    int tilesX = (img.cols + tileSize - 1) / tileSize;
+    int tilesY = (img.rows + tileSize - 1) / tileSize;
+    binTiles(tilesX, tilesY);
+
+    //tiles don't overlap, so they can be drawn in any order on any thread
+    parallel_for_(Range(0, tilesX * tilesY), [&](const Range &range)
+    {
+        vector<float> crossings;
+        for (int t = range.start; t < range.end; t++)
+        {
+            const vector<int> &bin = bins[t];
+            if (bin.empty())
+            {
+                continue;
+            }
+            int tx = t % tilesX, ty = t / tilesX;
+            Rect tile(tx * tileSize, ty * tileSize,
+                      min(tileSize, img.cols - tx * tileSize), min(tileSize, img.rows - ty * tileSize));
+            for (size_t k = 0; k < bin.size(); k++)
+            {
+                const DrawPrimitive &p = primitives[bin[k]];
+                if (p.numVertices == 0)
+                {
+                    rasterSegment(img, tile, p, antiAlias, solidColor);
+                }
+                else
+                {
+                    rasterFill(img, tile, p, &vertices[p.firstVertex], crossings, solidColor);
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,113 @@
+/* drawListBench.cpp
+ * Times compositing N overlay segments into a frame with one cv::line call
+ * per segment (how arSystem used to draw) against the batched, tiled
+ * DrawList, with and without anti-aliasing
+ *
+ * to compile:
+ * make drawListBench
+ *
+ * usage: ../bin/drawListBench [width height]
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include "opencv2/opencv.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "drawList.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Makes n random short segments (like projected model edges) in a frame of
+ * the given size, with some reaching past the border so clipping matters
+ */
+void makeSegments(int n, Size frameSize, vector<Point2f> &ends, vector<Scalar> &colors)
+{
+    RNG rng(365);
+    ends.resize(2 * n);
+    colors.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+        Point2f a(rng.uniform(-20.f, frameSize.width + 20.f), rng.uniform(-20.f, frameSize.height + 20.f));
+        Point2f step(rng.uniform(-40.f, 40.f), rng.uniform(-40.f, 40.f));
+        ends[2 * i] = a;
+        ends[2 * i + 1] = a + step;
+        colors[i] = Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+    }
+}
+
+/**
+ * Median of the per-repetition times, in milliseconds
+ */
+double medianMs(vector<double> &times)
+{
+    sort(times.begin(), times.end());
+    return times[times.size() / 2] * 1000;
+}
+
+int main(int argc, char *argv[])
+{
+    Size frameSize(640, 480);
+    if (argc == 3)
+    {
+        frameSize = Size(atoi(argv[1]), atoi(argv[2]));
+    }
+    Mat background(frameSize, CV_8UC3, Scalar(40, 40, 40));
+    Mat img;
+    DrawList overlay;
+
+    printf("frame %dx%d, %d threads, median of repeated runs (ms per frame)\n",
+           frameSize.width, frameSize.height, getNumThreads());
+    printf("%9s %12s %12s %12s %12s\n", "segments", "cv::line", "cv::line AA", "DrawList", "DrawList AA");
+
+    const int counts[] = {10, 100, 1000, 10000, 100000};
+    for (int c = 0; c < 5; c++)
+    {
+        int n = counts[c];
+        vector<Point2f> ends;
+        vector<Scalar> colors;
+        makeSegments(n, frameSize, ends, colors);
+        int reps = max(3, min(200, 200000 / n));
+
+        double results[4];
+        for (int mode = 0; mode < 4; mode++)
+        {
+            vector<double> times;
+            for (int r = 0; r < reps; r++)
+            {
+                background.copyTo(img);
+                int64 start = getTickCount();
+                if (mode < 2)
+                {
+                    int lineType = mode == 0 ? LINE_8 : LINE_AA;
+                    for (int i = 0; i < n; i++)
+                    {
+                        line(img, ends[2 * i], ends[2 * i + 1], colors[i], 2, lineType);
+                    }
+                }
+                else
+                {
+                    //building the list is part of the cost, as it is per frame in arSystem
+                    overlay.clear();
+                    for (int i = 0; i < n; i++)
+                    {
+                        overlay.addSegment(ends[2 * i], ends[2 * i + 1], colors[i], 2);
+                    }
+                    overlay.render(img, mode == 3);
+                }
+                times.push_back((getTickCount() - start) / getTickFrequency());
+            }
+            results[mode] = medianMs(times);
+        }
+        printf("%9d %12.3f %12.3f %12.3f %12.3f\n", n, results[0], results[1], results[2], results[3]);
+    }
+
+    return 0;
+}
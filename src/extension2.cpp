@@ -21,11 +21,20 @@
 #include <fstream> //for writing out to file
 #include <iomanip> //for string formatting via a stream
 #include <cstring> //for strtok
+#include <csignal>
 #include "opencv2/opencv.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/calib3d/calib3d.hpp"
+#include "frameCache.h"
+#include "boardGeometry.h"
+#include "calibrationProfile.h"
+#include "retainedRenderer.h"
+#include "glView.h"
+#include "tripleBuffer.h"
+#include "offscreenContext.h"
+#include "asyncVideoWriter.h"
+#include "frameSource.h"
 #include "opencv2/highgui/highgui.hpp"
-#include <GL/gl.h>
 
 using namespace std;
 using namespace cv;
@@ -56,170 +65,162 @@ int loadTexture()
 }
 
 /**
- * Create a solid cube with texture
- * basically glutSolidCube but with texture coords
- * modified from https://stackoverflow.com/questions/327043/how-to-apply-texture-to-glutsolidcube
+ * Board pose handed from the capture loop to the draw callback
  */
-void solidCube(GLdouble size)
+struct PoseState
 {
-    GLfloat n[6][3] =
-    {
-        {-1.0, 0.0, 0.0},
-        {0.0, 1.0, 0.0},
-        {1.0, 0.0, 0.0},
-        {0.0, -1.0, 0.0},
-        {0.0, 0.0, 1.0},
-        {0.0, 0.0, -1.0}
-    };
-    GLint faces[6][4] =
-    {
-        {0, 1, 2, 3},
-        {3, 2, 6, 7},
-        {7, 6, 5, 4},
-        {4, 5, 1, 0},
-        {5, 6, 2, 1},
-        {7, 4, 0, 3}
-    };
-    GLfloat v[8][3];
-    GLint i;
-
-    v[0][0] = v[1][0] = v[2][0] = v[3][0] = -size / 2;
-    v[4][0] = v[5][0] = v[6][0] = v[7][0] = size / 2;
-    v[0][1] = v[1][1] = v[4][1] = v[5][1] = -size / 2;
-    v[2][1] = v[3][1] = v[6][1] = v[7][1] = size / 2;
-    v[0][2] = v[3][2] = v[4][2] = v[7][2] = -size / 2;
-    v[1][2] = v[2][2] = v[5][2] = v[6][2] = size / 2;
-
-    //added
-    GLfloat tc[4][2] =
-    {
-        { 0.0, 0.0 },
-        { 1.0, 0.0 },
-        { 1.0, 1.0 },
-        { 0.0, 1.0 }
-    };
-
-
-    for (i = 5; i >= 0; i--) {
-        glBegin(GL_QUADS);
-        glNormal3fv(&n[i][0]);
-
-        glTexCoord2fv(&tc[0][0]);
-        glVertex3fv(&v[faces[i][0]][0]);
-        glTexCoord2fv(&tc[1][0]);
-        glVertex3fv(&v[faces[i][1]][0]);
-        glTexCoord2fv(&tc[2][0]);
-        glVertex3fv(&v[faces[i][2]][0]);
-        glTexCoord2fv(&tc[3][0]);
-        glVertex3fv(&v[faces[i][3]][0]);
-        glEnd();
-    }
-}
+    bool found;
+    double rvec[3];
+    double tvec[3];
+};
 
 /**
- * Callback function to draw with OpenGL on each frame
+ * A camera frame and the board pose found in it
  */
-void drawOpenGL(void *params)
+struct CapturedFrame
 {
-    glLoadIdentity();
-    glBindTexture(GL_TEXTURE_2D, texture);
-
-    //TODO: get rvec & tvec, use w/ glRotatef, glTranslatef
-
-    solidCube(1.0);
-}
+    Mat frame;
+    PoseState pose;
+};
 
 /**
- * Reads in the given calibration file (in the format written out by calibration.cpp)
- * and writes the camera parameters into the given Mats
+ * Everything the draw callback needs from the capture loop
  */
-void readCalibrationFile(char* calibrationFilename, Mat &cameraMatrix, Mat &distCoeffs)
+struct GLScene
 {
-    ifstream paramFile (calibrationFilename);
+    Mat cameraMatrix;
+    //frames and their poses, handed over lock-free in case the GUI backend
+    //draws on its own thread; the capture loop reads straight into its slot
+    TripleBuffer<CapturedFrame> handoff;
+    vector<Matx44f> cubes; //cube placements in board coordinates
 
-    if (paramFile.is_open())
-    {
-        string line;
-        char *lineArr = new char[line.length()+1]; //line as char array for strtok
-        for (int i = 0; i < 3; i++) //loop for 3 rows of camera matrix
-        {
-            getline(paramFile, line);
-            strcpy(lineArr, line.c_str());
+    PoseState shownPose; //pose that matches the background currently on screen
+    bool hasShownPose;
+};
 
-            //for 3 columns in each row
-            cameraMatrix.at<double>(i, 0) = atof( strtok(lineArr, " ") );
-            cameraMatrix.at<double>(i, 1) = atof( strtok(NULL, " ") ); //NULL b/c continuing on same line
-            cameraMatrix.at<double>(i, 2) = atof( strtok(NULL, " ") );
-        }
+RetainedRenderer *renderer = NULL; //created on the first draw, once the GL context exists
+StreamedTexture *background = NULL;
+int cubeMesh;
+int backgroundMesh;
+double lastDrawMs = 0; //time spent submitting the last OpenGL frame
+
+volatile sig_atomic_t stopRequested = 0; //set by Ctrl-C so headless runs close their output
 
-        //read in distortion coeffs
-        getline(paramFile, line);
+void requestStop(int)
+{
+    stopRequested = 1;
+}
 
-        strcpy(lineArr, line.c_str());
-        char *word = strtok(lineArr, " "); //line as char array for strtok
-        int i = 0;
-        while (word != NULL) //loop while there are more words to read in on the line
+/**
+ * Places a unit cube sitting on each outer corner of the given board
+ */
+vector<Matx44f> boardCornerCubes(const BoardOps *board)
+{
+    float xs[2] = {0, (float)(board->width - 1)};
+    float ys[2] = {0, -(float)(board->height - 1)};
+    vector<Matx44f> cubes;
+    for (int i = 0; i < 2; i++)
+    {
+        for (int j = 0; j < 2; j++)
         {
-            distCoeffs.at<double>(i, 0) = atof( word );
-            word = strtok(NULL, " ");
-            i++;
+            Matx44f model = Matx44f::eye();
+            model(0, 3) = xs[j];
+            model(1, 3) = ys[i];
+            model(2, 3) = 0.5; //+z points out of the board towards the camera
+            cubes.push_back(model);
         }
-        
-        paramFile.close();
     }
-    else
+    return cubes;
+}
+
+/**
+ * Callback function to draw with OpenGL on each frame
+ */
+void drawOpenGL(void *params)
+{
+    GLScene *scene = (GLScene *)params;
+    bool haveCurrent = scene->handoff.update();
+    const Mat &frame = scene->handoff.readSlot().frame;
+    if (frame.empty())
     {
-        cout << "unable to open calibration file\n";
-        exit(-1);
+        return;
     }
 
-    cout << "\ncamera matrix:\n";
-    for (int i = 0; i < cameraMatrix.rows; i++)
+    int64 start = getTickCount();
+    if (renderer == NULL)
     {
-        for (int j = 0; j < cameraMatrix.cols; j++)
-        {
-            cout << cameraMatrix.at<double>(i, j) << " ";
-        }
-        cout << "\n";
+        //geometry is uploaded once and reused on every redraw
+        renderer = new RetainedRenderer();
+        renderer->init();
+        cubeMesh = renderer->uploadMesh(makeCubeMesh(1.0));
+        backgroundMesh = renderer->uploadMesh(makeBackgroundQuad());
+        background = new StreamedTexture();
     }
+    renderer->beginFrame();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    cout << "\ndistortion coefficients:\n";
-    for (int i = 0; i < distCoeffs.rows; i++)
+    //camera frame as the background
+    background->update(frame);
+    glDisable(GL_DEPTH_TEST);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glBindTexture(GL_TEXTURE_2D, background->id());
+    renderer->draw(backgroundMesh);
+
+    //the background shows the frame uploaded last time, so draw with last time's pose too
+    if (scene->hasShownPose && scene->shownPose.found)
+    {
+        Mat rvec(3, 1, CV_64F, scene->shownPose.rvec);
+        Mat tvec(3, 1, CV_64F, scene->shownPose.tvec);
+
+        glMatrixMode(GL_PROJECTION);
+        glLoadTransposeMatrixf(projectionFromIntrinsics(scene->cameraMatrix, frame.size(),
+                                                        0.1, 1000).val);
+        glMatrixMode(GL_MODELVIEW);
+        glLoadTransposeMatrixf(modelviewFromPose(rvec, tvec).val);
+
+        glEnable(GL_DEPTH_TEST);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        renderer->drawInstanced(cubeMesh, scene->cubes);
+    }
+    if (haveCurrent)
     {
-        cout << distCoeffs.at<double>(i, 0) << " ";
+        scene->shownPose = scene->handoff.readSlot().pose;
+        scene->hasShownPose = true;
     }
-    cout << "\n";
+
+    lastDrawMs = (getTickCount() - start) * 1000.0 / getTickFrequency();
 }
 
 /**
- * Builds a set of 3D-space points for the corners of a chessboard of the given size,
- * with coordinates in units of chessboard squares
+ * Reads in the given calibration file (in the format written out by calibration.cpp)
+ * and writes the camera parameters into the given Mats; exits if it can't
  */
-vector<Point3f> buildPointSet(Size chessboardSize)
+void readCalibrationFile(char* calibrationFilename, Mat &cameraMatrix, Mat &distCoeffs)
 {
-    vector<Point3f> points;
-    
-    for (int i = 0; i < chessboardSize.height; i++)
+    if (!readCalibrationProfile(calibrationFilename, cameraMatrix, distCoeffs))
     {
-        for (int j = 0; j < chessboardSize.width; j++)
-        {
-            points.push_back(Point3f(j, -i, 0));
-        }
+        cout << "unable to read calibration file " << calibrationFilename << "\n";
+        exit(-1);
     }
-    
-    return points;
+    printCalibrationProfile(cameraMatrix, distCoeffs);
 }
 
 /**
- * Looks for chessboard corners on a live video feed and
- * projects onto the video feed with the given parameters if board found
+ * Looks for chessboard corners on a live video feed (or in the given video
+ * file) and projects onto the video with the given parameters if board found.
+ * With an output filename, renders headless into an offscreen framebuffer
+ * and encodes the result instead of opening a window.
  */
-int openVideoInput( Mat cameraMatrix, Mat distCoeffs )
+int openVideoInput( Mat cameraMatrix, Mat distCoeffs, const BoardOps *board,
+                    const FrameSourceOptions &source, const char *outputName )
 {    
-    VideoCapture *capdev;
+    FrameSource *capdev;
 
-	// open the video device
-	capdev = new cv::VideoCapture(0);
+	// open the video device (or file, or raw capture)
+	capdev = new FrameSource(source);
 	if( !capdev->isOpened() ) {
 		printf("Unable to open video device\n");
 		return(-1);
@@ -231,50 +232,90 @@ int openVideoInput( Mat cameraMatrix, Mat distCoeffs )
 	printf("Expected size: %d %d\n", refS.width, refS.height);
 
     const string winName = "Video";
-	namedWindow(winName, WINDOW_OPENGL); //open window w/ OpenGL support
-	Mat frame;
-
-    Size chessboardSize(9,6);
+    bool headless = (outputName != NULL);
+    OffscreenContext offscreen;
+    AsyncVideoWriter recorder;
+    if (headless)
+    {
+        if (!offscreen.create(refS) || !recorder.open(outputName, capdev->get(CAP_PROP_FPS), refS))
+        {
+            return(-1);
+        }
+        cout << "Rendering offscreen to " << outputName << "\n";
+        signal(SIGINT, requestStop);
+    }
+    else
+    {
+        namedWindow(winName, WINDOW_OPENGL); //open window w/ OpenGL support
+    }
+    Mat rendered; //headless read-back of the composited frame
 
     //set up OpenGl textures
     glEnable(GL_TEXTURE_2D);
-    glGenTextures(1, &texture);
+    glGenTextures(1, &textureID);
     loadTexture();
 
-    setOpenGlDrawCallback(winName, drawOpenGL);
+    GLScene scene;
+    scene.cameraMatrix = cameraMatrix;
+    scene.cubes = boardCornerCubes(board);
+    scene.hasShownPose = false;
+    if (!headless)
+    {
+        setOpenGlDrawCallback(winName, drawOpenGL, &scene);
+    }
 
+    FrameCache cache;
+    BoardPose pose;
     int printIntervalCount = 0;
 	for(;;) {
+        CapturedFrame &captured = scene.handoff.writeSlot(); //the draw callback never holds this one
+        Mat &frame = captured.frame;
 		*capdev >> frame; // get a new frame from the camera, treat as a stream
+        if (frame.empty()) //end of a video file
+        {
+            break;
+        }
+        cache.reset(frame);
 
-        vector<Point2f> corner_set;
-        vector<Point3f> point_set = buildPointSet(chessboardSize);
-        Mat rvec = Mat::zeros(1, 3, DataType<double>::type);
-        Mat tvec = Mat::zeros(1, 3, DataType<double>::type);
-
-        bool chessboardFound = findChessboardCorners(frame, chessboardSize, corner_set);
+        bool chessboardFound = board->estimatePose(cache.gray(), cameraMatrix, distCoeffs, pose, 0);
+        Mat &rvec = pose.rvec;
+        Mat &tvec = pose.tvec;
 
-        //project/draw into frame if chessboard found
-        if (chessboardFound)
+        //hand the frame and its pose to the draw callback
+        PoseState &state = captured.pose;
+        state.found = chessboardFound;
+        for (int i = 0; i < 3; i++)
         {
-            solvePnP(point_set, corner_set, cameraMatrix, distCoeffs, rvec, tvec);
-            
-            //drawAxes(frame, rvec, tvec, cameraMatrix, distCoeffs);
-            //drawRectPrism(frame, rvec, tvec, cameraMatrix, distCoeffs);
-            // drawFish(frame, red, 3, 0, rvec, tvec, cameraMatrix, distCoeffs);
-            // drawFish(frame, green, 1, -2, rvec, tvec, cameraMatrix, distCoeffs);
-            // drawFish(frame, blue, 6, -4, rvec, tvec, cameraMatrix, distCoeffs);
-
-            updateWindow(winName); //TODO: only update OpenGL when there's a board?
+            state.rvec[i] = rvec.at<double>(i);
+            state.tvec[i] = tvec.at<double>(i);
         }
+        scene.handoff.publish();
 
-        imshow(winName, frame);
+        //redraw every frame, since the video itself is now drawn by OpenGL
+        if (headless)
+        {
+            offscreen.beginFrame();
+            drawOpenGL(&scene);
+            if (offscreen.readFrame(rendered)) //read-back lags one frame, so it never stalls
+            {
+                recorder.write(rendered);
+            }
+        }
+        else
+        {
+            updateWindow(winName);
+        }
 
         //print out rotation and translation vectors every 5 frames
         printIntervalCount++;
         if (printIntervalCount%5 == 0)
         {
             cout << "frame " << printIntervalCount << "\n";
+            if (renderer != NULL)
+            {
+                cout << "draw: " << lastDrawMs << " ms, " << renderer->trianglesDrawn
+                     << " triangles in " << renderer->drawCalls << " calls\n";
+            }
             cout << "rvec: ";
             for (int i = 0; i < 3; i++)
             {
@@ -289,13 +330,34 @@ int openVideoInput( Mat cameraMatrix, Mat distCoeffs )
             cout << "\n\n";
         }
 
-        //check for user keyboard input
+        //check for user keyboard input (headless runs go as fast as they can)
+        if (stopRequested)
+        {
+            break;
+        }
+        if (headless)
+        {
+            continue;
+        }
         char key = waitKey(10);
 		if(key == 'q') {
 		    break;
 		}
 	}
 
+    if (headless)
+    {
+        if (offscreen.finish(rendered))
+        {
+            recorder.write(rendered);
+        }
+        recorder.close();
+    }
+    else
+    {
+        setOpenGlDrawCallback(winName, 0); //scene is about to go out of scope
+    }
+
 	// terminate the video capture
 	delete capdev;
     return (0);
@@ -306,13 +368,43 @@ int main(int argc, char *argv[])
     char paramFilename[256];
     char imgOrVidName[256];
 
+    //pull out optional flags, leaving the positional arguments in order
+    const BoardOps *board = findBoardOps(Size(9,6));
+    const char *outputName = NULL;
+    FrameSourceOptions sourceOptions;
+    vector<char *> args;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) //-b WxH: inner corners of the board
+        {
+            board = parseBoardOps(argv[++i]);
+            if (board == NULL)
+            {
+                exit(-1);
+            }
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) //-o file: headless, render to a file
+        {
+            outputName = argv[++i];
+        }
+        else if (parseFrameSourceFlag(argc, argv, i, sourceOptions))
+        {
+            //-c, -r, -F: where frames come from
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+    }
+
 	// If user didn't give parameter file name
-	if(argc < 2) 
+	if(args.size() < 1) 
 	{
-		cout << "Usage: ../bin/arSystem |parameter file name| [Optional image/video file name]\n";
+		cout << "Usage: ../bin/extension2 [-b WxH] [-o output] " << FRAME_SOURCE_USAGE
+             << " |parameter file name| [Optional video file name]\n";
 		exit(-1);
 	}
-    strcpy(paramFilename, argv[1]);
+    strcpy(paramFilename, args[0]);
 
     Mat cameraMatrix(3, 3, CV_64FC1);
     Mat distCoeffs = Mat::zeros(8, 1, CV_64F);
@@ -321,7 +413,11 @@ int main(int argc, char *argv[])
     readCalibrationFile(paramFilename, cameraMatrix, distCoeffs);
     cout << "Read in calibration file...\n";
 
-    openVideoInput(cameraMatrix, distCoeffs);
+    if (args.size() == 2) //positional video file, same as -c
+    {
+        sourceOptions.source = args[1];
+    }
+    openVideoInput(cameraMatrix, distCoeffs, board, sourceOptions, outputName);
 
     return 0;
 }
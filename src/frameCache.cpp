@@ -0,0 +1,104 @@
+/* frameCache.cpp
+ * Lazily computed grayscale, pyramid and gradient images for a single frame
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <utility>
+#include "frameCache.h"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/video/tracking.hpp"
+
+using namespace std;
+using namespace cv;
+
+FrameCache::FrameCache()
+    : hasGray(false), hasPyramid(false), hasGradients(false)
+{
+}
+
+FrameCache::FrameCache(const Mat &frame)
+    : hasGray(false), hasPyramid(false), hasGradients(false)
+{
+    reset(frame);
+}
+
+void FrameCache::reset(const Mat &newFrame)
+{
+    frame = newFrame;
+    hasGray = false;
+    hasPyramid = false;
+    hasGradients = false;
+}
+
+void FrameCache::swap(FrameCache &other)
+{
+    //Mat headers move with their data, so grayImg still aliases the right buffer
+    std::swap(frame, other.frame);
+    std::swap(grayImg, other.grayImg);
+    std::swap(grayBuf, other.grayBuf);
+    pyr.swap(other.pyr);
+    std::swap(dx, other.dx);
+    std::swap(dy, other.dy);
+    std::swap(hasGray, other.hasGray);
+    std::swap(hasPyramid, other.hasPyramid);
+    std::swap(hasGradients, other.hasGradients);
+}
+
+const Mat &FrameCache::gray()
+{
+    if (!hasGray)
+    {
+        if (frame.channels() == 1)
+        {
+            grayImg = frame; //already grayscale, share the data
+        }
+        else
+        {
+            //convert into our own buffer so a shared grayImg never aliases a capture buffer
+            cvtColor(frame, grayBuf, CV_BGR2GRAY);
+            grayImg = grayBuf;
+        }
+        hasGray = true;
+    }
+    return grayImg;
+}
+
+const vector<Mat> &FrameCache::pyramid()
+{
+    if (!hasPyramid)
+    {
+        //no derivatives; the pyramid is then usable directly by calcOpticalFlowPyrLK
+        buildOpticalFlowPyramid(gray(), pyr, Size(pyramidWinSize, pyramidWinSize),
+                                pyramidLevels, false);
+        hasPyramid = true;
+    }
+    return pyr;
+}
+
+const Mat &FrameCache::gradX()
+{
+    computeGradients();
+    return dx;
+}
+
+const Mat &FrameCache::gradY()
+{
+    computeGradients();
+    return dy;
+}
+
+/**
+ * Computes both Sobel derivatives at once, since every consumer needs both
+ */
+void FrameCache::computeGradients()
+{
+    if (!hasGradients)
+    {
+        Sobel(gray(), dx, CV_32F, 1, 0, 3);
+        Sobel(gray(), dy, CV_32F, 0, 1, 3);
+        hasGradients = true;
+    }
+}
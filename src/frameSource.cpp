@@ -0,0 +1,442 @@
+/* frameSource.cpp
+ * Raw capture recording/replay and the common frame source
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "frameSource.h"
+
+using namespace std;
+using namespace cv;
+
+static_assert(sizeof(RawCaptureHeader) == 4096, "raw capture header must be one page");
+static_assert(sizeof(RawFrameHeader) == 64, "raw frame header must be 64 bytes");
+
+/** Current steady clock time in microseconds */
+static uint64_t steadyTimestampUs()
+{
+    return chrono::duration_cast<chrono::microseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+RawCaptureWriter::RawCaptureWriter()
+    : header(NULL), mappedSize(0)
+{
+}
+
+RawCaptureWriter::~RawCaptureWriter()
+{
+    close();
+}
+
+bool RawCaptureWriter::open(const string &filename, Size frameSize, int type, int capacity)
+{
+    close();
+
+    uint64_t frameBytes = (uint64_t)frameSize.area() * CV_ELEM_SIZE(type);
+    uint64_t slotBytes = (sizeof(RawFrameHeader) + frameBytes + 4095) / 4096 * 4096;
+    mappedSize = sizeof(RawCaptureHeader) + slotBytes * capacity;
+
+    int fd = ::open(filename.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror(filename.c_str());
+        return false;
+    }
+    //reserve the disk blocks now, so recording never waits on the file growing
+    int err = posix_fallocate(fd, 0, mappedSize);
+    if (err != 0)
+    {
+        cout << "Unable to preallocate " << mappedSize << " bytes for " << filename << ": "
+             << strerror(err) << "\n";
+        ::close(fd);
+        return false;
+    }
+    void *mem = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd); //the mapping keeps the file open
+    if (mem == MAP_FAILED)
+    {
+        perror("mmap");
+        return false;
+    }
+
+    header = (RawCaptureHeader *)mem;
+    memset(header, 0, sizeof(RawCaptureHeader));
+    header->version = RAW_CAPTURE_VERSION;
+    header->width = frameSize.width;
+    header->height = frameSize.height;
+    header->type = type;
+    header->frameBytes = frameBytes;
+    header->slotBytes = slotBytes;
+    header->capacity = capacity;
+    header->written = 0;
+    memcpy(header->magic, RAW_CAPTURE_MAGIC, sizeof(header->magic)); //last: the file is now valid
+
+    cout << "Recording raw frames to " << filename << " (" << capacity << " frame ring, "
+         << mappedSize / (1024 * 1024) << " MB)\n";
+    return true;
+}
+
+bool RawCaptureWriter::write(const Mat &frame, uint64_t timestampUs)
+{
+    if (header == NULL || frame.cols != (int)header->width || frame.rows != (int)header->height ||
+        frame.type() != (int)header->type)
+    {
+        return false;
+    }
+
+    unsigned char *slotStart = (unsigned char *)header + sizeof(RawCaptureHeader) +
+                               (header->written % header->capacity) * header->slotBytes;
+    RawFrameHeader *frameHeader = (RawFrameHeader *)slotStart;
+    frameHeader->frameNumber = header->written;
+    frameHeader->timestampUs = timestampUs;
+
+    unsigned char *pixels = slotStart + sizeof(RawFrameHeader);
+    size_t rowBytes = frame.cols * frame.elemSize();
+    if (frame.isContinuous())
+    {
+        memcpy(pixels, frame.data, header->frameBytes);
+    }
+    else
+    {
+        for (int i = 0; i < frame.rows; i++)
+        {
+            memcpy(pixels + i * rowBytes, frame.ptr(i), rowBytes);
+        }
+    }
+    header->written++;
+    return true;
+}
+
+void RawCaptureWriter::close()
+{
+    if (header != NULL)
+    {
+        munmap(header, mappedSize); //dirty pages still reach the file after unmapping
+        header = NULL;
+    }
+}
+
+RawCaptureReader::RawCaptureReader()
+    : header(NULL), base(NULL), mappedSize(0), first(0), count(0), next(0),
+      realTime(false), lastTimestamp(0), firstTimestamp(0)
+{
+}
+
+RawCaptureReader::~RawCaptureReader()
+{
+    close();
+}
+
+bool RawCaptureReader::open(const string &filename, bool replayInRealTime)
+{
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        perror(filename.c_str());
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(RawCaptureHeader))
+    {
+        cout << filename << " is not a raw capture\n";
+        ::close(fd);
+        return false;
+    }
+    mappedSize = info.st_size;
+
+    //private and writable: frames handed out can be drawn on, copying only the touched pages
+    void *mem = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED)
+    {
+        perror("mmap");
+        return false;
+    }
+    base = (unsigned char *)mem;
+    header = (const RawCaptureHeader *)mem;
+
+    if (memcmp(header->magic, RAW_CAPTURE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != RAW_CAPTURE_VERSION ||
+        sizeof(RawCaptureHeader) + header->slotBytes * header->capacity > mappedSize)
+    {
+        cout << filename << " is not a raw capture (or is truncated)\n";
+        close();
+        return false;
+    }
+    madvise(mem, mappedSize, MADV_SEQUENTIAL); //read ahead of the replay
+
+    count = min(header->written, header->capacity);
+    first = header->written - count;
+    next = 0;
+    realTime = replayInRealTime;
+    cout << "Replaying " << count << " raw frames from " << filename
+         << (realTime ? " at recorded speed\n" : " as fast as possible\n");
+    return true;
+}
+
+const RawFrameHeader *RawCaptureReader::slot(uint64_t index) const
+{
+    return (const RawFrameHeader *)(base + sizeof(RawCaptureHeader) +
+                                    (index % header->capacity) * header->slotBytes);
+}
+
+bool RawCaptureReader::read(Mat &frame)
+{
+    if (header == NULL || next >= count)
+    {
+        frame.release();
+        return false;
+    }
+
+    const RawFrameHeader *frameHeader = slot(first + next);
+    lastTimestamp = frameHeader->timestampUs;
+    if (realTime)
+    {
+        if (next == 0)
+        {
+            replayStart = chrono::steady_clock::now();
+            firstTimestamp = lastTimestamp;
+        }
+        this_thread::sleep_until(replayStart + chrono::microseconds(lastTimestamp - firstTimestamp));
+    }
+    next++;
+
+    frame = Mat(header->height, header->width, header->type,
+                (unsigned char *)frameHeader + sizeof(RawFrameHeader));
+    return true;
+}
+
+void RawCaptureReader::close()
+{
+    if (header != NULL)
+    {
+        munmap(base, mappedSize);
+        header = NULL;
+        base = NULL;
+    }
+}
+
+Size RawCaptureReader::size() const
+{
+    return header == NULL ? Size() : Size(header->width, header->height);
+}
+
+double RawCaptureReader::fps() const
+{
+    if (count < 2)
+    {
+        return 0;
+    }
+    double seconds = (slot(first + count - 1)->timestampUs - slot(first)->timestampUs) / 1e6;
+    return seconds > 0 ? (count - 1) / seconds : 0;
+}
+
+const char *FRAME_SOURCE_USAGE = "[-c camera|/dev/videoN[@WxH]|frames.nv12@WxH|video|capture.raw] [-r capture.raw[=frames]] [-F]";
+
+bool parseFrameSourceFlag(int argc, char *argv[], int &i, FrameSourceOptions &options)
+{
+    if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) //-c source: where frames come from
+    {
+        options.source = argv[++i];
+    }
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) //-r file[=frames]: record raw frames
+    {
+        string spec = argv[++i];
+        size_t split = spec.find('=');
+        options.recordFile = spec.substr(0, split);
+        if (split != string::npos)
+        {
+            options.recordCapacity = max(1, atoi(spec.c_str() + split + 1));
+        }
+    }
+    else if (strcmp(argv[i], "-F") == 0) //-F: replay raw captures without waiting
+    {
+        options.fastReplay = true;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+FrameSource::FrameSource()
+    : backend(BACKEND_VIDEOCAPTURE), recordCapacity(0), lastTimestamp(0)
+{
+}
+
+FrameSource::FrameSource(const FrameSourceOptions &options)
+    : backend(BACKEND_VIDEOCAPTURE), recordCapacity(0), lastTimestamp(0)
+{
+    open(options);
+}
+
+bool FrameSource::open(const FrameSourceOptions &options)
+{
+    const string &source = options.source;
+    recordFile = options.recordFile;
+    recordCapacity = options.recordCapacity;
+    recorder.close();
+
+    if (source.size() > 4 && source.compare(source.size() - 4, 4, ".raw") == 0)
+    {
+        backend = BACKEND_RAW;
+        return replay.open(source, !options.fastReplay);
+    }
+
+    //V4L2 device or stand-in, with an optional @WxH frame size
+    size_t at = source.rfind('@');
+    string path = source.substr(0, at);
+    if (LumaCapture::handles(path))
+    {
+        backend = BACKEND_LUMA;
+        Size size;
+        if (at != string::npos && sscanf(source.c_str() + at + 1, "%dx%d", &size.width, &size.height) != 2)
+        {
+            printf("invalid frame size in %s (expected @WxH)\n", source.c_str());
+            return false;
+        }
+        return lumaCapture.open(path, size, !options.fastReplay);
+    }
+
+    backend = BACKEND_VIDEOCAPTURE;
+
+    bool isCamera = !source.empty() && source.find_first_not_of("0123456789") == string::npos;
+    if (isCamera)
+    {
+        return capture.open(atoi(source.c_str()));
+    }
+    return capture.open(source);
+}
+
+bool FrameSource::open(const string &source)
+{
+    FrameSourceOptions options;
+    options.source = source;
+    return open(options);
+}
+
+bool FrameSource::isOpened() const
+{
+    switch (backend)
+    {
+        case BACKEND_RAW: return replay.isOpened();
+        case BACKEND_LUMA: return lumaCapture.isOpened();
+        default: return capture.isOpened();
+    }
+}
+
+/**
+ * Adds a frame to the raw recording, if there is one; the recording is
+ * created at the first frame, once its size and type are known
+ */
+void FrameSource::record(const Mat &frame)
+{
+    if (recordFile.empty())
+    {
+        return;
+    }
+    if (!recorder.isOpened() &&
+        !recorder.open(recordFile, frame.size(), frame.type(), recordCapacity))
+    {
+        recordFile.clear(); //already reported; keep running without recording
+        return;
+    }
+    recorder.write(frame, lastTimestamp);
+}
+
+bool FrameSource::read(Mat &frame)
+{
+    if (backend != BACKEND_VIDEOCAPTURE)
+    {
+        return grab() && retrieve(frame);
+    }
+    if (!capture.read(frame) || frame.empty())
+    {
+        return false;
+    }
+    lastTimestamp = steadyTimestampUs();
+    record(frame);
+    return true;
+}
+
+bool FrameSource::grab()
+{
+    bool ok;
+    switch (backend)
+    {
+        case BACKEND_RAW:
+            ok = replay.read(grabbed);
+            lastTimestamp = replay.timestampUs();
+            break;
+        case BACKEND_LUMA:
+            ok = lumaCapture.grab();
+            lastTimestamp = lumaCapture.timestampUs();
+            break;
+        default:
+            ok = capture.grab(); //decoded (and recorded) by retrieve
+            lastTimestamp = steadyTimestampUs();
+            return ok;
+    }
+    if (!ok)
+    {
+        grabbed.release();
+        return false;
+    }
+
+    //V4L2 input records just the luma plane detection runs on
+    record(backend == BACKEND_LUMA ? lumaCapture.luma() : grabbed);
+    return true;
+}
+
+bool FrameSource::retrieve(Mat &frame)
+{
+    if (backend == BACKEND_LUMA)
+    {
+        lumaCapture.retrieveColor(frame);
+    }
+    else if (backend == BACKEND_VIDEOCAPTURE)
+    {
+        if (!capture.retrieve(frame) || frame.empty())
+        {
+            return false;
+        }
+        record(frame);
+    }
+    else
+    {
+        frame = grabbed;
+    }
+    return !frame.empty();
+}
+
+double FrameSource::get(int propId)
+{
+    if (backend == BACKEND_VIDEOCAPTURE)
+    {
+        return capture.get(propId);
+    }
+    bool luma = backend == BACKEND_LUMA;
+    switch (propId)
+    {
+        case CAP_PROP_FRAME_WIDTH: return luma ? lumaCapture.size().width : replay.size().width;
+        case CAP_PROP_FRAME_HEIGHT: return luma ? lumaCapture.size().height : replay.size().height;
+        case CAP_PROP_FPS: return luma ? lumaCapture.fps() : replay.fps();
+        case CAP_PROP_FRAME_COUNT: return luma ? lumaCapture.frameCount() : replay.frameCount();
+        default: return 0;
+    }
+}
@@ -0,0 +1,155 @@
+/* glView.cpp
+ * Camera-matched OpenGL matrices and the streamed background texture
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <cstring>
+#include "glView.h"
+#include "opencv2/calib3d/calib3d.hpp"
+
+using namespace std;
+using namespace cv;
+
+Matx44f projectionFromIntrinsics(const Mat &cameraMatrix, Size imageSize,
+                                 float nearPlane, float farPlane)
+{
+    float fx = cameraMatrix.at<double>(0, 0);
+    float fy = cameraMatrix.at<double>(1, 1);
+    float cx = cameraMatrix.at<double>(0, 2);
+    float cy = cameraMatrix.at<double>(1, 2);
+    float w = imageSize.width;
+    float h = imageSize.height;
+
+    //maps a camera-space point to the same pixel projectPoints would, in NDC
+    return Matx44f(2*fx/w, 0,      1 - 2*cx/w, 0,
+                   0,      2*fy/h, 2*cy/h - 1, 0,
+                   0,      0,      -(farPlane + nearPlane) / (farPlane - nearPlane),
+                                   -2*farPlane*nearPlane / (farPlane - nearPlane),
+                   0,      0,      -1,         0);
+}
+
+Matx44f modelviewFromPose(const Mat &rvec, const Mat &tvec)
+{
+    Mat rotation;
+    Rodrigues(rvec, rotation);
+
+    //flip the y and z rows to go from OpenCV to OpenGL camera axes
+    const float flip[3] = {1, -1, -1};
+    Matx44f view = Matx44f::eye();
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            view(i, j) = flip[i] * rotation.at<double>(i, j);
+        }
+        view(i, 3) = flip[i] * tvec.at<double>(i);
+    }
+    return view;
+}
+
+MeshData makeBackgroundQuad()
+{
+    MeshData quad;
+    const float corners[4][4] = { //x, y, u, v
+        {-1, -1, 0, 1}, {1, -1, 1, 1}, {1, 1, 1, 0}, {-1, 1, 0, 0}
+    };
+    for (int i = 0; i < 4; i++)
+    {
+        MeshVertex v = {{corners[i][0], corners[i][1], 0}, {0, 0, 1}, {corners[i][2], corners[i][3]}};
+        quad.vertices.push_back(v);
+    }
+    GLuint indices[6] = {0, 1, 2, 0, 2, 3};
+    quad.indices.assign(indices, indices + 6);
+    return quad;
+}
+
+StreamedTexture::StreamedTexture()
+    : texture(0), bufferBytes(0), next(0)
+{
+    pixelBuffers[0] = pixelBuffers[1] = 0;
+}
+
+StreamedTexture::~StreamedTexture()
+{
+    if (texture != 0)
+    {
+        glDeleteTextures(1, &texture);
+        glDeleteBuffers(2, pixelBuffers);
+    }
+}
+
+/**
+ * (Re)creates the texture storage and pixel buffers for the given frame size
+ */
+void StreamedTexture::allocate(Size frameSize)
+{
+    if (texture == 0)
+    {
+        glGenTextures(1, &texture);
+        glGenBuffers(2, pixelBuffers);
+    }
+    size = frameSize;
+    bufferBytes = (size_t)size.width * size.height * 3;
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size.width, size.height, 0, GL_BGR, GL_UNSIGNED_BYTE, NULL);
+
+    for (int i = 0; i < 2; i++)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffers[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bufferBytes, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    next = 0;
+}
+
+/**
+ * Copies the frame into the given pixel buffer, orphaning its old contents
+ * first so the copy doesn't wait on a transfer still reading them
+ */
+void StreamedTexture::fill(int buffer, const Mat &frame)
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffers[buffer]);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, bufferBytes, NULL, GL_STREAM_DRAW);
+    uchar *dst = (uchar *)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+    if (dst != NULL)
+    {
+        size_t rowBytes = (size_t)size.width * 3;
+        for (int i = 0; i < size.height; i++) //row by row in case the Mat has padding
+        {
+            memcpy(dst + i * rowBytes, frame.ptr(i), rowBytes);
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void StreamedTexture::update(const Mat &frame)
+{
+    int filled = 1 - next;
+    if (frame.size() != size || texture == 0)
+    {
+        allocate(frame.size());
+        filled = 1 - next;
+
+        //nothing was queued at this size, so the first upload takes this frame directly
+        fill(filled, frame);
+    }
+
+    //texture <- the buffer filled last time; the driver can DMA it in the background
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffers[filled]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.width, size.height, GL_BGR, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    //new frame -> the other buffer, for next time
+    fill(next, frame);
+
+    next = filled;
+}
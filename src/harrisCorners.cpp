@@ -25,6 +25,9 @@
 #include "opencv2/opencv.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/calib3d/calib3d.hpp"
+#include "frameCache.h"
+#include "frameSource.h"
+#include "saddleDetector.h" //harrisResponse
 
 using namespace std;
 using namespace cv;
@@ -33,20 +36,17 @@ using namespace cv;
  * Attempts to detect Harris corners in the given image and
  * draws markers into the image if they're found
  */
-void tryDrawHarrisCorners(Mat &imgFrame)
+void tryDrawHarrisCorners(FrameCache &cache, Mat &imgFrame)
 {
-    Mat gray;
-    cvtColor(imgFrame, gray, CV_BGR2GRAY);
-
     //for Harris corner output (filtered image)
-    Mat dst = Mat::zeros( imgFrame.size(), CV_32FC1 );
+    Mat dst;
 
     int blockSize = 2; // neighborhood size
-    int apertureSize = 3; // aka ksize
+    int apertureSize = 3; // aka ksize, must match the cache's Sobel aperture
     double k = .04; // "Harris detector free parameter"
     double thresh = .001; //threshold pixel value for what we consider a corner
 
-    cornerHarris( gray, dst, blockSize, apertureSize, k );
+    harrisResponse( cache, dst, blockSize, apertureSize, k );
 
     Scalar circleColor = Scalar(0,0,255); // red
     for( int i = 0; i < imgFrame.rows ; i++ )
@@ -66,12 +66,12 @@ void tryDrawHarrisCorners(Mat &imgFrame)
  * Looks for Harris corners on a live video feed and
  * draws in markers if corners found
  */
-int openVideoInput()
+int openVideoInput( const FrameSourceOptions &source )
 {
-    VideoCapture *capdev;
+    FrameSource *capdev;
 
 	// open the video device
-	capdev = new cv::VideoCapture(0);
+	capdev = new FrameSource(source);
 	if( !capdev->isOpened() ) {
 		printf("Unable to open video device\n");
 		return(-1);
@@ -84,11 +84,17 @@ int openVideoInput()
 
 	namedWindow("Video", 1);
 	Mat frame;
+    FrameCache cache;
 
 	for(;;) {
-		*capdev >> frame; // get a new frame from the camera, treat as a stream
+        if (!capdev->grab() || !capdev->retrieve(frame)) //camera failed or replay finished
+        {
+            break;
+        }
+        //Harris runs on a V4L2 camera's own luma plane rather than converting back from color
+        cache.reset(capdev->luma().empty() ? frame : capdev->luma());
         
-        tryDrawHarrisCorners(frame);
+        tryDrawHarrisCorners(cache, frame);
 
         imshow("Video", frame);
 
@@ -107,7 +113,17 @@ int openVideoInput()
 
 int main(int argc, char *argv[])
 {
-    openVideoInput();
+    FrameSourceOptions sourceOptions;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!parseFrameSourceFlag(argc, argv, i, sourceOptions))
+        {
+            cout << "Usage: ../bin/harrisCorners " << FRAME_SOURCE_USAGE << "\n";
+            exit(-1);
+        }
+    }
+
+    openVideoInput(sourceOptions);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,59 @@
+/* imageList.cpp
+ * Image file lists from directories and glob patterns
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <glob.h>
+#include <sys/stat.h>
+#include "imageList.h"
+
+using namespace std;
+
+bool hasImageExtension(const string &name)
+{
+    size_t dot = name.find_last_of('.');
+    if (dot == string::npos)
+    {
+        return false;
+    }
+    string ext = name.substr(dot + 1);
+    transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "ppm" ||
+           ext == "tif" || ext == "tiff" || ext == "bmp";
+}
+
+bool isImageBatch(const string &name)
+{
+    struct stat info;
+    if (stat(name.c_str(), &info) == 0)
+    {
+        return S_ISDIR(info.st_mode);
+    }
+    return strpbrk(name.c_str(), "*?[") != NULL;
+}
+
+void listImages(const string &name, vector<string> &files)
+{
+    struct stat info;
+    bool isDir = stat(name.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+    string pattern = isDir ? name + "/*" : name;
+    size_t first = files.size();
+    glob_t matches;
+    if (glob(pattern.c_str(), 0, NULL, &matches) == 0)
+    {
+        for (size_t i = 0; i < matches.gl_pathc; i++)
+        {
+            if (hasImageExtension(matches.gl_pathv[i]))
+            {
+                files.push_back(matches.gl_pathv[i]);
+            }
+        }
+    }
+    globfree(&matches);
+    sort(files.begin() + first, files.end());
+}
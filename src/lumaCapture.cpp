@@ -0,0 +1,431 @@
+/* lumaCapture.cpp
+ * V4L2 memory-mapped capture (and its file stand-in) handing out luma planes
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/videodev2.h>
+#include "opencv2/imgproc/imgproc.hpp"
+#include "lumaCapture.h"
+
+using namespace std;
+using namespace cv;
+
+static const int NUM_BUFFERS = 4; //one being processed, the rest for the driver to fill
+static const double STAND_IN_FPS = 30;
+
+//formats we can read, best first: planar luma is zero-copy, YUYV needs a gather
+static const uint32_t FORMATS[] = {V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_GREY,
+                                   V4L2_PIX_FMT_YUYV};
+static const char *FORMAT_EXTENSIONS[] = {".nv12", ".i420", ".grey", ".yuyv"};
+static const int NUM_FORMATS = 4;
+
+/** ioctl, retried if a signal interrupts it */
+static int xioctl(int fd, unsigned long request, void *arg)
+{
+    int result;
+    do
+    {
+        result = ioctl(fd, request, arg);
+    } while (result < 0 && errno == EINTR);
+    return result;
+}
+
+/** Current steady clock time in microseconds */
+static uint64_t steadyTimestampUs()
+{
+    return chrono::duration_cast<chrono::microseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** Bytes in one frame of the format, with rows stride bytes apart */
+static size_t bytesPerFrame(uint32_t format, int stride, int height)
+{
+    switch (format)
+    {
+        case V4L2_PIX_FMT_NV12:
+        case V4L2_PIX_FMT_YUV420: return (size_t)stride * height * 3 / 2;
+        case V4L2_PIX_FMT_YUYV: return (size_t)stride * height;
+        default: return (size_t)stride * height;
+    }
+}
+
+LumaCapture::LumaCapture()
+    : pixelFormat(0), width(0), height(0), stride(0), frameRate(0), device(-1), dequeued(-1),
+      file(NULL), fileBytes(0), frameBytes(0), fileFrames(0), nextFrame(0), realTime(false),
+      frameData(NULL), lastTimestamp(0)
+{
+}
+
+LumaCapture::~LumaCapture()
+{
+    close();
+}
+
+bool LumaCapture::handles(const string &source)
+{
+    if (source.compare(0, 10, "/dev/video") == 0)
+    {
+        return true;
+    }
+    for (int i = 0; i < NUM_FORMATS; i++)
+    {
+        size_t length = strlen(FORMAT_EXTENSIONS[i]);
+        if (source.size() > length && source.compare(source.size() - length, length, FORMAT_EXTENSIONS[i]) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LumaCapture::open(const string &path, Size size, bool replayInRealTime)
+{
+    close();
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+    {
+        perror(path.c_str());
+        return false;
+    }
+    realTime = replayInRealTime;
+    bool opened = S_ISCHR(info.st_mode) ? openDevice(path, size) : openStandIn(path, size);
+    if (opened)
+    {
+        char fourcc[5] = {(char)pixelFormat, (char)(pixelFormat >> 8), (char)(pixelFormat >> 16),
+                          (char)(pixelFormat >> 24), '\0'};
+        cout << "Capturing " << width << "x" << height << " " << fourcc << " from " << path
+             << (pixelFormat == V4L2_PIX_FMT_YUYV ? " (luma gathered from YUYV)\n" : " (zero-copy luma)\n");
+    }
+    return opened;
+}
+
+bool LumaCapture::openDevice(const string &path, Size size)
+{
+    device = ::open(path.c_str(), O_RDWR);
+    if (device < 0)
+    {
+        perror(path.c_str());
+        return false;
+    }
+
+    v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (xioctl(device, VIDIOC_QUERYCAP, &cap) < 0 ||
+        !(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) || !(cap.capabilities & V4L2_CAP_STREAMING))
+    {
+        printf("%s is not a streaming capture device\n", path.c_str());
+        close();
+        return false;
+    }
+
+    //pick the best format the device offers
+    int best = NUM_FORMATS;
+    v4l2_fmtdesc desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    for (; xioctl(device, VIDIOC_ENUM_FMT, &desc) == 0; desc.index++)
+    {
+        for (int i = 0; i < best; i++)
+        {
+            if (desc.pixelformat == FORMATS[i])
+            {
+                best = i;
+            }
+        }
+    }
+    if (best == NUM_FORMATS)
+    {
+        printf("%s offers no GREY, NV12, YUV420 or YUYV format\n", path.c_str());
+        close();
+        return false;
+    }
+
+    v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    xioctl(device, VIDIOC_G_FMT, &fmt);
+    fmt.fmt.pix.pixelformat = FORMATS[best];
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    if (size.area() > 0)
+    {
+        fmt.fmt.pix.width = size.width;
+        fmt.fmt.pix.height = size.height;
+    }
+    if (xioctl(device, VIDIOC_S_FMT, &fmt) < 0 || fmt.fmt.pix.pixelformat != FORMATS[best])
+    {
+        perror("VIDIOC_S_FMT");
+        close();
+        return false;
+    }
+    pixelFormat = fmt.fmt.pix.pixelformat;
+    width = fmt.fmt.pix.width;
+    height = fmt.fmt.pix.height;
+    stride = fmt.fmt.pix.bytesperline;
+    //I420 chroma rows are half the luma stride, so a padded stride can't be described by one Mat
+    if (pixelFormat == V4L2_PIX_FMT_YUV420 && stride != width)
+    {
+        printf("%s pads YUV420 rows (%d bytes for %d pixels), which isn't supported\n",
+               path.c_str(), stride, width);
+        close();
+        return false;
+    }
+
+    v4l2_streamparm parm;
+    memset(&parm, 0, sizeof(parm));
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(device, VIDIOC_G_PARM, &parm) == 0 && parm.parm.capture.timeperframe.numerator > 0)
+    {
+        frameRate = (double)parm.parm.capture.timeperframe.denominator /
+                    parm.parm.capture.timeperframe.numerator;
+    }
+
+    //map the driver's buffers and queue them all
+    v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = NUM_BUFFERS;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(device, VIDIOC_REQBUFS, &req) < 0 || req.count < 2)
+    {
+        perror("VIDIOC_REQBUFS");
+        close();
+        return false;
+    }
+    for (unsigned int i = 0; i < req.count; i++)
+    {
+        v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (xioctl(device, VIDIOC_QUERYBUF, &buf) < 0)
+        {
+            perror("VIDIOC_QUERYBUF");
+            close();
+            return false;
+        }
+        void *mem = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, device, buf.m.offset);
+        if (mem == MAP_FAILED)
+        {
+            perror("mmap");
+            close();
+            return false;
+        }
+        Buffer mapped = {(unsigned char *)mem, buf.length};
+        buffers.push_back(mapped);
+        if (xioctl(device, VIDIOC_QBUF, &buf) < 0)
+        {
+            perror("VIDIOC_QBUF");
+            close();
+            return false;
+        }
+    }
+
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(device, VIDIOC_STREAMON, &type) < 0)
+    {
+        perror("VIDIOC_STREAMON");
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool LumaCapture::openStandIn(const string &path, Size size)
+{
+    if (size.area() <= 0)
+    {
+        printf("%s: a stand-in device needs its frame size (file@WxH)\n", path.c_str());
+        return false;
+    }
+    for (int i = 0; i < NUM_FORMATS; i++)
+    {
+        size_t length = strlen(FORMAT_EXTENSIONS[i]);
+        if (path.size() > length && path.compare(path.size() - length, length, FORMAT_EXTENSIONS[i]) == 0)
+        {
+            pixelFormat = FORMATS[i];
+        }
+    }
+    if (pixelFormat == 0)
+    {
+        printf("%s: a stand-in device must be .grey, .nv12, .i420 or .yuyv\n", path.c_str());
+        return false;
+    }
+    width = size.width;
+    height = size.height;
+    stride = pixelFormat == V4L2_PIX_FMT_YUYV ? 2 * width : width;
+    frameRate = STAND_IN_FPS;
+    frameBytes = bytesPerFrame(pixelFormat, stride, height);
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        perror(path.c_str());
+        return false;
+    }
+    struct stat info;
+    fstat(fd, &info);
+    fileBytes = info.st_size;
+    fileFrames = fileBytes / frameBytes;
+    if (fileFrames == 0)
+    {
+        printf("%s is smaller than one %dx%d frame\n", path.c_str(), width, height);
+        ::close(fd);
+        return false;
+    }
+    //private and writable like a driver buffer; writes never reach the file
+    void *mem = mmap(NULL, fileBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd); //the mapping keeps the file open
+    if (mem == MAP_FAILED)
+    {
+        perror("mmap");
+        return false;
+    }
+    madvise(mem, fileBytes, MADV_SEQUENTIAL);
+    file = (unsigned char *)mem;
+    nextFrame = 0;
+    return true;
+}
+
+bool LumaCapture::grab()
+{
+    if (file != NULL)
+    {
+        if (nextFrame >= fileFrames)
+        {
+            lumaImg.release();
+            return false;
+        }
+        if (realTime)
+        {
+            if (nextFrame == 0)
+            {
+                replayStart = chrono::steady_clock::now();
+            }
+            this_thread::sleep_until(replayStart + chrono::microseconds((int64_t)(nextFrame * 1e6 / frameRate)));
+        }
+        wrapFrame(file + nextFrame * frameBytes);
+        nextFrame++;
+        lastTimestamp = steadyTimestampUs();
+        return true;
+    }
+    if (device < 0)
+    {
+        return false;
+    }
+
+    //the previous frame is done with: let the driver fill its buffer again
+    v4l2_buffer buf;
+    if (dequeued >= 0)
+    {
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = dequeued;
+        xioctl(device, VIDIOC_QBUF, &buf);
+        dequeued = -1;
+    }
+
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(device, VIDIOC_DQBUF, &buf) < 0)
+    {
+        perror("VIDIOC_DQBUF");
+        lumaImg.release();
+        return false;
+    }
+    dequeued = buf.index;
+    wrapFrame(buffers[buf.index].start);
+
+    //the driver's monotonic timestamp is the steady clock, taken when the frame was captured
+    if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+    {
+        lastTimestamp = (uint64_t)buf.timestamp.tv_sec * 1000000 + buf.timestamp.tv_usec;
+    }
+    else
+    {
+        lastTimestamp = steadyTimestampUs();
+    }
+    return true;
+}
+
+/**
+ * Points the luma Mat at a frame's Y plane, or gathers it for YUYV
+ */
+void LumaCapture::wrapFrame(const unsigned char *data)
+{
+    frameData = data;
+    if (pixelFormat == V4L2_PIX_FMT_YUYV)
+    {
+        Mat packed(height, width, CV_8UC2, (void *)data, stride);
+        extractChannel(packed, lumaBuf, 0);
+        lumaImg = lumaBuf;
+    }
+    else
+    {
+        lumaImg = Mat(height, width, CV_8UC1, (void *)data, stride);
+    }
+}
+
+void LumaCapture::retrieveColor(Mat &bgr) const
+{
+    if (frameData == NULL)
+    {
+        bgr.release();
+        return;
+    }
+    switch (pixelFormat)
+    {
+        case V4L2_PIX_FMT_NV12:
+            cvtColor(Mat(height * 3 / 2, width, CV_8UC1, (void *)frameData, stride), bgr, COLOR_YUV2BGR_NV12);
+            break;
+        case V4L2_PIX_FMT_YUV420:
+            cvtColor(Mat(height * 3 / 2, width, CV_8UC1, (void *)frameData, stride), bgr, COLOR_YUV2BGR_I420);
+            break;
+        case V4L2_PIX_FMT_YUYV:
+            cvtColor(Mat(height, width, CV_8UC2, (void *)frameData, stride), bgr, COLOR_YUV2BGR_YUYV);
+            break;
+        default:
+            cvtColor(lumaImg, bgr, COLOR_GRAY2BGR);
+            break;
+    }
+}
+
+void LumaCapture::close()
+{
+    if (device >= 0)
+    {
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        xioctl(device, VIDIOC_STREAMOFF, &type);
+        for (size_t i = 0; i < buffers.size(); i++)
+        {
+            munmap(buffers[i].start, buffers[i].length);
+        }
+        buffers.clear();
+        ::close(device);
+        device = -1;
+    }
+    if (file != NULL)
+    {
+        munmap(file, fileBytes);
+        file = NULL;
+    }
+    dequeued = -1;
+    frameData = NULL;
+    pixelFormat = 0;
+    lumaImg.release();
+}
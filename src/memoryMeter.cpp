@@ -0,0 +1,110 @@
+/* memoryMeter.cpp
+ * Resident set size and per-frame Mat allocation counts
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "memoryMeter.h"
+
+using namespace std;
+using namespace cv;
+
+#if CV_VERSION_MAJOR >= 4
+typedef AccessFlag AccessFlags;
+#else
+typedef int AccessFlags;
+#endif
+
+static atomic<uint64_t> allocatedBytes(0);
+static atomic<uint64_t> allocationCount(0);
+
+/**
+ * Counts the Mat buffers allocated, leaving the allocation itself (and so
+ * the freeing, which goes back to whoever allocated) to the standard allocator
+ */
+class CountingAllocator : public MatAllocator
+{
+public:
+    UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                       AccessFlags flags, UMatUsageFlags usageFlags) const
+    {
+        UMatData *u = Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+        if (u != NULL && data == NULL) //user-supplied data isn't an allocation
+        {
+            allocatedBytes += u->size;
+            allocationCount++;
+        }
+        return u;
+    }
+
+    bool allocate(UMatData *data, AccessFlags accessFlags, UMatUsageFlags usageFlags) const
+    {
+        return Mat::getStdAllocator()->allocate(data, accessFlags, usageFlags);
+    }
+
+    void deallocate(UMatData *data) const
+    {
+        Mat::getStdAllocator()->deallocate(data);
+    }
+};
+
+MemoryMeter::MemoryMeter()
+    : startBytes(0), startAllocations(0), lastBytes(0), lastAllocations(0),
+      totalBytes(0), maxBytes(0), frames(0), quietFrames(0)
+{
+    //never destroyed, since Mats may outlive the meter
+    static CountingAllocator counter;
+    Mat::setDefaultAllocator(&counter);
+}
+
+void MemoryMeter::startFrame()
+{
+    startBytes = allocatedBytes;
+    startAllocations = allocationCount;
+}
+
+void MemoryMeter::endFrame()
+{
+    lastBytes = allocatedBytes - startBytes;
+    lastAllocations = allocationCount - startAllocations;
+    totalBytes += lastBytes;
+    maxBytes = max(maxBytes, lastBytes);
+    frames++;
+    quietFrames += lastAllocations == 0;
+}
+
+long MemoryMeter::peakRssKb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; //kilobytes on Linux
+}
+
+long MemoryMeter::currentRssKb()
+{
+    long pages = 0, residentPages = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL)
+    {
+        return 0;
+    }
+    if (fscanf(fp, "%ld %ld", &pages, &residentPages) != 2)
+    {
+        residentPages = 0;
+    }
+    fclose(fp);
+    return residentPages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+void MemoryMeter::printSummary() const
+{
+    printf("memory: peak RSS %.1f MB (now %.1f MB); Mat allocations per frame: mean %.1f KB, "
+           "max %.1f KB, none in %d of %d frames\n", peakRssKb() / 1024.0, currentRssKb() / 1024.0,
+           frames > 0 ? totalBytes / 1024.0 / frames : 0.0, maxBytes / 1024.0, quietFrames, frames);
+}
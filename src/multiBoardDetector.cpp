@@ -0,0 +1,210 @@
+/* multiBoardDetector.cpp
+ * Detects and tracks several chessboards in a single frame
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <algorithm>
+#include "multiBoardDetector.h"
+#include "opencv2/imgproc/imgproc.hpp"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Returns the corner at the given row and column of a detected board
+ */
+static Point2f cornerAt(const vector<Point2f> &corners, const Size &boardSize, int row, int col)
+{
+    return corners[row * boardSize.width + col];
+}
+
+void maskBoard(Mat &gray, const vector<Point2f> &corners, const Size &boardSize)
+{
+    int lastRow = boardSize.height - 1;
+    int lastCol = boardSize.width - 1;
+
+    //push each outer corner out by one square along both board directions,
+    //which covers the border squares the detector also looks at
+    int rows[4] = {0, 0, lastRow, lastRow};
+    int cols[4] = {0, lastCol, lastCol, 0};
+    Point outline[4];
+    for (int i = 0; i < 4; i++)
+    {
+        int r = rows[i], c = cols[i];
+        int rNext = (r == 0) ? 1 : r - 1; //neighbor towards the inside
+        int cNext = (c == 0) ? 1 : c - 1;
+        Point2f p = cornerAt(corners, boardSize, r, c);
+        Point2f rowStep = p - cornerAt(corners, boardSize, r, cNext);
+        Point2f colStep = p - cornerAt(corners, boardSize, rNext, c);
+        outline[i] = p + rowStep + colStep;
+    }
+
+    fillConvexPoly(gray, outline, 4, Scalar(128));
+}
+
+/**
+ * True if the two boxes mostly cover the same area
+ */
+static bool sameRegion(const Rect &a, const Rect &b)
+{
+    int overlap = (a & b).area();
+    return overlap > 0.5 * min(a.area(), b.area());
+}
+
+MultiBoardDetector::MultiBoardDetector(const vector<const BoardOps *> &boards, int maxPerSize,
+                                       int fullSearchInterval)
+    : subPixIterations(0), boards(boards), maxPerSize(maxPerSize),
+      fullSearchInterval(fullSearchInterval), framesSinceFullSearch(0)
+{
+}
+
+void MultiBoardDetector::reset()
+{
+    tracked.clear();
+    framesSinceFullSearch = 0;
+}
+
+/**
+ * Looks for each previously found board only inside its old bounding box,
+ * grown by half its size to allow for motion; the ROIs are searched in parallel
+ */
+void MultiBoardDetector::searchROIs(const Mat &gray, vector<DetectedBoard> &found)
+{
+    int numTracked = (int)tracked.size();
+    vector<char> refound(numTracked, 0);
+    Rect frameRect(0, 0, gray.cols, gray.rows);
+
+    parallel_for_(Range(0, numTracked), [&](const Range &range)
+    {
+        for (int i = range.start; i < range.end; i++)
+        {
+            DetectedBoard &t = tracked[i];
+            Rect roi = t.roi;
+            roi.x -= roi.width / 2;
+            roi.y -= roi.height / 2;
+            roi.width *= 2;
+            roi.height *= 2;
+            roi &= frameRect;
+            if (roi.area() == 0)
+            {
+                continue;
+            }
+
+            vector<Point2f> corners;
+            if (t.board->detectCorners(gray(roi), corners, subPixIterations))
+            {
+                Point2f offset((float)roi.x, (float)roi.y);
+                for (size_t j = 0; j < corners.size(); j++)
+                {
+                    corners[j] += offset;
+                }
+                t.pose.corners = corners;
+                t.roi = boundingRect(corners);
+                refound[i] = 1;
+            }
+        }
+    });
+
+    for (int i = 0; i < numTracked; i++)
+    {
+        if (refound[i])
+        {
+            found.push_back(tracked[i]);
+        }
+    }
+}
+
+/**
+ * Searches the whole frame for boards not already found, masking out every
+ * board as it is found and searching again; each board size is searched in
+ * parallel on its own masked copy of the frame
+ */
+void MultiBoardDetector::searchMasked(const Mat &gray, vector<DetectedBoard> &found)
+{
+    gray.copyTo(masked);
+    for (size_t i = 0; i < found.size(); i++)
+    {
+        maskBoard(masked, found[i].pose.corners, found[i].board->size());
+    }
+
+    int numSizes = (int)boards.size();
+    vector< vector<DetectedBoard> > perSize(numSizes);
+
+    parallel_for_(Range(0, numSizes), [&](const Range &range)
+    {
+        for (int s = range.start; s < range.end; s++)
+        {
+            const BoardOps *board = boards[s];
+            Mat search = masked.clone();
+            for (int n = 0; n < maxPerSize; n++)
+            {
+                DetectedBoard d;
+                if (!board->detectCorners(search, d.pose.corners, subPixIterations))
+                {
+                    break;
+                }
+                d.board = board;
+                d.roi = boundingRect(d.pose.corners);
+                perSize[s].push_back(d);
+                maskBoard(search, d.pose.corners, board->size());
+            }
+        }
+    });
+
+    //different sizes can latch onto the same printed board; keep the larger one
+    for (int s = 0; s < numSizes; s++)
+    {
+        for (size_t i = 0; i < perSize[s].size(); i++)
+        {
+            DetectedBoard &d = perSize[s][i];
+            bool duplicate = false;
+            for (size_t j = 0; j < found.size() && !duplicate; j++)
+            {
+                if (sameRegion(d.roi, found[j].roi))
+                {
+                    duplicate = true;
+                    if (d.board->numCorners > found[j].board->numCorners)
+                    {
+                        found[j] = d;
+                    }
+                }
+            }
+            if (!duplicate)
+            {
+                found.push_back(d);
+            }
+        }
+    }
+}
+
+void MultiBoardDetector::detect(FrameCache &cache, const Mat &cameraMatrix, const Mat &distCoeffs,
+                                vector<DetectedBoard> &found)
+{
+    const Mat &gray = cache.gray();
+    found.clear();
+
+    searchROIs(gray, found);
+
+    //only pay for a whole-frame search when a board was lost or periodically
+    //to pick up new ones, so tracked boards cost just their ROI
+    framesSinceFullSearch++;
+    bool lostBoard = (found.size() < tracked.size()) || tracked.empty();
+    if (lostBoard || framesSinceFullSearch >= fullSearchInterval)
+    {
+        searchMasked(gray, found);
+        framesSinceFullSearch = 0;
+    }
+
+    parallel_for_(Range(0, (int)found.size()), [&](const Range &range)
+    {
+        for (int i = range.start; i < range.end; i++)
+        {
+            found[i].board->solvePose(found[i].pose.corners, cameraMatrix, distCoeffs, found[i].pose);
+        }
+    });
+
+    tracked = found;
+}
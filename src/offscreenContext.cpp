@@ -0,0 +1,186 @@
+/* offscreenContext.cpp
+ * Surfaceless EGL context with framebuffer rendering and PBO read-back
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <cstring>
+#include <iostream>
+#include "offscreenContext.h"
+#include <EGL/eglext.h>
+
+using namespace std;
+using namespace cv;
+
+OffscreenContext::OffscreenContext()
+    : display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT), framebuffer(0),
+      colorBuffer(0), depthBuffer(0), frameCount(0)
+{
+    packBuffers[0] = packBuffers[1] = 0;
+}
+
+OffscreenContext::~OffscreenContext()
+{
+    if (context != EGL_NO_CONTEXT)
+    {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+        glDeleteBuffers(2, packBuffers);
+        glDeleteRenderbuffers(1, &colorBuffer);
+        glDeleteRenderbuffers(1, &depthBuffer);
+        glDeleteFramebuffers(1, &framebuffer);
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display, context);
+    }
+    if (display != EGL_NO_DISPLAY)
+    {
+        eglTerminate(display);
+    }
+}
+
+/**
+ * Opens an EGL display that needs no window system: Mesa's surfaceless
+ * platform when available, otherwise the default display
+ */
+static EGLDisplay openHeadlessDisplay()
+{
+    const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (clientExtensions != NULL && strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay != NULL)
+        {
+            EGLDisplay surfaceless = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                                        EGL_DEFAULT_DISPLAY, NULL);
+            if (surfaceless != EGL_NO_DISPLAY)
+            {
+                return surfaceless;
+            }
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+bool OffscreenContext::create(Size size)
+{
+    display = openHeadlessDisplay();
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+    {
+        cout << "Unable to open an EGL display\n";
+        return false;
+    }
+
+    //desktop OpenGL (compatibility profile), so the fixed-function drawing code works unchanged
+    //(EGL_SURFACE_TYPE defaults to windows, which a headless display has none of)
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if (!eglBindAPI(EGL_OPENGL_API) ||
+        !eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs < 1)
+    {
+        cout << "No EGL config with desktop OpenGL\n";
+        return false;
+    }
+
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+    if (context == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        cout << "Unable to make a surfaceless OpenGL context current\n";
+        return false;
+    }
+
+    frameSize = size;
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size.width, size.height);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size.width, size.height);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        cout << "Offscreen framebuffer is incomplete\n";
+        return false;
+    }
+
+    size_t bytes = (size_t)size.width * size.height * 3;
+    glGenBuffers(2, packBuffers);
+    for (int i = 0; i < 2; i++)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    frameCount = 0;
+    return true;
+}
+
+void OffscreenContext::beginFrame()
+{
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, frameSize.width, frameSize.height);
+}
+
+/**
+ * Copies a finished read-back out of the given pack buffer, flipping it so
+ * the top row comes first (GL rows start at the bottom)
+ */
+void OffscreenContext::copyOut(GLuint buffer, Mat &out)
+{
+    out.create(frameSize, CV_8UC3);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+    const uchar *src = (const uchar *)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (src != NULL)
+    {
+        size_t rowBytes = (size_t)frameSize.width * 3;
+        for (int i = 0; i < frameSize.height; i++)
+        {
+            memcpy(out.ptr(frameSize.height - 1 - i), src + i * rowBytes, rowBytes);
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool OffscreenContext::readFrame(Mat &out)
+{
+    int current = frameCount % 2;
+
+    //queue this frame's read-back; glReadPixels into a PBO returns without waiting
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffers[current]);
+    glReadPixels(0, 0, frameSize.width, frameSize.height, GL_BGR, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    frameCount++;
+
+    if (frameCount < 2)
+    {
+        return false;
+    }
+    copyOut(packBuffers[1 - current], out); //the previous frame has had a whole frame to land
+    return true;
+}
+
+bool OffscreenContext::finish(Mat &out)
+{
+    if (frameCount == 0)
+    {
+        return false;
+    }
+    copyOut(packBuffers[(frameCount - 1) % 2], out);
+    frameCount = 0;
+    return true;
+}
@@ -0,0 +1,129 @@
+/* overlayCache.cpp
+ * Reuses the last overlay drawn while the board holds still
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "opencv2/calib3d/calib3d.hpp"
+#include "overlayCache.h"
+
+using namespace std;
+using namespace cv;
+
+double OverlayCacheStats::savedMsPerFrame() const
+{
+    if (hits == 0 || misses == 0)
+    {
+        return 0; //no redraw cost to compare against
+    }
+    double missMean = missMs / misses;
+    double hitMean = hitMs / hits;
+    return (missMean - hitMean) * hits / (hits + misses);
+}
+
+OverlayCache::OverlayCache(double maxShift)
+    : maxShift(maxShift), valid(false), frameType(-1), layerLod(0)
+{
+}
+
+/**
+ * Rough bound, in pixels, on how far a point of the overlay moves between
+ * two poses: the rotation turns a point at about the board's distance by
+ * that angle as seen from the camera, and the translation moves it by its
+ * length over the depth
+ */
+static double estimateShift(const Mat &rotation, const Mat &translation, const BoardPose &pose,
+                            double focalLength)
+{
+    Mat newRotation;
+    Rodrigues(pose.rvec, newRotation);
+    Mat delta = newRotation * rotation.t();
+    double cosAngle = (trace(delta)[0] - 1) / 2;
+    double angle = acos(min(max(cosAngle, -1.0), 1.0));
+
+    double depth = pose.tvec.at<double>(2);
+    if (depth <= 0)
+    {
+        return HUGE_VAL;
+    }
+    return focalLength * (angle + norm(pose.tvec, translation) / depth);
+}
+
+bool OverlayCache::reuse(const vector<DetectedBoard> &boards, const Mat &cameraMatrix,
+                         float lodScale, Mat &frame)
+{
+    if (!valid || boards.size() != layerBoards.size() || frame.size() != frameSize ||
+        frame.type() != frameType || lodScale != layerLod)
+    {
+        return false;
+    }
+    double focalLength = cameraMatrix.at<double>(0, 0);
+    for (size_t i = 0; i < boards.size(); i++)
+    {
+        if (boards[i].board != layerBoards[i] ||
+            estimateShift(layerRotations[i], layerTranslations[i], boards[i].pose, focalLength) > maxShift)
+        {
+            return false;
+        }
+    }
+
+    layer.copyTo(frame(box), mask);
+    return true;
+}
+
+void OverlayCache::render(DrawList &overlay, const vector<DetectedBoard> &boards, float lodScale,
+                          Mat &frame, bool antiAlias)
+{
+    box = overlay.bounds(frame.size());
+    valid = box.area() > 0;
+    if (!valid)
+    {
+        overlay.render(frame, antiAlias);
+        return;
+    }
+
+    //anti-aliased edges keep the background they were blended with, which hardly
+    //changes while the camera holds still
+    overlay.render(frame, antiAlias);
+    frame(box).copyTo(layer);
+
+    //only the box is cleared, since nothing is ever read outside it
+    if (coverage.size() != frame.size())
+    {
+        coverage.create(frame.size(), CV_8UC1);
+    }
+    mask = coverage(box);
+    mask.setTo(Scalar(0));
+    overlay.renderCoverage(coverage, antiAlias);
+
+    frameSize = frame.size();
+    frameType = frame.type();
+    layerLod = lodScale;
+    layerBoards.resize(boards.size());
+    layerRotations.resize(boards.size());
+    layerTranslations.resize(boards.size());
+    for (size_t i = 0; i < boards.size(); i++)
+    {
+        layerBoards[i] = boards[i].board;
+        Rodrigues(boards[i].pose.rvec, layerRotations[i]);
+        boards[i].pose.tvec.copyTo(layerTranslations[i]);
+    }
+}
+
+void OverlayCache::record(bool hit, double ms)
+{
+    if (hit)
+    {
+        stats.hits++;
+        stats.hitMs += ms;
+    }
+    else
+    {
+        stats.misses++;
+        stats.missMs += ms;
+    }
+}
@@ -0,0 +1,99 @@
+/* poseReader.cpp
+ * Prints the poses published by arSystem, either live from its shared-memory
+ * ring or from a binary pose log; also an example of using the reader library
+ *
+ * to compile:
+ * make poseReader
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#include "poseStream.h"
+
+using namespace std;
+
+/**
+ * Prints one pose record on a single line
+ */
+void printRecord(const PoseRecord &rec, uint64_t latencyUs)
+{
+    printf("stream %u frame %llu board %u (%dx%d) ", rec.streamId,
+           (unsigned long long)rec.frameNumber, rec.boardIndex, rec.boardWidth, rec.boardHeight);
+    if (rec.status == POSE_FOUND)
+    {
+        printf("rvec %g %g %g tvec %g %g %g err %.3f", rec.rvec[0], rec.rvec[1], rec.rvec[2],
+               rec.tvec[0], rec.tvec[1], rec.tvec[2], rec.reprojError);
+    }
+    else
+    {
+        printf("no board");
+    }
+    if (latencyUs > 0)
+    {
+        printf(" (%llu us)", (unsigned long long)latencyUs);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        cout << "Usage: ../bin/poseReader |shared memory name, e.g. /arPoses| or -f |pose log file|\n";
+        exit(-1);
+    }
+
+    // replay a binary log
+    if (strcmp(argv[1], "-f") == 0 && argc == 3)
+    {
+        FILE *logFile = fopen(argv[2], "rb");
+        if (logFile == NULL)
+        {
+            cout << "Unable to open pose log " << argv[2] << "\n";
+            exit(-1);
+        }
+        PoseRecord rec;
+        while (readPoseLog(logFile, rec))
+        {
+            printRecord(rec, 0);
+        }
+        fclose(logFile);
+        return 0;
+    }
+
+    // follow the live ring
+    PoseReader reader;
+    while (!reader.open(argv[1]))
+    {
+        cout << "waiting for publisher " << argv[1] << "...\n";
+        sleep(1);
+    }
+
+    PoseRecord rec;
+    uint64_t lastDropped = 0;
+    for (;;)
+    {
+        if (reader.next(rec))
+        {
+            printRecord(rec, poseTimestampUs() - rec.timestampUs);
+            if (reader.dropped() != lastDropped)
+            {
+                cout << "dropped " << reader.dropped() - lastDropped << " records\n";
+                lastDropped = reader.dropped();
+            }
+        }
+        else
+        {
+            usleep(50); //poll briefly so new poses are picked up within microseconds
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,278 @@
+/* poseStream.cpp
+ * Shared-memory pose ring: publisher, reader and binary log
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "poseStream.h"
+
+using namespace std;
+
+uint64_t poseTimestampUs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+PosePublisher::PosePublisher()
+    : header(NULL), slots(NULL), mappedSize(0), nextIndex(0), logFile(NULL),
+      logFailed(false)
+{
+    name[0] = '\0';
+}
+
+PosePublisher::~PosePublisher()
+{
+    close();
+}
+
+bool PosePublisher::open(const char *shmName, uint32_t capacity)
+{
+    close();
+
+    //start from a fresh segment so readers of an older run see the new ring
+    shm_unlink(shmName);
+    int fd = shm_open(shmName, O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        perror("shm_open");
+        return false;
+    }
+
+    mappedSize = sizeof(PoseRingHeader) + capacity * sizeof(PoseSlot);
+    if (ftruncate(fd, mappedSize) != 0)
+    {
+        perror("ftruncate");
+        ::close(fd);
+        shm_unlink(shmName);
+        return false;
+    }
+
+    void *mem = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd); //the mapping keeps the segment alive
+    if (mem == MAP_FAILED)
+    {
+        perror("mmap");
+        shm_unlink(shmName);
+        return false;
+    }
+
+    //a new segment is zero-filled, which is also the "empty" state of every slot
+    header = (PoseRingHeader *)mem;
+    slots = (PoseSlot *)((char *)mem + sizeof(PoseRingHeader));
+    header->version = POSE_STREAM_VERSION;
+    header->capacity = capacity;
+    header->recordSize = sizeof(PoseRecord);
+    header->writeIndex.store(0, memory_order_relaxed);
+    header->magic.store(POSE_STREAM_MAGIC, memory_order_release);
+
+    nextIndex = 0;
+    strncpy(name, shmName, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    return true;
+}
+
+bool PosePublisher::openLog(const char *logFilename)
+{
+    if (logFile != NULL && fclose(logFile) != 0 && !logFailed)
+    {
+        perror("pose log");
+    }
+    logFile = fopen(logFilename, "wb");
+    if (logFile == NULL)
+    {
+        perror("fopen");
+        return false;
+    }
+
+    logFailed = false;
+    PoseLogHeader fileHeader = {POSE_STREAM_MAGIC, POSE_STREAM_VERSION, sizeof(PoseRecord), 0};
+    if (fwrite(&fileHeader, sizeof(fileHeader), 1, logFile) != 1)
+    {
+        perror(logFilename);
+        fclose(logFile);
+        logFile = NULL;
+        return false;
+    }
+    return true;
+}
+
+void PosePublisher::publish(const PoseRecord &record)
+{
+    if (header != NULL)
+    {
+        PoseSlot &slot = slots[nextIndex % header->capacity];
+
+        //odd sequence: readers that catch the slot mid-write will retry or skip
+        slot.seq.store(2 * nextIndex + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        memcpy(&slot.record, &record, sizeof(PoseRecord));
+        slot.seq.store(2 * nextIndex + 2, memory_order_release);
+
+        nextIndex++;
+        header->writeIndex.store(nextIndex, memory_order_release);
+    }
+
+    if (logFile != NULL)
+    {
+        //stdio buffers these into large writes, so a full disk may only show up at close
+        if (fwrite(&record, sizeof(PoseRecord), 1, logFile) != 1 && !logFailed)
+        {
+            perror("pose log");
+            logFailed = true;
+        }
+    }
+}
+
+void PosePublisher::close()
+{
+    if (header != NULL)
+    {
+        munmap(header, mappedSize);
+        shm_unlink(name);
+        header = NULL;
+        slots = NULL;
+    }
+    if (logFile != NULL)
+    {
+        if (fclose(logFile) != 0 && !logFailed)
+        {
+            perror("pose log");
+        }
+        logFile = NULL;
+    }
+}
+
+PoseReader::PoseReader()
+    : header(NULL), slots(NULL), mappedSize(0), readIndex(0), droppedCount(0)
+{
+}
+
+PoseReader::~PoseReader()
+{
+    close();
+}
+
+bool PoseReader::open(const char *shmName, bool fromOldest)
+{
+    close();
+
+    int fd = shm_open(shmName, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(PoseRingHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    mappedSize = info.st_size;
+    void *mem = mmap(NULL, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED)
+    {
+        return false;
+    }
+
+    header = (const PoseRingHeader *)mem;
+    slots = (const PoseSlot *)((const char *)mem + sizeof(PoseRingHeader));
+    if (header->magic.load(memory_order_acquire) != POSE_STREAM_MAGIC ||
+        header->version != POSE_STREAM_VERSION ||
+        header->recordSize != sizeof(PoseRecord) ||
+        mappedSize < sizeof(PoseRingHeader) + header->capacity * sizeof(PoseSlot))
+    {
+        close();
+        return false;
+    }
+
+    uint64_t written = header->writeIndex.load(memory_order_acquire);
+    readIndex = written;
+    if (fromOldest)
+    {
+        readIndex = (written > header->capacity) ? written - header->capacity : 0;
+    }
+    droppedCount = 0;
+    return true;
+}
+
+bool PoseReader::next(PoseRecord &record)
+{
+    if (header == NULL)
+    {
+        return false;
+    }
+
+    for (;;)
+    {
+        uint64_t written = header->writeIndex.load(memory_order_acquire);
+        if (readIndex >= written)
+        {
+            return false;
+        }
+
+        //lapped by the writer: skip to the oldest record that can still be intact
+        if (written - readIndex > header->capacity)
+        {
+            uint64_t oldest = written - header->capacity;
+            droppedCount += oldest - readIndex;
+            readIndex = oldest;
+        }
+
+        const PoseSlot &slot = slots[readIndex % header->capacity];
+        uint64_t expected = 2 * readIndex + 2;
+        uint64_t before = slot.seq.load(memory_order_acquire);
+        if (before == expected)
+        {
+            memcpy(&record, &slot.record, sizeof(PoseRecord));
+            atomic_thread_fence(memory_order_acquire);
+            if (slot.seq.load(memory_order_relaxed) == expected)
+            {
+                readIndex++;
+                return true;
+            }
+        }
+
+        //the slot was overwritten while we looked; count it as lost and move on
+        droppedCount++;
+        readIndex++;
+    }
+}
+
+void PoseReader::close()
+{
+    if (header != NULL)
+    {
+        munmap((void *)header, mappedSize);
+        header = NULL;
+        slots = NULL;
+    }
+}
+
+bool readPoseLog(FILE *logFile, PoseRecord &record)
+{
+    if (ftell(logFile) == 0)
+    {
+        PoseLogHeader fileHeader;
+        if (fread(&fileHeader, sizeof(fileHeader), 1, logFile) != 1 ||
+            fileHeader.magic != POSE_STREAM_MAGIC ||
+            fileHeader.version != POSE_STREAM_VERSION ||
+            fileHeader.recordSize != sizeof(PoseRecord))
+        {
+            return false;
+        }
+    }
+    return fread(&record, sizeof(PoseRecord), 1, logFile) == 1;
+}
@@ -0,0 +1,650 @@
+/* profileEval.cpp
+ * Ranks calibration profiles by how well they fit a camera's footage. The
+ * board's corners are found once in every frame of the dataset (a video, an
+ * image, or an image directory or glob) and cached to a file, so evaluating
+ * more profiles later skips detection. Every profile is then scored on every
+ * frame in parallel:
+ *  - reprojection error of the board pose solved with the profile,
+ *  - how far apart the poses solved from the left and right halves of the
+ *    board land (a wrong lens model bends the two halves differently),
+ *  - for video, frame-to-frame jitter: how far each pose sits from the
+ *    midpoint of its neighbors' poses,
+ *  - time per pose solve.
+ * Profiles are plain calibration.txt files or logs in the format of
+ * all_calibrations.txt, where every named entry with parameters is a profile.
+ *
+ * to compile:
+ * make profileEval
+ *
+ * usage: ../bin/profileEval [-b WxH] [-c cache.yml] [-r] [-o report.csv] [dataset [profile...]]
+ * (-r: detect again even if the cache matches; default: the bundled video
+ * and the bundled profiles)
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <sys/stat.h>
+#include "opencv2/opencv.hpp"
+#include "opencv2/calib3d/calib3d.hpp"
+#include "boardGeometry.h"
+#include "calibrationProfile.h"
+#include "imageList.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Corners found in one frame of the dataset
+ */
+struct FrameDetection
+{
+    int index;   //frame number (video) or position in the file list (images)
+    string name; //image filename, empty for video
+    vector<Point2f> corners;
+};
+
+/**
+ * Everything detection produced, as saved in the cache file
+ */
+struct DetectionCache
+{
+    string dataset;
+    string stamp;     //the dataset's files, bytes and latest change, to notice it being replaced
+    string boardSize; //WxH
+    Size imageSize;
+    int frameCount;
+    bool sequential; //video frames, so neighbors are consecutive in time
+    vector<FrameDetection> frames;
+};
+
+/**
+ * One profile's scores on one frame
+ */
+struct FrameScore
+{
+    bool solved;
+    double reprojError;            //pixels RMS
+    double splitShift, splitAngle; //left vs right half poses: board squares, degrees
+    Mat rvec, tvec;
+    double ms;
+};
+
+struct Profile
+{
+    string name;
+    Mat cameraMatrix, distCoeffs;
+    vector<FrameScore> scores;
+
+    //summary
+    int solved;
+    double medianError, meanError, maxError;
+    double splitShift, splitAngle;   //medians
+    double jitterShift, jitterAngle; //medians, negative if not measured
+    double meanMs;
+    bool otherResolution; //principal point outside the dataset's frames
+};
+
+/**
+ * Describes the dataset's files by count, total size and latest modification
+ * time, so a dataset recorded again under the same name doesn't match its
+ * old cache
+ */
+static string datasetStamp(const string &dataset)
+{
+    vector<string> files;
+    listImages(dataset, files);
+    if (files.empty())
+    {
+        files.push_back(dataset); //a video
+    }
+    long long bytes = 0;
+    long long modified = 0;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        struct stat info;
+        if (stat(files[i].c_str(), &info) == 0)
+        {
+            bytes += info.st_size;
+            modified = max(modified, (long long)info.st_mtime);
+        }
+    }
+    return to_string(files.size()) + " files, " + to_string(bytes) + " bytes, modified " +
+           to_string(modified);
+}
+
+/**
+ * Finds the board in every frame of the dataset, a batch of frames at a time
+ * in parallel; false if the dataset can't be opened
+ */
+static bool detectDataset(const string &dataset, const BoardOps *board, DetectionCache &cache)
+{
+    vector<string> files;
+    listImages(dataset, files);
+    VideoCapture capture;
+    if (files.empty() && !capture.open(dataset))
+    {
+        printf("Unable to open dataset %s\n", dataset.c_str());
+        return false;
+    }
+
+    cache.dataset = dataset;
+    cache.stamp = datasetStamp(dataset);
+    cache.boardSize = to_string(board->width) + "x" + to_string(board->height);
+    cache.sequential = files.empty();
+    cache.frameCount = 0;
+    cache.frames.clear();
+
+    int batchSize = 4 * max(1, getNumberOfCPUs());
+    vector<Mat> grays(batchSize);
+    vector<FrameDetection> batch(batchSize);
+    vector<char> found(batchSize);
+    Mat frame;
+    for (;;)
+    {
+        //video frames have to be read in order; images are read by the workers
+        int n = 0;
+        int wanted = cache.sequential ? batchSize : min(batchSize, (int)files.size() - cache.frameCount);
+        while (n < wanted)
+        {
+            if (cache.sequential)
+            {
+                if (!capture.read(frame))
+                {
+                    break;
+                }
+                cvtColor(frame, grays[n], CV_BGR2GRAY);
+                batch[n].name.clear();
+            }
+            else
+            {
+                batch[n].name = files[cache.frameCount + n];
+            }
+            batch[n].index = cache.frameCount + n;
+            n++;
+        }
+        if (n == 0)
+        {
+            break;
+        }
+
+        parallel_for_(Range(0, n), [&](const Range &range)
+        {
+            for (int i = range.start; i < range.end; i++)
+            {
+                if (!cache.sequential)
+                {
+                    grays[i] = imread(batch[i].name, IMREAD_GRAYSCALE);
+                }
+                found[i] = !grays[i].empty() && board->detectCorners(grays[i], batch[i].corners, 20);
+            }
+        });
+
+        for (int i = 0; i < n; i++)
+        {
+            if (grays[i].empty())
+            {
+                printf("Unable to read %s\n", batch[i].name.c_str());
+                continue;
+            }
+            cache.imageSize = grays[i].size();
+            if (found[i])
+            {
+                cache.frames.push_back(batch[i]);
+            }
+        }
+        cache.frameCount += n;
+    }
+    return true;
+}
+
+static bool writeCache(const string &filename, const DetectionCache &cache)
+{
+    FileStorage fs(filename, FileStorage::WRITE);
+    if (!fs.isOpened())
+    {
+        return false;
+    }
+    fs << "dataset" << cache.dataset << "stamp" << cache.stamp << "board" << cache.boardSize;
+    fs << "imageWidth" << cache.imageSize.width << "imageHeight" << cache.imageSize.height;
+    fs << "frameCount" << cache.frameCount << "sequential" << (int)cache.sequential;
+    fs << "frames" << "[";
+    for (size_t i = 0; i < cache.frames.size(); i++)
+    {
+        const FrameDetection &f = cache.frames[i];
+        fs << "{" << "index" << f.index << "name" << f.name << "corners" << f.corners << "}";
+    }
+    fs << "]";
+    return true;
+}
+
+/**
+ * Loads cached detections if the file exists and was made from the same
+ * dataset, unchanged since, and board
+ */
+static bool readCache(const string &filename, const string &dataset, const BoardOps *board,
+                      DetectionCache &cache)
+{
+    FileStorage fs;
+    try
+    {
+        if (!fs.open(filename, FileStorage::READ))
+        {
+            return false;
+        }
+    }
+    catch (const cv::Exception &)
+    {
+        return false; //not a cache file
+    }
+    fs["dataset"] >> cache.dataset;
+    fs["stamp"] >> cache.stamp;
+    fs["board"] >> cache.boardSize;
+    if (cache.dataset != dataset || cache.stamp != datasetStamp(dataset) ||
+        cache.boardSize != to_string(board->width) + "x" + to_string(board->height))
+    {
+        return false;
+    }
+    int sequential;
+    fs["imageWidth"] >> cache.imageSize.width;
+    fs["imageHeight"] >> cache.imageSize.height;
+    fs["frameCount"] >> cache.frameCount;
+    fs["sequential"] >> sequential;
+    cache.sequential = sequential != 0;
+
+    FileNode frames = fs["frames"];
+    cache.frames.clear();
+    for (FileNodeIterator it = frames.begin(); it != frames.end(); ++it)
+    {
+        FrameDetection f;
+        (*it)["index"] >> f.index;
+        (*it)["name"] >> f.name;
+        (*it)["corners"] >> f.corners;
+        if ((int)f.corners.size() == board->numCorners)
+        {
+            cache.frames.push_back(f);
+        }
+    }
+    return true;
+}
+
+/**
+ * Reads the profiles in a file: a calibration.txt, or a log of named entries
+ * like all_calibrations.txt (entries without parameters are skipped)
+ */
+static void readProfiles(const string &filename, vector<Profile> &profiles)
+{
+    Profile p;
+    if (readCalibrationProfile(filename, p.cameraMatrix, p.distCoeffs))
+    {
+        p.name = filename;
+        profiles.push_back(p);
+        return;
+    }
+
+    ifstream in(filename.c_str());
+    if (!in.is_open())
+    {
+        printf("Unable to open profile %s\n", filename.c_str());
+        return;
+    }
+    string line, name;
+    bool used = true; //the current name already has its parameters (or there is none)
+    while (getline(in, line))
+    {
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty() || line.find("re-projection error") == 0)
+        {
+            continue;
+        }
+        if (line.find("camera matrix") == 0)
+        {
+            p.cameraMatrix = Mat::zeros(3, 3, CV_64F);
+            for (int i = 0; i < 9; i++)
+            {
+                in >> p.cameraMatrix.at<double>(i / 3, i % 3);
+            }
+        }
+        else if (line.find("distortion coefficients") == 0)
+        {
+            getline(in, line);
+            istringstream words(line);
+            vector<double> coeffs;
+            double c;
+            while (words >> c)
+            {
+                coeffs.push_back(c);
+            }
+            if (!in.fail() && !p.cameraMatrix.empty() && coeffs.size() >= 4)
+            {
+                p.distCoeffs = Mat(coeffs).clone(); //not copyTo: the last profile may share the buffer
+                p.name = filename + ":" + name;
+                profiles.push_back(p);
+                used = true;
+            }
+            p.cameraMatrix.release();
+        }
+        else
+        {
+            if (!used)
+            {
+                printf("Skipping %s:%s (no camera parameters)\n", filename.c_str(), name.c_str());
+            }
+            name = line;
+            used = false;
+        }
+    }
+    if (!used)
+    {
+        printf("Skipping %s:%s (no camera parameters)\n", filename.c_str(), name.c_str());
+    }
+}
+
+/** Angle in degrees between two rotation vectors' rotations */
+static double rotationAngle(const Mat &rvecA, const Mat &rvecB)
+{
+    Mat a, b;
+    Rodrigues(rvecA, a);
+    Rodrigues(rvecB, b);
+    double cosAngle = (trace(a * b.t())[0] - 1) / 2;
+    return acos(min(max(cosAngle, -1.0), 1.0)) * 180 / CV_PI;
+}
+
+/**
+ * Scores one profile on one frame: full pose and its reprojection error,
+ * then the poses from each half of the board
+ */
+static void scoreFrame(const BoardOps *board, const vector<Point3f> &boardPoints,
+                       const Profile &profile, const FrameDetection &frame, FrameScore &score)
+{
+    int64 start = getTickCount();
+    BoardPose pose;
+    score.solved = board->solvePose(frame.corners, profile.cameraMatrix, profile.distCoeffs, pose);
+    score.ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+    if (!score.solved)
+    {
+        return;
+    }
+    score.reprojError = pose.reprojError;
+    score.rvec = pose.rvec;
+    score.tvec = pose.tvec;
+
+    //the middle column goes to both halves
+    vector<Point3f> objects[2];
+    vector<Point2f> images[2];
+    for (int i = 0; i < board->numCorners; i++)
+    {
+        int column = i % board->width;
+        for (int half = 0; half < 2; half++)
+        {
+            if (half == 0 ? column <= board->width / 2 : column >= board->width / 2)
+            {
+                objects[half].push_back(boardPoints[i]);
+                images[half].push_back(frame.corners[i]);
+            }
+        }
+    }
+    Mat rvecs[2], tvecs[2];
+    for (int half = 0; half < 2; half++)
+    {
+        pose.rvec.copyTo(rvecs[half]); //start from the full pose
+        pose.tvec.copyTo(tvecs[half]);
+        solvePnP(objects[half], images[half], profile.cameraMatrix, profile.distCoeffs,
+                 rvecs[half], tvecs[half], true);
+    }
+    score.splitShift = norm(tvecs[0], tvecs[1]);
+    score.splitAngle = rotationAngle(rvecs[0], rvecs[1]);
+}
+
+static double median(vector<double> values)
+{
+    if (values.empty())
+    {
+        return -1;
+    }
+    nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+/**
+ * Rotation vector halfway between two rotations: the first, turned by half of
+ * the rotation that takes it to the second (averaging the vectors themselves
+ * is only right for small rotations, and breaks where they wrap around at pi)
+ */
+static Mat midRotation(const Mat &rvecA, const Mat &rvecB)
+{
+    Mat a, b, delta, half, mid, midVec;
+    Rodrigues(rvecA, a);
+    Rodrigues(rvecB, b);
+    Rodrigues(a.t() * b, delta);
+    Rodrigues(delta * 0.5, half);
+    mid = a * half;
+    Rodrigues(mid, midVec);
+    return midVec;
+}
+
+/**
+ * Sums up a profile's frame scores
+ */
+static void summarize(Profile &p, const DetectionCache &cache)
+{
+    vector<double> errors, shifts, angles, jitterShifts, jitterAngles;
+    double totalMs = 0;
+    p.maxError = 0;
+    for (size_t i = 0; i < p.scores.size(); i++)
+    {
+        const FrameScore &s = p.scores[i];
+        totalMs += s.ms;
+        if (!s.solved)
+        {
+            continue;
+        }
+        errors.push_back(s.reprojError);
+        shifts.push_back(s.splitShift);
+        angles.push_back(s.splitAngle);
+        p.maxError = max(p.maxError, s.reprojError);
+
+        //jitter only where the frames on both sides were detected too
+        if (cache.sequential && i > 0 && i + 1 < p.scores.size() &&
+            cache.frames[i - 1].index == cache.frames[i].index - 1 &&
+            cache.frames[i + 1].index == cache.frames[i].index + 1 &&
+            p.scores[i - 1].solved && p.scores[i + 1].solved)
+        {
+            Mat midT = (p.scores[i - 1].tvec + p.scores[i + 1].tvec) / 2;
+            Mat midR = midRotation(p.scores[i - 1].rvec, p.scores[i + 1].rvec);
+            jitterShifts.push_back(norm(s.tvec, midT));
+            jitterAngles.push_back(rotationAngle(s.rvec, midR));
+        }
+    }
+
+    p.solved = (int)errors.size();
+    p.meanError = errors.empty() ? 0 : sum(Mat(errors))[0] / errors.size();
+    p.medianError = median(errors);
+    p.splitShift = median(shifts);
+    p.splitAngle = median(angles);
+    p.jitterShift = median(jitterShifts);
+    p.jitterAngle = median(jitterAngles);
+    p.meanMs = p.scores.empty() ? 0 : totalMs / p.scores.size();
+
+    double cx = p.cameraMatrix.at<double>(0, 2), cy = p.cameraMatrix.at<double>(1, 2);
+    p.otherResolution = cx <= 0 || cy <= 0 || cx >= cache.imageSize.width || cy >= cache.imageSize.height;
+}
+
+static bool writeReport(const string &filename, const vector<Profile *> &ranked)
+{
+    FILE *fp = fopen(filename.c_str(), "w");
+    if (fp == NULL)
+    {
+        return false;
+    }
+    fprintf(fp, "rank,profile,frames,median_error_px,mean_error_px,max_error_px,"
+                "split_shift,split_angle_deg,jitter_shift,jitter_angle_deg,ms_per_frame,other_resolution\n");
+    for (size_t r = 0; r < ranked.size(); r++)
+    {
+        const Profile &p = *ranked[r];
+        fprintf(fp, "%d,\"%s\",%d,%.4f,%.4f,%.4f,%.5f,%.4f,%.5f,%.4f,%.4f,%d\n", (int)r + 1,
+                p.name.c_str(), p.solved, p.medianError, p.meanError, p.maxError, p.splitShift,
+                p.splitAngle, p.jitterShift, p.jitterAngle, p.meanMs, (int)p.otherResolution);
+    }
+    fclose(fp);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const BoardOps *board = findBoardOps(Size(9,6));
+    string cacheName;
+    const char *reportName = NULL;
+    bool redetect = false;
+    vector<string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+        {
+            board = parseBoardOps(argv[++i]);
+            if (board == NULL)
+            {
+                exit(-1);
+            }
+        }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            cacheName = argv[++i];
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            reportName = argv[++i];
+        }
+        else if (strcmp(argv[i], "-r") == 0)
+        {
+            redetect = true;
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+    }
+    string dataset = args.empty() ? "../src/shortVideoTestSmaller.mov" : args[0];
+    vector<string> profileFiles(args.size() > 1 ? args.begin() + 1 : args.end(), args.end());
+    if (profileFiles.empty())
+    {
+        profileFiles = {"../src/calibrationLogitech.txt", "../src/calibrationRed.txt",
+                        "../src/calibrationSixLight.txt", "../all_calibrations.txt"};
+    }
+    if (cacheName.empty())
+    {
+        //one cache per dataset and board, in the current directory
+        string base = dataset.substr(dataset.find_last_of('/') + 1);
+        replace_if(base.begin(), base.end(), [](char c) { return !isalnum(c) && c != '.'; }, '_');
+        cacheName = base + "." + to_string(board->width) + "x" + to_string(board->height) + ".corners.yml";
+    }
+
+    //detect once; later runs (e.g. with a new profile) load the corners
+    DetectionCache cache;
+    int64 start = getTickCount();
+    if (!redetect && readCache(cacheName, dataset, board, cache))
+    {
+        printf("Loaded %d detections (%d frames) from %s\n", (int)cache.frames.size(),
+               cache.frameCount, cacheName.c_str());
+    }
+    else
+    {
+        if (!detectDataset(dataset, board, cache))
+        {
+            exit(-1);
+        }
+        printf("Found the board in %d of %d frames in %.2f s\n", (int)cache.frames.size(),
+               cache.frameCount, (getTickCount() - start) / getTickFrequency());
+        if (writeCache(cacheName, cache))
+        {
+            printf("Cached the corners in %s\n", cacheName.c_str());
+        }
+        else
+        {
+            printf("Unable to write %s\n", cacheName.c_str());
+        }
+    }
+    if (cache.frames.empty())
+    {
+        printf("No frames with the board to evaluate on\n");
+        exit(-1);
+    }
+
+    vector<Profile> profiles;
+    for (size_t i = 0; i < profileFiles.size(); i++)
+    {
+        readProfiles(profileFiles[i], profiles);
+    }
+    if (profiles.empty())
+    {
+        printf("No profiles to evaluate\n");
+        exit(-1);
+    }
+
+    //every (profile, frame) pair is independent
+    int numFrames = (int)cache.frames.size();
+    vector<Point3f> boardPoints = board->pointSet();
+    for (size_t p = 0; p < profiles.size(); p++)
+    {
+        profiles[p].scores.resize(numFrames);
+    }
+    start = getTickCount();
+    parallel_for_(Range(0, (int)profiles.size() * numFrames), [&](const Range &range)
+    {
+        for (int t = range.start; t < range.end; t++)
+        {
+            Profile &p = profiles[t / numFrames];
+            scoreFrame(board, boardPoints, p, cache.frames[t % numFrames], p.scores[t % numFrames]);
+        }
+    });
+    double evalSeconds = (getTickCount() - start) / getTickFrequency();
+
+    //best first, by median reprojection error
+    vector<Profile *> ranked;
+    for (size_t p = 0; p < profiles.size(); p++)
+    {
+        summarize(profiles[p], cache);
+        ranked.push_back(&profiles[p]);
+    }
+    stable_sort(ranked.begin(), ranked.end(), [](const Profile *a, const Profile *b)
+    {
+        return a->solved > 0 && (b->solved == 0 || a->medianError < b->medianError);
+    });
+
+    printf("\n%d profiles x %d frames (%dx%d) in %.2f s\n\n", (int)profiles.size(), numFrames,
+           cache.imageSize.width, cache.imageSize.height, evalSeconds);
+    printf("%-4s %-44s %6s %22s %18s %18s %8s\n", "rank", "profile", "frames",
+           "reproj px med/mean/max", "halves sq / deg", "jitter sq / deg", "ms");
+    for (size_t r = 0; r < ranked.size(); r++)
+    {
+        const Profile &p = *ranked[r];
+        char jitter[32] = "-";
+        if (p.jitterShift >= 0)
+        {
+            snprintf(jitter, sizeof(jitter), "%.4f / %.3f", p.jitterShift, p.jitterAngle);
+        }
+        printf("%-4d %-44s %6d %6.3f/%6.3f/%7.3f %9.4f / %6.3f %18s %8.3f%s\n", (int)r + 1,
+               p.name.c_str(), p.solved, p.medianError, p.meanError, p.maxError, p.splitShift,
+               p.splitAngle, jitter, p.meanMs,
+               p.otherResolution ? "  (principal point outside the frame: other resolution?)" : "");
+    }
+    printf("\nhalves: distance between the poses from the board's left and right halves\n"
+           "jitter: distance of each pose from the midpoint of its neighbors' (video only)\n");
+
+    if (reportName != NULL && !writeReport(reportName, ranked))
+    {
+        printf("Unable to write %s\n", reportName);
+        exit(-1);
+    }
+    return 0;
+}
@@ -0,0 +1,327 @@
+/* qualityGovernor.cpp
+ * Runtime quality/frame rate trade-off for the AR loop
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include "qualityGovernor.h"
+
+using namespace std;
+using namespace cv;
+
+//each knob's levels, full quality first; level 0 of every knob is what
+//arSystem runs at without a governor, so governing never costs more
+static const int SUBPIX_LEVELS[] = {5, 2, 0};
+static const int INTERVAL_LEVELS[] = {1, 2, 4, 8};
+static const float SCALE_LEVELS[] = {1, 0.75f, 0.5f};
+static const float LOD_LEVELS[] = {1, 2, 4, 8};
+static const int DISPLAY_LEVELS[] = {1, 2, 3, 4};
+
+static const char *KNOB_NAMES[NUM_KNOBS] = {"subpix", "detectInterval", "detectScale", "lod", "display"};
+static const char *STAGE_NAMES[NUM_STAGES] = {"capture", "detect", "overlay", "display"};
+
+//which knobs each stage's time can be cut with, in the order to try them
+static const QualityKnob DETECT_KNOBS[] = {KNOB_SUBPIX, KNOB_DETECT_INTERVAL, KNOB_DETECT_SCALE};
+static const QualityKnob OVERLAY_KNOBS[] = {KNOB_LOD};
+static const QualityKnob DISPLAY_KNOBS[] = {KNOB_DISPLAY};
+
+static const double SMOOTHING = 0.1;  //weight of the newest frame in the smoothed timings
+static const int SETTLE_FRAMES = 20;  //frames after a change before judging its effect
+static const int OVER_FRAMES = 5;     //frames over budget in a row before stepping down
+static const int HOLD_FRAMES = 90;    //frames after a change before trying to step up
+static const double HEADROOM = 0.8;   //step up only below this fraction of the budget...
+static const double UP_MARGIN = 0.9;  //...and if the restored cost is predicted under this fraction
+
+QualityGovernor::QualityGovernor(double budgetMs)
+    : budgetMs(budgetMs), haveTimings(false), lastMark(0), frameNumber(0), lastChange(0),
+      framesOver(0), reportedFloor(false), log(NULL)
+{
+    for (int k = 0; k < NUM_KNOBS; k++)
+    {
+        level[k] = 0;
+        enabled[k] = true;
+    }
+    for (int s = 0; s < NUM_STAGES; s++)
+    {
+        stageMs[s] = 0;
+        frameStageMs[s] = 0;
+    }
+    apply();
+}
+
+QualityGovernor::~QualityGovernor()
+{
+    if (log != NULL)
+    {
+        fclose(log);
+    }
+}
+
+bool QualityGovernor::openLog(const char *filename)
+{
+    log = fopen(filename, "w");
+    if (log == NULL)
+    {
+        perror(filename);
+        return false;
+    }
+    fprintf(log, "frame,direction,knob,from,to,frameMs,budgetMs,captureMs,detectMs,overlayMs,displayMs,reason\n");
+    return true;
+}
+
+void QualityGovernor::disableKnob(QualityKnob knob)
+{
+    enabled[knob] = false;
+    level[knob] = 0;
+    apply();
+}
+
+double QualityGovernor::parseTarget(const char *target)
+{
+    char *end;
+    double value = strtod(target, &end);
+    if (end == target || value <= 0)
+    {
+        return 0;
+    }
+    if (strcmp(end, "ms") == 0)
+    {
+        return value;
+    }
+    return *end == '\0' ? 1000 / value : 0;
+}
+
+int QualityGovernor::numLevels(QualityKnob knob) const
+{
+    switch (knob)
+    {
+        case KNOB_SUBPIX: return sizeof(SUBPIX_LEVELS) / sizeof(SUBPIX_LEVELS[0]);
+        case KNOB_DETECT_INTERVAL: return sizeof(INTERVAL_LEVELS) / sizeof(INTERVAL_LEVELS[0]);
+        case KNOB_DETECT_SCALE: return sizeof(SCALE_LEVELS) / sizeof(SCALE_LEVELS[0]);
+        case KNOB_LOD: return sizeof(LOD_LEVELS) / sizeof(LOD_LEVELS[0]);
+        case KNOB_DISPLAY: return sizeof(DISPLAY_LEVELS) / sizeof(DISPLAY_LEVELS[0]);
+        default: return 1;
+    }
+}
+
+/**
+ * Sets the current settings from the knob levels
+ */
+void QualityGovernor::apply()
+{
+    current.subPixIterations = SUBPIX_LEVELS[level[KNOB_SUBPIX]];
+    current.detectInterval = INTERVAL_LEVELS[level[KNOB_DETECT_INTERVAL]];
+    current.detectScale = SCALE_LEVELS[level[KNOB_DETECT_SCALE]];
+    current.lodScale = LOD_LEVELS[level[KNOB_LOD]];
+    current.displayInterval = DISPLAY_LEVELS[level[KNOB_DISPLAY]];
+}
+
+/**
+ * A knob's setting at the given level, for the log
+ */
+string QualityGovernor::describe(QualityKnob knob, int atLevel) const
+{
+    ostringstream out;
+    switch (knob)
+    {
+        case KNOB_SUBPIX: out << SUBPIX_LEVELS[atLevel]; break;
+        case KNOB_DETECT_INTERVAL: out << INTERVAL_LEVELS[atLevel]; break;
+        case KNOB_DETECT_SCALE: out << SCALE_LEVELS[atLevel]; break;
+        case KNOB_LOD: out << LOD_LEVELS[atLevel]; break;
+        case KNOB_DISPLAY: out << DISPLAY_LEVELS[atLevel]; break;
+        default: break;
+    }
+    return out.str();
+}
+
+void QualityGovernor::startFrame()
+{
+    lastMark = getTickCount();
+    for (int s = 0; s < NUM_STAGES; s++)
+    {
+        frameStageMs[s] = 0;
+    }
+}
+
+void QualityGovernor::endStage(GovernorStage stage)
+{
+    int64 now = getTickCount();
+    frameStageMs[stage] += (now - lastMark) * 1000.0 / getTickFrequency();
+    lastMark = now;
+}
+
+/**
+ * Smoothed time of the stages the knobs control. Capture is left out: from a
+ * camera it is mostly waiting for the next frame, which shrinks as the other
+ * stages grow, so counting it would keep the frame at the camera's period
+ * and never show the headroom to step back up
+ */
+double QualityGovernor::frameMs() const
+{
+    double total = 0;
+    for (int s = STAGE_DETECT; s < NUM_STAGES; s++)
+    {
+        total += stageMs[s];
+    }
+    return total;
+}
+
+bool QualityGovernor::endFrame()
+{
+    for (int s = 0; s < NUM_STAGES; s++)
+    {
+        stageMs[s] = haveTimings ? stageMs[s] + SMOOTHING * (frameStageMs[s] - stageMs[s])
+                                 : frameStageMs[s];
+    }
+    haveTimings = true;
+    frameNumber++;
+
+    long sinceChange = frameNumber - lastChange;
+    if (sinceChange < SETTLE_FRAMES) //also lets the timings warm up at the start
+    {
+        return false;
+    }
+    //the last step down has settled: remember what it saved, to judge undoing it later
+    if (!steps.empty() && steps.back().savedMs < 0)
+    {
+        steps.back().savedMs = max(0.0, steps.back().frameMsBefore - frameMs());
+    }
+
+    double total = frameMs();
+    framesOver = total > budgetMs ? framesOver + 1 : 0;
+    if (framesOver >= OVER_FRAMES)
+    {
+        return stepDown();
+    }
+    if (total < HEADROOM * budgetMs && !steps.empty() && sinceChange >= HOLD_FRAMES)
+    {
+        return stepUp();
+    }
+    return false;
+}
+
+/**
+ * Lowers one knob of the most expensive stage that still has one to lower
+ */
+bool QualityGovernor::stepDown()
+{
+    double total = frameMs();
+    ostringstream reason;
+    reason.precision(3);
+
+    //nothing we lower speeds up the camera itself
+    if (stageMs[STAGE_CAPTURE] >= UP_MARGIN * budgetMs)
+    {
+        if (!reportedFloor)
+        {
+            reason << "capture alone takes " << stageMs[STAGE_CAPTURE]
+                   << " ms: the source is slower than the target";
+            record("hold", NUM_KNOBS, 0, reason.str());
+            reportedFloor = true;
+        }
+        return false;
+    }
+
+    //controllable stages, most expensive first
+    GovernorStage order[3] = {STAGE_DETECT, STAGE_OVERLAY, STAGE_DISPLAY};
+    sort(order, order + 3, [this](GovernorStage a, GovernorStage b) { return stageMs[a] > stageMs[b]; });
+    for (int i = 0; i < 3; i++)
+    {
+        const QualityKnob *knobs;
+        int numKnobs;
+        switch (order[i])
+        {
+            case STAGE_DETECT: knobs = DETECT_KNOBS; numKnobs = 3; break;
+            case STAGE_OVERLAY: knobs = OVERLAY_KNOBS; numKnobs = 1; break;
+            default: knobs = DISPLAY_KNOBS; numKnobs = 1; break;
+        }
+        for (int k = 0; k < numKnobs; k++)
+        {
+            QualityKnob knob = knobs[k];
+            if (!enabled[knob] || level[knob] + 1 >= numLevels(knob))
+            {
+                continue;
+            }
+            reason << "frame " << total << " ms over budget; " << STAGE_NAMES[order[i]] << " "
+                   << stageMs[order[i]] << " ms" << (i == 0 ? " is the largest stage" : "");
+            int from = level[knob];
+            level[knob]++;
+            apply();
+            Step step = {knob, total, -1};
+            steps.push_back(step);
+            record("lower", knob, from, reason.str());
+            lastChange = frameNumber;
+            framesOver = 0;
+            return true;
+        }
+    }
+
+    if (!reportedFloor)
+    {
+        reason << "frame " << total << " ms over budget with every knob at its lowest";
+        record("hold", NUM_KNOBS, 0, reason.str());
+        reportedFloor = true;
+    }
+    return false;
+}
+
+/**
+ * Undoes the most recent step down if the time it saved fits in the headroom
+ */
+bool QualityGovernor::stepUp()
+{
+    double total = frameMs();
+    Step step = steps.back();
+    double predicted = total + step.savedMs;
+    if (predicted >= UP_MARGIN * budgetMs)
+    {
+        return false;
+    }
+
+    ostringstream reason;
+    reason.precision(3);
+    reason << "frame " << total << " ms + " << step.savedMs << " ms saved by lowering = "
+           << predicted << " ms fits the budget";
+    int from = level[step.knob];
+    level[step.knob]--;
+    apply();
+    steps.pop_back();
+    record("raise", step.knob, from, reason.str());
+    lastChange = frameNumber;
+    reportedFloor = false;
+    return true;
+}
+
+/**
+ * Prints a decision and writes it to the log with the timings behind it
+ */
+void QualityGovernor::record(const char *direction, QualityKnob knob, int fromLevel, const string &reason)
+{
+    bool isKnob = knob < NUM_KNOBS;
+    string from = isKnob ? describe(knob, fromLevel) : "";
+    string to = isKnob ? describe(knob, level[knob]) : "";
+    if (isKnob)
+    {
+        printf("governor: frame %ld %s %s %s -> %s (%s)\n", frameNumber, direction, KNOB_NAMES[knob],
+               from.c_str(), to.c_str(), reason.c_str());
+    }
+    else
+    {
+        printf("governor: frame %ld %s (%s)\n", frameNumber, direction, reason.c_str());
+    }
+
+    if (log != NULL)
+    {
+        fprintf(log, "%ld,%s,%s,%s,%s,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,\"%s\"\n", frameNumber, direction,
+                isKnob ? KNOB_NAMES[knob] : "", from.c_str(), to.c_str(), frameMs(), budgetMs,
+                stageMs[STAGE_CAPTURE], stageMs[STAGE_DETECT], stageMs[STAGE_OVERLAY],
+                stageMs[STAGE_DISPLAY], reason.c_str());
+        fflush(log);
+    }
+}
@@ -0,0 +1,294 @@
+/* retainedRenderer.cpp
+ * Buffer-object based OpenGL mesh renderer with instancing
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include "retainedRenderer.h"
+
+using namespace std;
+using namespace cv;
+
+static const GLuint INSTANCE_ATTRIB = 10; //clear of the attributes fixed-function inputs alias
+
+//the model matrix arrives as four row attributes per instance
+static const char *instanceVertexShader =
+    "#version 120\n"
+    "attribute vec4 modelRow0;\n"
+    "attribute vec4 modelRow1;\n"
+    "attribute vec4 modelRow2;\n"
+    "attribute vec4 modelRow3;\n"
+    "varying vec2 uv;\n"
+    "varying vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "    mat4 model = transpose(mat4(modelRow0, modelRow1, modelRow2, modelRow3));\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * (model * gl_Vertex);\n"
+    "    uv = gl_MultiTexCoord0.xy;\n"
+    "    color = gl_Color;\n"
+    "}\n";
+
+//same result as the fixed-function GL_MODULATE texture environment
+static const char *instanceFragmentShader =
+    "#version 120\n"
+    "uniform sampler2D tex;\n"
+    "varying vec2 uv;\n"
+    "varying vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = color * texture2D(tex, uv);\n"
+    "}\n";
+
+MeshData makeCubeMesh(float size)
+{
+    //face normals and the four corners of each face, counterclockwise from outside
+    static const float normals[6][3] = {
+        {-1, 0, 0}, {0, 1, 0}, {1, 0, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}
+    };
+    static const float corners[6][4][3] = {
+        {{-1,-1,-1}, {-1,-1, 1}, {-1, 1, 1}, {-1, 1,-1}},
+        {{-1, 1,-1}, {-1, 1, 1}, { 1, 1, 1}, { 1, 1,-1}},
+        {{ 1, 1,-1}, { 1, 1, 1}, { 1,-1, 1}, { 1,-1,-1}},
+        {{ 1,-1,-1}, { 1,-1, 1}, {-1,-1, 1}, {-1,-1,-1}},
+        {{ 1,-1, 1}, { 1, 1, 1}, {-1, 1, 1}, {-1,-1, 1}},
+        {{ 1,-1,-1}, {-1,-1,-1}, {-1, 1,-1}, { 1, 1,-1}}
+    };
+    static const float texCoords[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+
+    MeshData mesh;
+    float half = size / 2;
+    for (int f = 0; f < 6; f++)
+    {
+        GLuint base = mesh.vertices.size();
+        for (int c = 0; c < 4; c++)
+        {
+            MeshVertex v;
+            for (int k = 0; k < 3; k++)
+            {
+                v.position[k] = corners[f][c][k] * half;
+                v.normal[k] = normals[f][k];
+            }
+            v.texCoord[0] = texCoords[c][0];
+            v.texCoord[1] = texCoords[c][1];
+            mesh.vertices.push_back(v);
+        }
+
+        //two triangles per face
+        GLuint quad[6] = {0, 1, 2, 0, 2, 3};
+        for (int k = 0; k < 6; k++)
+        {
+            mesh.indices.push_back(base + quad[k]);
+        }
+    }
+    return mesh;
+}
+
+RetainedRenderer::RetainedRenderer()
+    : drawCalls(0), trianglesDrawn(0), instanceBuffer(0), instanceProgram(0),
+      instanceAttrib(INSTANCE_ATTRIB)
+{
+}
+
+RetainedRenderer::~RetainedRenderer()
+{
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        glDeleteBuffers(1, &meshes[i].vertexBuffer);
+        glDeleteBuffers(1, &meshes[i].indexBuffer);
+    }
+    if (instanceBuffer != 0)
+    {
+        glDeleteBuffers(1, &instanceBuffer);
+    }
+    if (instanceProgram != 0)
+    {
+        glDeleteProgram(instanceProgram);
+    }
+}
+
+/**
+ * Compiles one shader stage; returns 0 and prints the log on failure
+ */
+static GLuint compileShader(GLenum type, const char *source)
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    GLint ok = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok)
+    {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        cout << "shader compile failed: " << log << "\n";
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+void RetainedRenderer::init()
+{
+    glGenBuffers(1, &instanceBuffer);
+
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+    bool canInstance = extensions != NULL &&
+                       strstr(extensions, "GL_ARB_instanced_arrays") != NULL &&
+                       strstr(extensions, "GL_ARB_draw_instanced") != NULL;
+    if (!canInstance)
+    {
+        cout << "no hardware instancing, drawing instances one by one\n";
+        return;
+    }
+
+    GLuint vs = compileShader(GL_VERTEX_SHADER, instanceVertexShader);
+    GLuint fs = compileShader(GL_FRAGMENT_SHADER, instanceFragmentShader);
+    if (vs == 0 || fs == 0)
+    {
+        return;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    glBindAttribLocation(program, INSTANCE_ATTRIB, "modelRow0");
+    glBindAttribLocation(program, INSTANCE_ATTRIB + 1, "modelRow1");
+    glBindAttribLocation(program, INSTANCE_ATTRIB + 2, "modelRow2");
+    glBindAttribLocation(program, INSTANCE_ATTRIB + 3, "modelRow3");
+    glLinkProgram(program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+
+    GLint ok = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok)
+    {
+        cout << "instancing shader failed to link, drawing instances one by one\n";
+        glDeleteProgram(program);
+        return;
+    }
+    instanceProgram = program;
+}
+
+int RetainedRenderer::uploadMesh(const MeshData &data)
+{
+    GpuMesh mesh;
+    glGenBuffers(1, &mesh.vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, data.vertices.size() * sizeof(MeshVertex),
+                 data.vertices.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(1, &mesh.indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices.size() * sizeof(GLuint),
+                 data.indices.data(), GL_STATIC_DRAW);
+    mesh.indexCount = data.indices.size();
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    meshes.push_back(mesh);
+    return meshes.size() - 1;
+}
+
+void RetainedRenderer::beginFrame()
+{
+    drawCalls = 0;
+    trianglesDrawn = 0;
+}
+
+/**
+ * Points the fixed-function vertex arrays at the mesh's buffers
+ */
+void RetainedRenderer::bindMesh(const GpuMesh &mesh)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), (void *)offsetof(MeshVertex, position));
+    glNormalPointer(GL_FLOAT, sizeof(MeshVertex), (void *)offsetof(MeshVertex, normal));
+    glTexCoordPointer(2, GL_FLOAT, sizeof(MeshVertex), (void *)offsetof(MeshVertex, texCoord));
+}
+
+void RetainedRenderer::unbindMesh()
+{
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void RetainedRenderer::draw(int meshId)
+{
+    const GpuMesh &mesh = meshes[meshId];
+    bindMesh(mesh);
+    glDrawElements(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, 0);
+    unbindMesh();
+
+    drawCalls++;
+    trianglesDrawn += mesh.indexCount / 3;
+}
+
+void RetainedRenderer::drawInstanced(int meshId, const vector<Matx44f> &instances)
+{
+    if (instances.empty())
+    {
+        return;
+    }
+
+    const GpuMesh &mesh = meshes[meshId];
+    bindMesh(mesh);
+
+    if (instanceProgram != 0)
+    {
+        //stream this frame's matrices into the instance buffer and draw them all at once
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Matx44f), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(Matx44f), instances.data());
+        for (int row = 0; row < 4; row++)
+        {
+            glEnableVertexAttribArray(instanceAttrib + row);
+            glVertexAttribPointer(instanceAttrib + row, 4, GL_FLOAT, GL_FALSE, sizeof(Matx44f),
+                                  (void *)(row * 4 * sizeof(float)));
+            glVertexAttribDivisorARB(instanceAttrib + row, 1);
+        }
+
+        glUseProgram(instanceProgram);
+        glDrawElementsInstancedARB(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, 0,
+                                   instances.size());
+        glUseProgram(0);
+
+        for (int row = 0; row < 4; row++)
+        {
+            glVertexAttribDivisorARB(instanceAttrib + row, 0);
+            glDisableVertexAttribArray(instanceAttrib + row);
+        }
+        drawCalls++;
+    }
+    else
+    {
+        //buffers stay bound, so each instance is just a matrix and one indexed call
+        glMatrixMode(GL_MODELVIEW);
+        for (size_t i = 0; i < instances.size(); i++)
+        {
+            glPushMatrix();
+            glMultTransposeMatrixf(instances[i].val); //Matx is row-major
+            glDrawElements(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, 0);
+            glPopMatrix();
+        }
+        drawCalls += instances.size();
+    }
+
+    unbindMesh();
+    trianglesDrawn += (long)instances.size() * (mesh.indexCount / 3);
+}
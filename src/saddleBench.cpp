@@ -0,0 +1,239 @@
+/* saddleBench.cpp
+ * Compares the saddle-point detector with findChessboardCorners on video or
+ * images: time per frame, how many frames each finds the board in, and how
+ * closely they agree. With -O, every frame where findChessboardCorners finds
+ * the board is run again with part of the board covered, to measure how
+ * often each detector still finds it and whether the saddle detector's
+ * corner indices are right.
+ *
+ * to compile:
+ * make saddleBench
+ *
+ * usage: ../bin/saddleBench [-b WxH] [-O] [video or images...]
+ * (default: the bundled ../src/shortVideoTestSmaller.mov)
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "opencv2/opencv.hpp"
+#include "frameCache.h"
+#include "boardGeometry.h"
+#include "saddleDetector.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Running totals for one detector
+ */
+struct DetectorStats
+{
+    vector<double> ms;
+    int found;      //frames with a board (partial counts for the saddle detector)
+    int complete;   //frames with every corner
+    long corners;   //corners returned, over all frames with a board
+
+    DetectorStats() : found(0), complete(0), corners(0) {}
+
+    double medianMs()
+    {
+        if (ms.empty())
+        {
+            return 0;
+        }
+        nth_element(ms.begin(), ms.begin() + ms.size() / 2, ms.end());
+        return ms[ms.size() / 2];
+    }
+
+    double meanMs() const
+    {
+        double total = 0;
+        for (size_t i = 0; i < ms.size(); i++)
+        {
+            total += ms[i];
+        }
+        return ms.empty() ? 0 : total / ms.size();
+    }
+};
+
+/** Milliseconds since start */
+static double msSince(int64 start)
+{
+    return (getTickCount() - start) * 1000.0 / getTickFrequency();
+}
+
+/**
+ * Median distance between the saddle corners and the reference corners
+ * with the same indices
+ */
+static double medianError(const SaddleBoard &saddle, const vector<Point2f> &reference)
+{
+    vector<double> errors;
+    for (size_t i = 0; i < saddle.corners.size(); i++)
+    {
+        errors.push_back(norm(saddle.corners[i] - reference[saddle.indices[i]]));
+    }
+    nth_element(errors.begin(), errors.begin() + errors.size() / 2, errors.end());
+    return errors[errors.size() / 2];
+}
+
+/**
+ * Runs both detectors on one grayscale frame
+ */
+static void runBoth(const Mat &gray, const BoardOps *board, SaddleDetector &saddle, FrameCache &cache,
+                    DetectorStats &chessStats, DetectorStats &saddleStats,
+                    vector<Point2f> &chessCorners, SaddleBoard &saddleBoard,
+                    bool &chessFound, bool &saddleFound)
+{
+    int64 start = getTickCount();
+    chessFound = board->detectCorners(gray, chessCorners, 0);
+    chessStats.ms.push_back(msSince(start));
+    if (chessFound)
+    {
+        chessStats.found++;
+        chessStats.complete++;
+        chessStats.corners += chessCorners.size();
+    }
+
+    //the cache is reset first so the gradients are part of the saddle detector's time
+    start = getTickCount();
+    cache.reset(gray);
+    saddleFound = saddle.detect(cache, saddleBoard);
+    saddleStats.ms.push_back(msSince(start));
+    if (saddleFound)
+    {
+        saddleStats.found++;
+        saddleStats.complete += saddleBoard.complete;
+        saddleStats.corners += saddleBoard.corners.size();
+    }
+}
+
+static void printStats(const char *name, DetectorStats &stats, int frames)
+{
+    printf("%-22s %8.2f %8.2f %7d (%5.1f%%) %9d %10.1f\n", name, stats.meanMs(), stats.medianMs(),
+           stats.found, 100.0 * stats.found / max(frames, 1), stats.complete,
+           stats.found > 0 ? (double)stats.corners / stats.found : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+    const BoardOps *board = findBoardOps(Size(9,6));
+    bool occlude = false;
+    vector<string> inputs;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+        {
+            board = parseBoardOps(argv[++i]);
+            if (board == NULL)
+            {
+                exit(-1);
+            }
+        }
+        else if (strcmp(argv[i], "-O") == 0)
+        {
+            occlude = true;
+        }
+        else
+        {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (inputs.empty())
+    {
+        inputs.push_back("../src/shortVideoTestSmaller.mov");
+    }
+
+    SaddleDetector saddle(board);
+    FrameCache cache;
+    DetectorStats chessStats, saddleStats, chessOccluded, saddleOccluded;
+    int frames = 0, saddleOnly = 0, chessOnly = 0, agreed = 0, disagreed = 0;
+    int occludedFrames = 0, occludedCorrect = 0;
+    vector<double> agreement;
+    RNG rng(365);
+    Mat frame, gray;
+    vector<Point2f> chessCorners, occludedCorners;
+    SaddleBoard saddleBoard, occludedBoard;
+
+    for (size_t f = 0; f < inputs.size(); f++)
+    {
+        VideoCapture capture;
+        bool isImage = !(frame = imread(inputs[f])).empty();
+        if (!isImage && !capture.open(inputs[f]))
+        {
+            printf("Unable to open %s\n", inputs[f].c_str());
+            continue;
+        }
+        while (isImage || capture.read(frame))
+        {
+            cvtColor(frame, gray, CV_BGR2GRAY);
+            frames++;
+            bool chessFound, saddleFound;
+            runBoth(gray, board, saddle, cache, chessStats, saddleStats, chessCorners, saddleBoard,
+                    chessFound, saddleFound);
+            saddleOnly += saddleFound && !chessFound;
+            chessOnly += chessFound && !saddleFound;
+            if (chessFound && saddleFound)
+            {
+                double error = medianError(saddleBoard, chessCorners);
+                agreement.push_back(error);
+                //more than a couple of pixels off means a corner was given the wrong index
+                if (error < 2)
+                {
+                    agreed++;
+                }
+                else
+                {
+                    disagreed++;
+                }
+            }
+
+            //cover a disc 1.5 squares across around a random corner and try again
+            if (occlude && chessFound)
+            {
+                Point2f center = chessCorners[rng.uniform(0, board->numCorners)];
+                float square = (float)norm(chessCorners[1] - chessCorners[0]);
+                Mat covered = gray.clone();
+                circle(covered, center, cvRound(1.5 * square), Scalar(rng.uniform(60, 200)), -1);
+                bool chessStill, saddleStill;
+                runBoth(covered, board, saddle, cache, chessOccluded, saddleOccluded, occludedCorners,
+                        occludedBoard, chessStill, saddleStill);
+                occludedFrames++;
+                occludedCorrect += saddleStill && medianError(occludedBoard, chessCorners) < 2;
+            }
+            if (isImage)
+            {
+                break;
+            }
+        }
+    }
+
+    printf("%d frames, %dx%d board\n\n", frames, board->width, board->height);
+    printf("%-22s %8s %8s %17s %9s %10s\n", "detector", "mean ms", "med ms", "found", "complete",
+           "corners");
+    printStats("findChessboardCorners", chessStats, frames);
+    printStats("saddle", saddleStats, frames);
+    printf("\nsaddle only: %d frames, findChessboardCorners only: %d frames\n", saddleOnly, chessOnly);
+    if (!agreement.empty())
+    {
+        sort(agreement.begin(), agreement.end());
+        printf("both found: %d agree on every index, %d don't; median corner distance %.3f px\n",
+               agreed, disagreed, agreement[agreement.size() / 2]);
+    }
+    if (occlude)
+    {
+        printf("\nwith part of the board covered (%d frames):\n", occludedFrames);
+        printStats("findChessboardCorners", chessOccluded, occludedFrames);
+        printStats("saddle", saddleOccluded, occludedFrames);
+        printf("saddle indices right in %d of %d\n", occludedCorrect, saddleOccluded.found);
+    }
+    return 0;
+}
@@ -0,0 +1,717 @@
+/* saddleDetector.cpp
+ * Saddle-point chessboard detection that tolerates partly hidden boards
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/calib3d/calib3d.hpp"
+#include "saddleDetector.h"
+
+using namespace std;
+using namespace cv;
+
+static const float RING_RADIUS = 5;     //pixels; squares must be wider than twice this
+static const int RING_SAMPLES = 16;
+static const float MIN_CONTRAST = 24;   //gray levels between the ring's lightest and darkest sample
+static const float MAX_ASYMMETRY = 0.35f; //mean difference of opposite samples, as a fraction of contrast
+static const float EDGE_TOLERANCE = 0.45f; //radians between the two halves of one edge
+static const float AXIS_TOLERANCE = 0.35f; //radians between a grid step and a saddle's edge
+static const double PEAK_FRACTION = 0.01; //peaks below this fraction of the strongest are ignored
+static const int PEAK_RADIUS = 3;       //non-maximum suppression window is 7x7
+static const int SEEDS = 8;             //strongest saddles to try growing a grid from
+static const float MIN_SQUARE_CONTRAST = 20; //gray levels between the dark and light squares
+
+/**
+ * Offsets of the ring samples around a candidate, computed on first use;
+ * detectors are built on worker threads, and a function-local static is
+ * initialized exactly once however many get there at the same time
+ */
+static const Point2f *ringOffsets()
+{
+    struct Ring
+    {
+        Point2f offset[RING_SAMPLES];
+
+        Ring()
+        {
+            for (int i = 0; i < RING_SAMPLES; i++)
+            {
+                double angle = 2 * CV_PI * i / RING_SAMPLES;
+                offset[i] = Point2f((float)(RING_RADIUS * cos(angle)), (float)(RING_RADIUS * sin(angle)));
+            }
+        }
+    };
+    static const Ring ring;
+    return ring.offset;
+}
+
+void harrisResponse(FrameCache &cache, Mat &dst, int blockSize, int apertureSize, double k)
+{
+    const Mat &dx = cache.gradX();
+    const Mat &dy = cache.gradY();
+
+    //cornerHarris normalizes 8-bit Sobel output by 1/(2^(ksize-1) * blockSize * 255)
+    double scale = 1.0 / ((1 << (apertureSize - 1)) * blockSize * 255.0);
+    double scale2 = scale * scale;
+
+    //per-pixel products of the gradients: dx*dx, dx*dy, dy*dy
+    Mat cov(dx.size(), CV_32FC3);
+    for (int i = 0; i < dx.rows; i++)
+    {
+        const float *dxRow = dx.ptr<float>(i);
+        const float *dyRow = dy.ptr<float>(i);
+        float *covRow = cov.ptr<float>(i);
+        for (int j = 0; j < dx.cols; j++)
+        {
+            covRow[j*3] = (float)(dxRow[j] * dxRow[j] * scale2);
+            covRow[j*3 + 1] = (float)(dxRow[j] * dyRow[j] * scale2);
+            covRow[j*3 + 2] = (float)(dyRow[j] * dyRow[j] * scale2);
+        }
+    }
+    boxFilter(cov, cov, cov.depth(), Size(blockSize, blockSize), Point(-1,-1), false);
+
+    //R = det(M) - k * trace(M)^2
+    dst.create(dx.size(), CV_32FC1);
+    for (int i = 0; i < cov.rows; i++)
+    {
+        const float *covRow = cov.ptr<float>(i);
+        float *dstRow = dst.ptr<float>(i);
+        for (int j = 0; j < cov.cols; j++)
+        {
+            float a = covRow[j*3];
+            float b = covRow[j*3 + 1];
+            float c = covRow[j*3 + 2];
+            dstRow[j] = (float)(a*c - b*b - k*(a + c)*(a + c));
+        }
+    }
+}
+
+/** Difference between two undirected angles, in [0, pi/2] */
+static float angleDiff(float a, float b)
+{
+    float d = fmod(fabs(a - b), (float)CV_PI);
+    return min(d, (float)CV_PI - d);
+}
+
+/** Mean of two undirected angles (averaged on the doubled-angle circle), in [0, pi) */
+static float meanAxis(float a, float b)
+{
+    float mean = 0.5f * atan2(sin(2*a) + sin(2*b), cos(2*a) + cos(2*b));
+    return mean < 0 ? mean + (float)CV_PI : mean;
+}
+
+/** Bilinear sample of an 8-bit image; (x, y) must be at least a pixel inside */
+static float sample(const Mat &gray, float x, float y)
+{
+    int xi = (int)x, yi = (int)y;
+    float fx = x - xi, fy = y - yi;
+    const uchar *row0 = gray.ptr<uchar>(yi) + xi;
+    const uchar *row1 = row0 + gray.step;
+    return (row0[0] * (1 - fx) + row0[1] * fx) * (1 - fy) + (row1[0] * (1 - fx) + row1[1] * fx) * fy;
+}
+
+/** True if the step d runs along one of the saddle's edges */
+static bool alongAxis(const SaddlePoint &s, Point2f d)
+{
+    float angle = atan2(d.y, d.x);
+    return angleDiff(angle, s.axisA) < AXIS_TOLERANCE || angleDiff(angle, s.axisB) < AXIS_TOLERANCE;
+}
+
+SaddleDetector::SaddleDetector(const BoardOps *board)
+    : minCorners(8), blockSize(5), board(board)
+{
+    gridRadius = max(board->width, board->height);
+    cellNode.assign((2 * gridRadius + 1) * (2 * gridRadius + 1), -1);
+}
+
+/**
+ * Decides from a ring of samples whether pos is an X-junction and, if so,
+ * fills in the directions of its two edges
+ */
+bool SaddleDetector::classify(const Mat &gray, Point2f pos, SaddlePoint &saddle) const
+{
+    const Point2f *ringOffset = ringOffsets();
+    float v[RING_SAMPLES];
+    float mean = 0, lo = 255, hi = 0;
+    for (int i = 0; i < RING_SAMPLES; i++)
+    {
+        v[i] = sample(gray, pos.x + ringOffset[i].x, pos.y + ringOffset[i].y);
+        mean += v[i];
+        lo = min(lo, v[i]);
+        hi = max(hi, v[i]);
+    }
+    mean /= RING_SAMPLES;
+    if (hi - lo < MIN_CONTRAST)
+    {
+        return false;
+    }
+
+    //exactly four light/dark transitions around the ring
+    int transitions[4];
+    int numTransitions = 0;
+    for (int i = 0; i < RING_SAMPLES; i++)
+    {
+        if ((v[i] > mean) != (v[(i + 1) % RING_SAMPLES] > mean))
+        {
+            if (numTransitions == 4)
+            {
+                return false;
+            }
+            transitions[numTransitions++] = i;
+        }
+    }
+    if (numTransitions != 4)
+    {
+        return false;
+    }
+
+    //opposite quadrants of an X-junction are the same color
+    float asymmetry = 0;
+    for (int i = 0; i < RING_SAMPLES / 2; i++)
+    {
+        asymmetry += fabs(v[i] - v[i + RING_SAMPLES / 2]);
+    }
+    if (asymmetry / (RING_SAMPLES / 2) > MAX_ASYMMETRY * (hi - lo))
+    {
+        return false;
+    }
+
+    //each edge crosses the ring twice, on opposite sides
+    float angles[4];
+    for (int i = 0; i < 4; i++)
+    {
+        angles[i] = (float)(2 * CV_PI * (transitions[i] + 0.5) / RING_SAMPLES);
+    }
+    if (angleDiff(angles[0], angles[2]) > EDGE_TOLERANCE || angleDiff(angles[1], angles[3]) > EDGE_TOLERANCE)
+    {
+        return false;
+    }
+    saddle.pos = pos;
+    saddle.axisA = meanAxis(angles[0], angles[2]);
+    saddle.axisB = meanAxis(angles[1], angles[3]);
+    return true;
+}
+
+/**
+ * Finds the X-junctions: Harris peaks, refined to the saddle point, that
+ * pass the ring test
+ */
+void SaddleDetector::findSaddles(FrameCache &cache)
+{
+    const Mat &gray = cache.gray();
+    harrisResponse(cache, response, blockSize, 3, 0.04);
+    double maxResponse;
+    minMaxLoc(response, NULL, &maxResponse);
+    float threshold = (float)max(maxResponse * PEAK_FRACTION, 1e-6);
+
+    //local maxima over a 7x7 window (ties go to the first in raster order)
+    peaks.clear();
+    peakPixels.clear();
+    for (int y = PEAK_RADIUS; y < response.rows - PEAK_RADIUS; y++)
+    {
+        const float *row = response.ptr<float>(y);
+        for (int x = PEAK_RADIUS; x < response.cols - PEAK_RADIUS; x++)
+        {
+            float r = row[x];
+            if (r <= threshold)
+            {
+                continue;
+            }
+            bool isPeak = true;
+            for (int dy = -PEAK_RADIUS; dy <= PEAK_RADIUS && isPeak; dy++)
+            {
+                const float *neighbors = response.ptr<float>(y + dy);
+                for (int dx = -PEAK_RADIUS; dx <= PEAK_RADIUS; dx++)
+                {
+                    float n = neighbors[x + dx];
+                    bool before = dy < 0 || (dy == 0 && dx < 0);
+                    if (n > r || (before && n == r))
+                    {
+                        isPeak = false;
+                        break;
+                    }
+                }
+            }
+            if (isPeak)
+            {
+                peaks.push_back(Point2f((float)x, (float)y));
+                peakPixels.push_back(Point(x, y));
+            }
+        }
+    }
+
+    //the Harris peak sits a few pixels off an X-junction's center; move it onto the saddle
+    points.clear();
+    if (peaks.empty())
+    {
+        return;
+    }
+    cornerSubPix(gray, peaks, Size(4,4), Size(-1,-1),
+                 TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 5, 0.01));
+    float margin = RING_RADIUS + 2;
+    for (size_t i = 0; i < peaks.size(); i++)
+    {
+        Point2f p = peaks[i];
+        Point2f moved = p - Point2f(peakPixels[i]);
+        if (fabs(moved.x) > 3.5f || fabs(moved.y) > 3.5f ||
+            p.x < margin || p.y < margin || p.x >= gray.cols - margin || p.y >= gray.rows - margin)
+        {
+            continue;
+        }
+        SaddlePoint s;
+        if (classify(gray, p, s))
+        {
+            s.response = response.at<float>(peakPixels[i]);
+            points.push_back(s);
+        }
+    }
+}
+
+/**
+ * Grows a grid outward from the seed saddle into nodes
+ */
+void SaddleDetector::growGrid(int seed)
+{
+    nodes.clear();
+    const SaddlePoint &s = points[seed];
+
+    //first steps: the nearest saddle along each of the seed's edges
+    Point2f steps[2];
+    float axes[2] = {s.axisA, s.axisB};
+    for (int a = 0; a < 2; a++)
+    {
+        float bestLength = FLT_MAX;
+        for (size_t j = 0; j < points.size(); j++)
+        {
+            Point2f d = points[j].pos - s.pos;
+            float length = (float)norm(d);
+            if ((int)j == seed || length < 2 * RING_RADIUS || length >= bestLength ||
+                angleDiff(atan2(d.y, d.x), axes[a]) > 0.3f || !alongAxis(points[j], d))
+            {
+                continue;
+            }
+            bestLength = length;
+            steps[a] = d;
+        }
+        if (bestLength == FLT_MAX)
+        {
+            return;
+        }
+    }
+    //keep the grid right-handed in the image (x then y turns clockwise), like reading order
+    if (steps[0].cross(steps[1]) < 0)
+    {
+        steps[1] = -steps[1];
+    }
+
+    fill(cellNode.begin(), cellNode.end(), -1);
+    used.assign(points.size(), 0);
+    GridNode first = {seed, 0, 0, steps[0], steps[1]};
+    nodes.push_back(first);
+    cell(0, 0) = 0;
+    used[seed] = 1;
+
+    static const int dirs[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    for (size_t q = 0; q < nodes.size(); q++)
+    {
+        GridNode n = nodes[q]; //copy: push_back below may move it
+        Point2f pos = points[n.saddle].pos;
+        for (int d = 0; d < 4; d++)
+        {
+            int dgx = dirs[d][0], dgy = dirs[d][1];
+            int gx = n.gx + dgx, gy = n.gy + dgy;
+            if (abs(gx) > gridRadius || abs(gy) > gridRadius || cell(gx, gy) >= 0)
+            {
+                continue;
+            }
+
+            //continue straight from the node behind if there is one (follows perspective)
+            Point2f step;
+            int back = (abs(n.gx - dgx) <= gridRadius && abs(n.gy - dgy) <= gridRadius) ?
+                       cell(n.gx - dgx, n.gy - dgy) : -1;
+            if (back >= 0)
+            {
+                step = pos - points[nodes[back].saddle].pos;
+            }
+            else
+            {
+                step = (dgx != 0 ? n.stepX : n.stepY) * (float)(dgx + dgy);
+            }
+            Point2f predicted = pos + step;
+            float radius2 = 0.09f * step.dot(step); //within 0.3 steps
+
+            int nearest = -1;
+            float nearest2 = radius2;
+            for (size_t j = 0; j < points.size(); j++)
+            {
+                Point2f diff = points[j].pos - predicted;
+                float dist2 = diff.dot(diff);
+                if (dist2 < nearest2)
+                {
+                    nearest2 = dist2;
+                    nearest = (int)j;
+                }
+            }
+            if (nearest < 0 || used[nearest] || !alongAxis(points[nearest], points[nearest].pos - pos))
+            {
+                continue;
+            }
+
+            Point2f actual = points[nearest].pos - pos;
+            GridNode next = {nearest, gx, gy, n.stepX, n.stepY};
+            if (dgx != 0)
+            {
+                next.stepX = actual * (float)dgx;
+            }
+            else
+            {
+                next.stepY = actual * (float)dgy;
+            }
+            cell(gx, gy) = (int)nodes.size();
+            used[nearest] = 1;
+            nodes.push_back(next);
+        }
+    }
+}
+
+/**
+ * One way of laying the grid on the board: rotated by rotation quarter
+ * turns, then shifted by (offsetX, offsetY) squares
+ */
+struct Placement
+{
+    int score;
+    int rotation;
+    int offsetX, offsetY;
+
+    bool operator<(const Placement &other) const { return score > other.score; } //best first
+};
+
+/** Rotates doubled grid coordinates by the given number of quarter turns */
+static void rotate(int rotation, int x, int y, int &rx, int &ry)
+{
+    switch (rotation & 3)
+    {
+        case 0: rx = x; ry = y; break;
+        case 1: rx = -y; ry = x; break;
+        case 2: rx = -x; ry = -y; break;
+        default: rx = y; ry = -x; break;
+    }
+}
+
+/** Board index of grid corner (gx, gy) under a placement */
+static int boardIndex(const Placement &p, int gx, int gy, int boardWidth)
+{
+    int col, row;
+    rotate(p.rotation, gx, gy, col, row);
+    return (row + p.offsetY) * boardWidth + col + p.offsetX;
+}
+
+/**
+ * Mean gray level of the 3x3 pixels around a point; false if outside the frame
+ */
+static bool cellLevel(const Mat &gray, const Matx33d &H, double gx, double gy, float &level)
+{
+    Vec3d p = H * Vec3d(gx, gy, 1);
+    if (p[2] <= 0)
+    {
+        return false;
+    }
+    int x = cvRound(p[0] / p[2]), y = cvRound(p[1] / p[2]);
+    if (x < 1 || y < 1 || x >= gray.cols - 1 || y >= gray.rows - 1)
+    {
+        return false;
+    }
+    int sum = 0;
+    for (int dy = -1; dy <= 1; dy++)
+    {
+        const uchar *row = gray.ptr<uchar>(y + dy);
+        sum += row[x - 1] + row[x] + row[x + 1];
+    }
+    level = sum / 9.0f;
+    return true;
+}
+
+/**
+ * Works out which board corner each grid node is by scoring every placement
+ * of the grid on the board against the squares around it: inside the board
+ * squares alternate dark and light (the top left one is dark), and a ring of
+ * white margin surrounds it. Fails if two placements that aren't the board's
+ * own symmetry explain the image about equally well.
+ */
+bool SaddleDetector::placeOnBoard(const Mat &gray, SaddleBoard &result)
+{
+    const int W = board->width, H = board->height;
+    int minX = INT_MAX, maxX = INT_MIN, minY = INT_MAX, maxY = INT_MIN;
+    vector<Point2f> gridPts, imagePts;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        minX = min(minX, nodes[i].gx);
+        maxX = max(maxX, nodes[i].gx);
+        minY = min(minY, nodes[i].gy);
+        maxY = max(maxY, nodes[i].gy);
+        gridPts.push_back(Point2f((float)nodes[i].gx, (float)nodes[i].gy));
+        imagePts.push_back(points[nodes[i].saddle].pos);
+    }
+    if (maxX - minX >= max(W, H) || maxY - minY >= max(W, H) || maxX == minX || maxY == minY)
+    {
+        return false;
+    }
+    Mat homography = findHomography(gridPts, imagePts, 0);
+    if (homography.empty())
+    {
+        return false;
+    }
+    Matx33d gridToImage = homography;
+
+    //dark and light levels from the squares the grid surrounds
+    float levelSum[2] = {0, 0};
+    int levelCount[2] = {0, 0};
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        int gx = nodes[i].gx, gy = nodes[i].gy;
+        if (gx == maxX || gy == maxY || cell(gx + 1, gy) < 0 || cell(gx, gy + 1) < 0 || cell(gx + 1, gy + 1) < 0)
+        {
+            continue;
+        }
+        float level;
+        if (cellLevel(gray, gridToImage, gx + 0.5, gy + 0.5, level))
+        {
+            levelSum[(gx + gy) & 1] += level;
+            levelCount[(gx + gy) & 1]++;
+        }
+    }
+    if (levelCount[0] == 0 || levelCount[1] == 0)
+    {
+        return false;
+    }
+    float mean0 = levelSum[0] / levelCount[0], mean1 = levelSum[1] / levelCount[1];
+    if (fabs(mean0 - mean1) < MIN_SQUARE_CONTRAST)
+    {
+        return false;
+    }
+    float threshold = 0.5f * (mean0 + mean1);
+
+    //squares in and two squares around the grid: (doubled center, dark?)
+    vector<Vec3i> squares;
+    for (int gy = minY - 2; gy <= maxY + 1; gy++)
+    {
+        for (int gx = minX - 2; gx <= maxX + 1; gx++)
+        {
+            float level;
+            if (cellLevel(gray, gridToImage, gx + 0.5, gy + 0.5, level))
+            {
+                squares.push_back(Vec3i(2 * gx + 1, 2 * gy + 1, level < threshold));
+            }
+        }
+    }
+
+    //score every placement that keeps the grid on the board
+    vector<Placement> placements;
+    for (int rotation = 0; rotation < 4; rotation++)
+    {
+        int cx0, cy0, cx1, cy1;
+        rotate(rotation, minX, minY, cx0, cy0);
+        rotate(rotation, maxX, maxY, cx1, cy1);
+        int minCol = min(cx0, cx1), maxCol = max(cx0, cx1);
+        int minRow = min(cy0, cy1), maxRow = max(cy0, cy1);
+        for (int ox = -minCol; ox + maxCol < W; ox++)
+        {
+            for (int oy = -minRow; oy + maxRow < H; oy++)
+            {
+                Placement p = {0, rotation, ox, oy};
+                for (size_t i = 0; i < squares.size(); i++)
+                {
+                    int rx, ry;
+                    rotate(rotation, squares[i][0], squares[i][1], rx, ry);
+                    int c = (rx + 2 * ox + 1) / 2, r = (ry + 2 * oy + 1) / 2; //square (c, r) of the (W+1)x(H+1)
+                    bool dark;
+                    if (c >= 0 && c <= W && r >= 0 && r <= H)
+                    {
+                        dark = ((c + r) & 1) == 0;
+                    }
+                    else if (c >= -1 && c <= W + 1 && r >= -1 && r <= H + 1)
+                    {
+                        dark = false; //margin
+                    }
+                    else
+                    {
+                        continue;
+                    }
+                    p.score += (dark == (squares[i][2] != 0)) ? 1 : -1;
+                }
+                placements.push_back(p);
+            }
+        }
+    }
+    if (placements.empty())
+    {
+        return false;
+    }
+    sort(placements.begin(), placements.end());
+
+    //a board with W+H even looks the same turned half way round: its twin isn't a rival
+    const Placement &best = placements[0];
+    int numCorners = board->numCorners;
+    bool symmetric = ((W + H) & 1) == 0;
+    const Placement *twin = NULL;
+    const Placement *rival = NULL;
+    for (size_t i = 1; i < placements.size() && rival == NULL; i++)
+    {
+        bool isTwin = symmetric;
+        for (size_t n = 0; n < nodes.size() && isTwin; n++)
+        {
+            isTwin = boardIndex(placements[i], nodes[n].gx, nodes[n].gy, W) ==
+                     numCorners - 1 - boardIndex(best, nodes[n].gx, nodes[n].gy, W);
+        }
+        if (isTwin)
+        {
+            twin = &placements[i];
+        }
+        else
+        {
+            rival = &placements[i];
+        }
+    }
+    if (rival != NULL && best.score - rival->score < max(2, (int)squares.size() / 8))
+    {
+        return false;
+    }
+
+    //of two twins, number from the one whose lowest index is higher up in the frame
+    const Placement *chosen = &best;
+    if (twin != NULL)
+    {
+        int lowNode = 0, highNode = 0;
+        for (size_t n = 1; n < nodes.size(); n++)
+        {
+            int index = boardIndex(best, nodes[n].gx, nodes[n].gy, W);
+            if (index < boardIndex(best, nodes[lowNode].gx, nodes[lowNode].gy, W)) lowNode = (int)n;
+            if (index > boardIndex(best, nodes[highNode].gx, nodes[highNode].gy, W)) highNode = (int)n;
+        }
+        if (points[nodes[lowNode].saddle].pos.y > points[nodes[highNode].saddle].pos.y)
+        {
+            chosen = twin;
+        }
+    }
+
+    //corners in index order
+    vector<pair<int, Point2f> > indexed;
+    for (size_t n = 0; n < nodes.size(); n++)
+    {
+        indexed.push_back(make_pair(boardIndex(*chosen, nodes[n].gx, nodes[n].gy, W),
+                                    points[nodes[n].saddle].pos));
+    }
+    sort(indexed.begin(), indexed.end(),
+         [](const pair<int, Point2f> &a, const pair<int, Point2f> &b) { return a.first < b.first; });
+    result.corners.clear();
+    result.indices.clear();
+    for (size_t i = 0; i < indexed.size(); i++)
+    {
+        result.indices.push_back(indexed[i].first);
+        result.corners.push_back(indexed[i].second);
+    }
+    result.complete = (int)result.corners.size() == numCorners;
+    return true;
+}
+
+bool SaddleDetector::detect(FrameCache &cache, SaddleBoard &result, int subPixIterations)
+{
+    result.corners.clear();
+    result.indices.clear();
+    result.complete = false;
+    findSaddles(cache);
+
+    //grow from the strongest saddles, keeping the biggest grid
+    order.resize(points.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = (int)i;
+    }
+    int numSeeds = min((int)order.size(), SEEDS);
+    partial_sort(order.begin(), order.begin() + numSeeds, order.end(),
+                 [this](int a, int b) { return points[a].response > points[b].response; });
+    bestNodes.clear();
+    for (int i = 0; i < numSeeds && (int)bestNodes.size() < board->numCorners; i++)
+    {
+        growGrid(order[i]);
+        if (nodes.size() > bestNodes.size())
+        {
+            bestNodes.swap(nodes);
+        }
+    }
+    if ((int)bestNodes.size() < max(minCorners, 4))
+    {
+        return false;
+    }
+
+    //placing needs the grid's cells filled in again
+    nodes.swap(bestNodes);
+    fill(cellNode.begin(), cellNode.end(), -1);
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        cell(nodes[i].gx, nodes[i].gy) = (int)i;
+    }
+    const Mat &gray = cache.gray();
+    if (!placeOnBoard(gray, result))
+    {
+        return false;
+    }
+
+    if (subPixIterations > 0)
+    {
+        TermCriteria criteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, subPixIterations, 0.001);
+        cornerSubPix(gray, result.corners, Size(5,5), Size(-1,-1), criteria);
+    }
+    return true;
+}
+
+bool solvePartialBoardPose(const BoardOps *board, const vector<Point2f> &corners,
+                           const vector<int> &indices, const Mat &cameraMatrix,
+                           const Mat &distCoeffs, BoardPose &pose)
+{
+    if (indices.empty())
+    {
+        return board->solvePose(corners, cameraMatrix, distCoeffs, pose);
+    }
+
+    pose.rvec = Mat::zeros(1, 3, CV_64F);
+    pose.tvec = Mat::zeros(1, 3, CV_64F);
+    pose.reprojError = 0;
+    pose.found = corners.size() >= 6 && corners.size() == indices.size();
+    if (!pose.found)
+    {
+        return false;
+    }
+
+    vector<Point3f> objectPoints;
+    objectPoints.reserve(indices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        const BoardPoint &p = board->objectPoints[indices[i]];
+        objectPoints.push_back(Point3f(p.x, p.y, p.z));
+    }
+    solvePnP(objectPoints, corners, cameraMatrix, distCoeffs, pose.rvec, pose.tvec);
+
+    vector<Point2f> projected;
+    projectPoints(objectPoints, pose.rvec, pose.tvec, cameraMatrix, distCoeffs, projected);
+    double sum = 0;
+    for (size_t i = 0; i < corners.size(); i++)
+    {
+        Point2f d = corners[i] - projected[i];
+        sum += d.dot(d);
+    }
+    pose.reprojError = sqrt(sum / corners.size());
+    if (&pose.corners != &corners)
+    {
+        pose.corners = corners;
+    }
+    return true;
+}
@@ -0,0 +1,482 @@
+/* scene.cpp
+ * Scene file loading, frustum culling, level of detail and projection
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <unordered_map>
+#include "scene.h"
+#include "opencv2/calib3d/calib3d.hpp"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Sorts the edges, makes each one low index first and removes duplicates
+ * (neighboring faces share their edges)
+ */
+static void uniqueEdges(vector<Vec2i> &edges)
+{
+    vector<uint64_t> keys;
+    keys.reserve(edges.size());
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        int a = min(edges[i][0], edges[i][1]);
+        int b = max(edges[i][0], edges[i][1]);
+        if (a != b)
+        {
+            keys.push_back(((uint64_t)a << 32) | (uint32_t)b);
+        }
+    }
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+
+    edges.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        edges[i] = Vec2i((int)(keys[i] >> 32), (int)(keys[i] & 0xffffffff));
+    }
+}
+
+bool loadObjWireframe(const string &filename, SceneLOD &lod)
+{
+    ifstream objFile(filename);
+    if (!objFile.is_open())
+    {
+        cout << "Unable to open mesh file " << filename << "\n";
+        return false;
+    }
+
+    lod.vertices.clear();
+    lod.edges.clear();
+    lod.cellSize = 0;
+    string line;
+    vector<int> polygon;
+    while (getline(objFile, line))
+    {
+        istringstream tokens(line);
+        string type;
+        tokens >> type;
+        if (type == "v")
+        {
+            Point3f v;
+            tokens >> v.x >> v.y >> v.z;
+            lod.vertices.push_back(v);
+        }
+        else if (type == "f" || type == "l")
+        {
+            //indices are 1-based, or negative to count back from the latest vertex;
+            //only the position index of "v/vt/vn" matters here
+            polygon.clear();
+            string token;
+            while (tokens >> token)
+            {
+                int index = atoi(token.c_str());
+                index = index < 0 ? (int)lod.vertices.size() + index : index - 1;
+                if (index < 0 || index >= (int)lod.vertices.size())
+                {
+                    cout << "Bad vertex index " << token << " in " << filename << "\n";
+                    return false;
+                }
+                polygon.push_back(index);
+            }
+            for (size_t i = 0; i + 1 < polygon.size(); i++)
+            {
+                lod.edges.push_back(Vec2i(polygon[i], polygon[i + 1]));
+            }
+            if (type == "f" && polygon.size() > 2)
+            {
+                lod.edges.push_back(Vec2i(polygon.back(), polygon[0]));
+            }
+        }
+    }
+
+    uniqueEdges(lod.edges);
+    if (lod.edges.empty())
+    {
+        cout << "No faces or lines in " << filename << "\n";
+        return false;
+    }
+    return true;
+}
+
+SceneLOD simplifyWireframe(const SceneLOD &lod, float cellSize)
+{
+    Point3f low = lod.vertices[0];
+    for (size_t i = 1; i < lod.vertices.size(); i++)
+    {
+        low.x = min(low.x, lod.vertices[i].x);
+        low.y = min(low.y, lod.vertices[i].y);
+        low.z = min(low.z, lod.vertices[i].z);
+    }
+
+    //one merged vertex per occupied cell, at the average of the vertices in it
+    SceneLOD coarse;
+    coarse.cellSize = cellSize;
+    unordered_map<uint64_t, int> cellIndex;
+    vector<int> remap(lod.vertices.size());
+    vector<int> counts;
+    for (size_t i = 0; i < lod.vertices.size(); i++)
+    {
+        const Point3f &v = lod.vertices[i];
+        uint64_t key = ((uint64_t)((v.x - low.x) / cellSize) << 42) |
+                       ((uint64_t)((v.y - low.y) / cellSize) << 21) |
+                        (uint64_t)((v.z - low.z) / cellSize);
+        auto found = cellIndex.find(key);
+        if (found == cellIndex.end())
+        {
+            found = cellIndex.insert(make_pair(key, (int)coarse.vertices.size())).first;
+            coarse.vertices.push_back(Point3f(0, 0, 0));
+            counts.push_back(0);
+        }
+        remap[i] = found->second;
+        coarse.vertices[found->second] += v;
+        counts[found->second]++;
+    }
+    for (size_t i = 0; i < coarse.vertices.size(); i++)
+    {
+        coarse.vertices[i] *= 1.f / counts[i];
+    }
+
+    coarse.edges.resize(lod.edges.size());
+    for (size_t i = 0; i < lod.edges.size(); i++)
+    {
+        coarse.edges[i] = Vec2i(remap[lod.edges[i][0]], remap[lod.edges[i][1]]);
+    }
+    uniqueEdges(coarse.edges); //also drops the edges that collapsed to a point
+    return coarse;
+}
+
+/**
+ * Average edge length, used as the detail scale of an authored coarse level
+ */
+static float meanEdgeLength(const SceneLOD &lod)
+{
+    double total = 0;
+    for (size_t i = 0; i < lod.edges.size(); i++)
+    {
+        Point3f d = lod.vertices[lod.edges[i][0]] - lod.vertices[lod.edges[i][1]];
+        total += sqrt(d.dot(d));
+    }
+    return lod.edges.empty() ? 0 : (float)(total / lod.edges.size());
+}
+
+/**
+ * Fills in a mesh's bounding sphere and, if it has only one level, generates
+ * coarser ones while they still remove a good share of the edges
+ */
+static void finishMesh(SceneMesh &mesh)
+{
+    const vector<Point3f> &v = mesh.lods[0].vertices;
+    Point3f low = v[0], high = v[0];
+    for (size_t i = 1; i < v.size(); i++)
+    {
+        low = Point3f(min(low.x, v[i].x), min(low.y, v[i].y), min(low.z, v[i].z));
+        high = Point3f(max(high.x, v[i].x), max(high.y, v[i].y), max(high.z, v[i].z));
+    }
+    mesh.center = (low + high) * 0.5f;
+    mesh.radius = 0;
+    for (size_t i = 0; i < v.size(); i++)
+    {
+        Point3f d = v[i] - mesh.center;
+        mesh.radius = max(mesh.radius, (float)sqrt(d.dot(d)));
+    }
+
+    if (mesh.lods.size() > 1)
+    {
+        for (size_t l = 1; l < mesh.lods.size(); l++)
+        {
+            mesh.lods[l].cellSize = meanEdgeLength(mesh.lods[l]);
+        }
+        return;
+    }
+
+    float extent = max(high.x - low.x, max(high.y - low.y, high.z - low.z));
+    const float divisions[3] = {64, 16, 4};
+    for (int i = 0; i < 3 && extent > 0; i++)
+    {
+        SceneLOD coarse = simplifyWireframe(mesh.lods.back(), extent / divisions[i]);
+        if (coarse.edges.empty() || coarse.edges.size() > mesh.lods.back().edges.size() * 0.7)
+        {
+            continue; //not worth a level of its own
+        }
+        mesh.lods.push_back(coarse);
+    }
+}
+
+Scene::Scene()
+    : lodPixelError(4), minPixelSize(1), nearPlane(0.1f)
+{
+}
+
+int Scene::findMesh(const string &name) const
+{
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        if (meshes[i].name == name)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Rotation about x, then y, then z, by the given angles in degrees
+ */
+static Matx33f eulerRotation(float rx, float ry, float rz)
+{
+    float a = rx * (float)CV_PI / 180, b = ry * (float)CV_PI / 180, c = rz * (float)CV_PI / 180;
+    Matx33f x(1, 0, 0,  0, cos(a), -sin(a),  0, sin(a), cos(a));
+    Matx33f y(cos(b), 0, sin(b),  0, 1, 0,  -sin(b), 0, cos(b));
+    Matx33f z(cos(c), -sin(c), 0,  sin(c), cos(c), 0,  0, 0, 1);
+    return z * y * x;
+}
+
+bool Scene::load(const string &manifestFile)
+{
+    ifstream manifest(manifestFile);
+    if (!manifest.is_open())
+    {
+        cout << "Unable to open scene file " << manifestFile << "\n";
+        return false;
+    }
+    size_t slash = manifestFile.find_last_of('/');
+    string dir = slash == string::npos ? "" : manifestFile.substr(0, slash + 1);
+
+    meshes.clear();
+    objects.clear();
+    string line;
+    int lineNumber = 0;
+    while (getline(manifest, line))
+    {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        istringstream tokens(line);
+        string type;
+        if (!(tokens >> type))
+        {
+            continue; //blank or comment
+        }
+
+        if (type == "mesh")
+        {
+            SceneMesh mesh;
+            string file;
+            tokens >> mesh.name;
+            while (tokens >> file)
+            {
+                SceneLOD lod;
+                if (!loadObjWireframe(file[0] == '/' ? file : dir + file, lod))
+                {
+                    return false;
+                }
+                mesh.lods.push_back(lod);
+            }
+            if (mesh.lods.empty())
+            {
+                cout << manifestFile << ":" << lineNumber << ": mesh needs a name and an OBJ file\n";
+                return false;
+            }
+            finishMesh(mesh);
+            meshes.push_back(mesh);
+        }
+        else if (type == "object")
+        {
+            string meshName;
+            float x, y, z;
+            if (!(tokens >> meshName >> x >> y >> z))
+            {
+                cout << manifestFile << ":" << lineNumber << ": object needs a mesh and a position\n";
+                return false;
+            }
+            SceneObject obj;
+            obj.mesh = findMesh(meshName);
+            if (obj.mesh < 0)
+            {
+                cout << manifestFile << ":" << lineNumber << ": unknown mesh " << meshName << "\n";
+                return false;
+            }
+
+            //optional fields, in order; the first one missing leaves the rest at their defaults
+            float rx = 0, ry = 0, rz = 0, scale = 1, b = 0, g = 255, r = 0;
+            int thickness = 2;
+            tokens >> rx >> ry >> rz >> scale >> b >> g >> r >> thickness;
+            obj.transform = eulerRotation(rx, ry, rz) * scale;
+            obj.position = Vec3f(x, y, z);
+            obj.scale = scale;
+            obj.color = Scalar(b, g, r);
+            obj.thickness = thickness;
+            objects.push_back(obj);
+        }
+        else
+        {
+            cout << manifestFile << ":" << lineNumber << ": unknown entry " << type << "\n";
+            return false;
+        }
+    }
+
+    cout << "Loaded scene: " << meshes.size() << " meshes, " << objects.size() << " objects\n";
+    return true;
+}
+
+void Scene::draw(DrawList &overlay, SceneWorkspace &work, const Mat &rvec, const Mat &tvec,
+                 const Mat &cameraMatrix, const Mat &distCoeffs, Size imageSize) const
+{
+    Mat rotationMat;
+    Rodrigues(rvec, rotationMat);
+    Matx33f rotation = rotationMat;
+    Vec3f translation(tvec.at<double>(0), tvec.at<double>(1), tvec.at<double>(2));
+    float fx = cameraMatrix.at<double>(0, 0), fy = cameraMatrix.at<double>(1, 1);
+    float cx = cameraMatrix.at<double>(0, 2), cy = cameraMatrix.at<double>(1, 2);
+
+    //side planes of the viewing frustum through the camera center, facing inward;
+    //widened a little since distortion can pull points in from just outside
+    float margin = 0.05f;
+    float xMin = (-margin * imageSize.width - cx) / fx;
+    float xMax = ((1 + margin) * imageSize.width - cx) / fx;
+    float yMin = (-margin * imageSize.height - cy) / fy;
+    float yMax = ((1 + margin) * imageSize.height - cy) / fy;
+    Vec3f planes[4] = {normalize(Vec3f(1, 0, -xMin)), normalize(Vec3f(-1, 0, xMax)),
+                       normalize(Vec3f(0, 1, -yMin)), normalize(Vec3f(0, -1, yMax))};
+
+    //cull and pick a level for every object: -1 outside the frustum, -2 too small
+    int numObjects = (int)objects.size();
+    float maxError = lodPixelError * work.lodScale;
+    work.lodChoice.resize(numObjects);
+    parallel_for_(Range(0, numObjects), [&](const Range &range)
+    {
+        for (int i = range.start; i < range.end; i++)
+        {
+            const SceneObject &obj = objects[i];
+            const SceneMesh &mesh = meshes[obj.mesh];
+            Vec3f center = rotation * (obj.transform * Vec3f(mesh.center) + obj.position) + translation;
+            float radius = mesh.radius * obj.scale;
+
+            bool inside = center[2] > nearPlane - radius;
+            for (int p = 0; p < 4 && inside; p++)
+            {
+                inside = planes[p].dot(center) >= -radius;
+            }
+            if (!inside)
+            {
+                work.lodChoice[i] = -1;
+                continue;
+            }
+
+            float pixelsPerUnit = fx * obj.scale / max(center[2], nearPlane);
+            if (2 * mesh.radius * pixelsPerUnit < minPixelSize)
+            {
+                work.lodChoice[i] = -2;
+                continue;
+            }
+            int level = (int)mesh.lods.size() - 1;
+            while (level > 0 && mesh.lods[level].cellSize * pixelsPerUnit > maxError)
+            {
+                level--;
+            }
+            work.lodChoice[i] = level;
+        }
+    });
+
+    //lay out the surviving objects' vertices one after another
+    SceneStats &stats = work.stats;
+    stats = SceneStats();
+    stats.objects = numObjects;
+    work.pointOffsets.resize(numObjects + 1);
+    int total = 0;
+    for (int i = 0; i < numObjects; i++)
+    {
+        work.pointOffsets[i] = total;
+        int level = work.lodChoice[i];
+        if (level == -1)
+        {
+            stats.outsideFrustum++;
+            continue;
+        }
+        if (level == -2)
+        {
+            stats.tooSmall++;
+            continue;
+        }
+        const SceneLOD &lod = meshes[objects[i].mesh].lods[level];
+        total += (int)lod.vertices.size();
+        stats.drawn++;
+        stats.edges += (int)lod.edges.size();
+        stats.lodCounts[min(level, 3)]++;
+    }
+    work.pointOffsets[numObjects] = total;
+    if (total == 0)
+    {
+        return;
+    }
+
+    //to camera coordinates, then project in parallel chunks (distortion and all)
+    work.camPoints.resize(total);
+    work.imgPoints.resize(total);
+    parallel_for_(Range(0, numObjects), [&](const Range &range)
+    {
+        for (int i = range.start; i < range.end; i++)
+        {
+            if (work.lodChoice[i] < 0)
+            {
+                continue;
+            }
+            const SceneObject &obj = objects[i];
+            const SceneLOD &lod = meshes[obj.mesh].lods[work.lodChoice[i]];
+            Matx33f m = rotation * obj.transform;
+            Vec3f t = rotation * obj.position + translation;
+            Point3f *out = &work.camPoints[work.pointOffsets[i]];
+            for (size_t v = 0; v < lod.vertices.size(); v++)
+            {
+                Vec3f p = m * Vec3f(lod.vertices[v]) + t;
+                out[v] = Point3f(p[0], p[1], p[2]);
+            }
+        }
+    });
+    Mat zero = Mat::zeros(3, 1, CV_64F);
+    const int chunk = 4096;
+    parallel_for_(Range(0, (total + chunk - 1) / chunk), [&](const Range &range)
+    {
+        vector<Point3f> in;
+        vector<Point2f> out;
+        for (int c = range.start; c < range.end; c++)
+        {
+            int start = c * chunk;
+            int end = min(start + chunk, total);
+            in.assign(work.camPoints.begin() + start, work.camPoints.begin() + end);
+            projectPoints(in, zero, zero, cameraMatrix, distCoeffs, out);
+            copy(out.begin(), out.end(), work.imgPoints.begin() + start);
+        }
+    });
+
+    //queue the edges, skipping any that reach behind the near plane
+    for (int i = 0; i < numObjects; i++)
+    {
+        if (work.lodChoice[i] < 0)
+        {
+            continue;
+        }
+        const SceneObject &obj = objects[i];
+        const SceneLOD &lod = meshes[obj.mesh].lods[work.lodChoice[i]];
+        int base = work.pointOffsets[i];
+        for (size_t e = 0; e < lod.edges.size(); e++)
+        {
+            int a = base + lod.edges[e][0], b = base + lod.edges[e][1];
+            if (work.camPoints[a].z < nearPlane || work.camPoints[b].z < nearPlane)
+            {
+                continue;
+            }
+            overlay.addSegment(work.imgPoints[a], work.imgPoints[b], obj.color, obj.thickness);
+        }
+    }
+}
@@ -0,0 +1,384 @@
+/* sparseCalibration.cpp
+ * Schur-complement Levenberg-Marquardt calibration for planar boards
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <cmath>
+#include "opencv2/calib3d/calib3d.hpp"
+#include "sparseCalibration.h"
+
+using namespace std;
+using namespace cv;
+
+//intrinsics: f, cx, cy, k1, k2, p1, p2, k3; pose: rvec, tvec
+const int NUM_INTRINSICS = 8;
+const int NUM_POSE = 6;
+
+typedef Matx<double, NUM_INTRINSICS, NUM_INTRINSICS> IntrinsicMat;
+typedef Matx<double, NUM_INTRINSICS, NUM_POSE> CrossMat;
+typedef Vec<double, NUM_INTRINSICS> IntrinsicVec;
+
+/**
+ * One view's share of the normal equations, [U W; W^T V] [da; db] = -[ea; eb]
+ */
+struct ViewBlocks
+{
+    IntrinsicMat U;
+    Matx66d V;
+    CrossMat W;
+    IntrinsicVec ea;
+    Vec6d eb;
+    double cost; //sum of squared residuals
+
+    //filled in while solving a step
+    Matx66d Vinv;
+    CrossMat Y; //W * Vinv
+};
+
+static Mat makeCameraMatrix(const IntrinsicVec &a, double aspect)
+{
+    return (Mat_<double>(3, 3) << a[0], 0, a[1], 0, a[0] * aspect, a[2], 0, 0, 1);
+}
+
+static Mat makeDistCoeffs(const IntrinsicVec &a)
+{
+    return (Mat_<double>(5, 1) << a[3], a[4], a[5], a[6], a[7]);
+}
+
+/**
+ * Sum of squared residuals of one view, and optionally its blocks of the
+ * normal equations (projectPoints provides the analytic Jacobian)
+ */
+static double evaluateView(const vector<Point3d> &objectPoints, const vector<Point2d> &imagePoints,
+                           const IntrinsicVec &a, double aspect, const Vec6d &pose,
+                           ViewBlocks *blocks)
+{
+    Mat K = makeCameraMatrix(a, aspect);
+    Mat D = makeDistCoeffs(a);
+    Mat rvec = (Mat_<double>(3, 1) << pose[0], pose[1], pose[2]);
+    Mat tvec = (Mat_<double>(3, 1) << pose[3], pose[4], pose[5]);
+    vector<Point2d> projected;
+    Mat jacobian;
+    if (blocks == NULL)
+    {
+        projectPoints(objectPoints, rvec, tvec, K, D, projected);
+    }
+    else
+    {
+        projectPoints(objectPoints, rvec, tvec, K, D, projected, jacobian);
+        blocks->U = IntrinsicMat::zeros();
+        blocks->V = Matx66d::zeros();
+        blocks->W = CrossMat::zeros();
+        blocks->ea = IntrinsicVec::all(0);
+        blocks->eb = Vec6d::all(0);
+    }
+
+    double cost = 0;
+    for (size_t n = 0; n < projected.size(); n++)
+    {
+        double res[2] = {projected[n].x - imagePoints[n].x, projected[n].y - imagePoints[n].y};
+        cost += res[0] * res[0] + res[1] * res[1];
+        if (blocks == NULL)
+        {
+            continue;
+        }
+
+        //jacobian columns: rvec, tvec, fx, fy, cx, cy, k1 k2 p1 p2 k3
+        for (int row = 0; row < 2; row++)
+        {
+            const double *J = jacobian.ptr<double>(2 * (int)n + row);
+            double ja[NUM_INTRINSICS] = {J[6] + aspect * J[7], J[8], J[9], J[10], J[11], J[12], J[13], J[14]};
+            const double *jb = J;
+            for (int i = 0; i < NUM_INTRINSICS; i++)
+            {
+                for (int j = i; j < NUM_INTRINSICS; j++)
+                {
+                    blocks->U(i, j) += ja[i] * ja[j];
+                }
+                for (int j = 0; j < NUM_POSE; j++)
+                {
+                    blocks->W(i, j) += ja[i] * jb[j];
+                }
+                blocks->ea[i] += ja[i] * res[row];
+            }
+            for (int i = 0; i < NUM_POSE; i++)
+            {
+                for (int j = i; j < NUM_POSE; j++)
+                {
+                    blocks->V(i, j) += jb[i] * jb[j];
+                }
+                blocks->eb[i] += jb[i] * res[row];
+            }
+        }
+    }
+
+    if (blocks != NULL)
+    {
+        //only the upper triangles were accumulated
+        for (int i = 0; i < NUM_INTRINSICS; i++)
+        {
+            for (int j = 0; j < i; j++)
+            {
+                blocks->U(i, j) = blocks->U(j, i);
+            }
+        }
+        for (int i = 0; i < NUM_POSE; i++)
+        {
+            for (int j = 0; j < i; j++)
+            {
+                blocks->V(i, j) = blocks->V(j, i);
+            }
+        }
+        blocks->cost = cost;
+    }
+    return cost;
+}
+
+/**
+ * Focal length from the views' homographies with the principal point at the
+ * image center (Zhang's method with one focal length), as calibrateCamera
+ * starts from; falls back to the image size if the views can't tell
+ */
+static double initialFocalLength(const vector<vector<Point3f> > &objectPoints,
+                                 const vector<vector<Point2f> > &imagePoints, Size imageSize)
+{
+    double cx = (imageSize.width - 1) * 0.5, cy = (imageSize.height - 1) * 0.5;
+    double num = 0, den = 0;
+    for (size_t v = 0; v < objectPoints.size(); v++)
+    {
+        vector<Point2f> planar(objectPoints[v].size());
+        for (size_t n = 0; n < planar.size(); n++)
+        {
+            planar[n] = Point2f(objectPoints[v][n].x, objectPoints[v][n].y);
+        }
+        Mat H = findHomography(planar, imagePoints[v]);
+        if (H.empty())
+        {
+            continue;
+        }
+
+        //move the principal point to the origin, then the columns h1, h2 (and
+        //their sum and difference) must be orthogonal under diag(1/f^2, 1/f^2, 1).
+        //The sum and difference are orthogonal only if h1 and h2 have equal norms
+        //under that metric, which holds only at the homography's own common
+        //scale, so both are divided by the same factor
+        Matx33d centered = Matx33d(1, 0, -cx, 0, 1, -cy, 0, 0, 1) * Matx33d(H);
+        Vec3d h1(centered(0, 0), centered(1, 0), centered(2, 0));
+        Vec3d h2(centered(0, 1), centered(1, 1), centered(2, 1));
+        double scale = sqrt(norm(h1) * norm(h2));
+        h1 /= scale;
+        h2 /= scale;
+        Vec3d pairs[2][2] = {{h1, h2}, {(h1 + h2) * 0.5, (h1 - h2) * 0.5}};
+        for (int p = 0; p < 2; p++)
+        {
+            const Vec3d &a = pairs[p][0], &b = pairs[p][1];
+            double coef = a[0] * b[0] + a[1] * b[1];
+            num += coef * -(a[2] * b[2]);
+            den += coef * coef;
+        }
+    }
+    double invF2 = den > 0 ? num / den : 0;
+    return invF2 > 0 ? 1 / sqrt(invF2) : max(imageSize.width, imageSize.height);
+}
+
+double calibrateSparse(const vector<vector<Point3f> > &objectPoints,
+                       const vector<vector<Point2f> > &imagePoints,
+                       Size imageSize, Mat &cameraMatrix, Mat &distCoeffs,
+                       vector<Mat> &rvecs, vector<Mat> &tvecs,
+                       const SparseCalibrationOptions &options, SparseCalibrationReport *report)
+{
+    CV_Assert(objectPoints.size() == imagePoints.size() && !objectPoints.empty());
+    int numViews = (int)objectPoints.size();
+    int totalPoints = 0;
+    for (int v = 0; v < numViews; v++)
+    {
+        CV_Assert(objectPoints[v].size() == imagePoints[v].size());
+        totalPoints += (int)objectPoints[v].size();
+    }
+
+    //in double, so the projections (and the error) are too: in float the
+    //error stops going down well before the parameters settle
+    vector<vector<Point3d> > objects(numViews);
+    vector<vector<Point2d> > images(numViews);
+    for (int v = 0; v < numViews; v++)
+    {
+        Mat(objectPoints[v]).convertTo(objects[v], CV_64F);
+        Mat(imagePoints[v]).convertTo(images[v], CV_64F);
+    }
+
+    //starting intrinsics: the given ones, or the focal length from the homographies
+    IntrinsicVec a = IntrinsicVec::all(0);
+    double aspect = 1;
+    if (options.useInitialGuess)
+    {
+        Mat K, D;
+        cameraMatrix.convertTo(K, CV_64F);
+        distCoeffs.convertTo(D, CV_64F);
+        aspect = K.at<double>(1, 1) / K.at<double>(0, 0);
+        a[0] = K.at<double>(0, 0);
+        a[1] = K.at<double>(0, 2);
+        a[2] = K.at<double>(1, 2);
+        for (int i = 0; i < min(5, (int)D.total()); i++)
+        {
+            a[3 + i] = D.at<double>(i);
+        }
+    }
+    else
+    {
+        a[0] = initialFocalLength(objectPoints, imagePoints, imageSize);
+        a[1] = (imageSize.width - 1) * 0.5;
+        a[2] = (imageSize.height - 1) * 0.5;
+    }
+
+    //starting poses from the starting intrinsics
+    vector<Vec6d> poses(numViews);
+    {
+        Mat K = makeCameraMatrix(a, aspect), D = makeDistCoeffs(a);
+        parallel_for_(Range(0, numViews), [&](const Range &range)
+        {
+            for (int v = range.start; v < range.end; v++)
+            {
+                Mat rvec, tvec;
+                solvePnP(objectPoints[v], imagePoints[v], K, D, rvec, tvec);
+                for (int i = 0; i < 3; i++)
+                {
+                    poses[v][i] = rvec.at<double>(i);
+                    poses[v][3 + i] = tvec.at<double>(i);
+                }
+            }
+        });
+    }
+
+    vector<ViewBlocks> blocks(numViews);
+    vector<Vec6d> trialPoses(numViews);
+    vector<double> trialCosts(numViews);
+    double lambda = 1e-3;
+    double cost = 0;
+    bool linearize = true;
+    int iter = 0;
+    double initialCost = -1;
+    for (; iter < options.maxIterations; iter++)
+    {
+        if (linearize)
+        {
+            parallel_for_(Range(0, numViews), [&](const Range &range)
+            {
+                for (int v = range.start; v < range.end; v++)
+                {
+                    evaluateView(objects[v], images[v], a, aspect, poses[v], &blocks[v]);
+                }
+            });
+            cost = 0;
+            for (int v = 0; v < numViews; v++)
+            {
+                cost += blocks[v].cost;
+            }
+            if (initialCost < 0)
+            {
+                initialCost = cost;
+            }
+            linearize = false;
+        }
+
+        //eliminate each pose (damped), leaving the intrinsic system S da = g
+        parallel_for_(Range(0, numViews), [&](const Range &range)
+        {
+            for (int v = range.start; v < range.end; v++)
+            {
+                ViewBlocks &b = blocks[v];
+                Matx66d damped = b.V;
+                for (int i = 0; i < NUM_POSE; i++)
+                {
+                    damped(i, i) += lambda * b.V(i, i) + 1e-12;
+                }
+                b.Vinv = damped.inv(DECOMP_CHOLESKY);
+                b.Y = b.W * b.Vinv;
+            }
+        });
+        IntrinsicMat S = IntrinsicMat::zeros();
+        IntrinsicMat U = IntrinsicMat::zeros();
+        IntrinsicVec g = IntrinsicVec::all(0);
+        for (int v = 0; v < numViews; v++)
+        {
+            const ViewBlocks &b = blocks[v];
+            U += b.U;
+            S += b.U - b.Y * b.W.t();
+            g += b.Y * b.eb - b.ea;
+        }
+        for (int i = 0; i < NUM_INTRINSICS; i++)
+        {
+            S(i, i) += lambda * U(i, i) + 1e-12;
+        }
+        Mat daMat;
+        if (!solve(Mat(S), Mat(g), daMat, DECOMP_CHOLESKY))
+        {
+            lambda *= 10;
+            continue;
+        }
+        IntrinsicVec da(daMat.ptr<double>());
+
+        //back-substitute each pose step and measure the trial point
+        IntrinsicVec trial = a + da;
+        parallel_for_(Range(0, numViews), [&](const Range &range)
+        {
+            for (int v = range.start; v < range.end; v++)
+            {
+                const ViewBlocks &b = blocks[v];
+                Vec6d db = b.Vinv * (-b.eb - b.W.t() * da);
+                trialPoses[v] = poses[v] + db;
+                trialCosts[v] = evaluateView(objects[v], images[v], trial, aspect, trialPoses[v], NULL);
+            }
+        });
+        double trialCost = 0;
+        for (int v = 0; v < numViews; v++)
+        {
+            trialCost += trialCosts[v];
+        }
+
+        if (trialCost < cost)
+        {
+            double decrease = (cost - trialCost) / cost;
+            a = trial;
+            poses.swap(trialPoses);
+            cost = trialCost;
+            lambda = max(lambda * 0.1, 1e-12);
+            linearize = true;
+            if (decrease < options.epsilon)
+            {
+                iter++;
+                break;
+            }
+        }
+        else
+        {
+            lambda *= 10;
+            if (lambda > 1e16) //no step helps: at the minimum
+            {
+                iter++;
+                break;
+            }
+        }
+    }
+
+    cameraMatrix = makeCameraMatrix(a, aspect);
+    distCoeffs = makeDistCoeffs(a);
+    rvecs.resize(numViews);
+    tvecs.resize(numViews);
+    for (int v = 0; v < numViews; v++)
+    {
+        rvecs[v] = (Mat_<double>(3, 1) << poses[v][0], poses[v][1], poses[v][2]);
+        tvecs[v] = (Mat_<double>(3, 1) << poses[v][3], poses[v][4], poses[v][5]);
+    }
+
+    double rms = sqrt(cost / totalPoints);
+    if (report != NULL)
+    {
+        report->iterations = iter;
+        report->initialError = sqrt(initialCost / totalPoints);
+        report->finalError = rms;
+    }
+    return rms;
+}
@@ -0,0 +1,237 @@
+/* subPixCheck.cpp
+ * Checks SubPixRefiner against cornerSubPix (same window, 40 iterations,
+ * epsilon 0.001). Given images, it refines each detected board both ways and
+ * reports how far apart the results are. Without images, it renders a moving
+ * sequence of views of data/checkerboard.png with blur and noise, where the
+ * true corners are known, and also reports each method's error and how much
+ * the warm start saves.
+ *
+ * (frames saved by calibration have the detected corners drawn on them, so
+ * they are only useful for comparing the two methods, not for accuracy)
+ *
+ * to compile:
+ * make subPixCheck
+ *
+ * usage: ../bin/subPixCheck [-b WxH] [image...]
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "opencv2/opencv.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/calib3d/calib3d.hpp"
+#include "boardGeometry.h"
+#include "subPixRefiner.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Running totals of the distances between two corner lists
+ */
+struct Distances
+{
+    double sum;
+    double max;
+    int count;
+
+    Distances() : sum(0), max(0), count(0) {}
+
+    void add(const vector<Point2f> &a, const vector<Point2f> &b)
+    {
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            double d = norm(a[i] - b[i]);
+            sum += d;
+            max = std::max(max, d);
+            count++;
+        }
+    }
+
+    double mean() const { return count > 0 ? sum / count : 0; }
+};
+
+/**
+ * Refines a copy of the detections with cornerSubPix, adding to the time taken
+ */
+vector<Point2f> refineOpenCV(const Mat &gray, const vector<Point2f> &detected, double &seconds)
+{
+    vector<Point2f> corners = detected;
+    int64 start = getTickCount();
+    cornerSubPix(gray, corners, Size(5,5), Size(-1,-1),
+                 TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 40, 0.001));
+    seconds += (getTickCount() - start) / getTickFrequency();
+    return corners;
+}
+
+/**
+ * Refines a copy of the detections with the given refiner, adding to the
+ * time taken and the iterations per corner
+ */
+vector<Point2f> refineBatch(SubPixRefiner &refiner, const Mat &gray, const vector<Point2f> &detected,
+                            double &seconds, double &iterations)
+{
+    vector<Point2f> corners = detected;
+    int64 start = getTickCount();
+    refiner.refine(gray, corners);
+    seconds += (getTickCount() - start) / getTickFrequency();
+    iterations += refiner.meanIterations();
+    return corners;
+}
+
+/**
+ * Compares the two methods on the given images
+ */
+void checkImages(const vector<string> &files, const BoardOps *board)
+{
+    SubPixRefiner refiner;
+    refiner.warmStart = false; //unrelated images
+    Distances apart;
+    double openCVTime = 0, batchTime = 0, iterations = 0;
+    int boards = 0;
+    for (size_t f = 0; f < files.size(); f++)
+    {
+        Mat gray = imread(files[f], IMREAD_GRAYSCALE);
+        vector<Point2f> detected;
+        if (gray.empty() || !board->detectCorners(gray, detected, 0))
+        {
+            printf("%s: no board\n", files[f].c_str());
+            continue;
+        }
+        vector<Point2f> expected = refineOpenCV(gray, detected, openCVTime);
+        vector<Point2f> actual = refineBatch(refiner, gray, detected, batchTime, iterations);
+        Distances one;
+        one.add(expected, actual);
+        apart.add(expected, actual);
+        boards++;
+        printf("%s: mean %.4f px, max %.4f px apart\n", files[f].c_str(), one.mean(), one.max);
+    }
+    if (boards > 0)
+    {
+        printf("\n%d boards: mean %.4f px, max %.4f px apart\n", boards, apart.mean(), apart.max);
+        printf("cornerSubPix %.3f ms/board, SubPixRefiner %.3f ms/board (%.1f iterations/corner)\n",
+               openCVTime * 1000 / boards, batchTime * 1000 / boards, iterations / boards);
+    }
+}
+
+/**
+ * Renders views of the flat board image moving smoothly across a 640x480
+ * frame and compares both methods, cold and warm-started, with the truth
+ */
+void checkRendered(const string &boardImage, const BoardOps *board, int numViews)
+{
+    Mat flat = imread(boardImage, IMREAD_GRAYSCALE);
+    vector<Point2f> flatCorners;
+    if (flat.empty() || !board->detectCorners(flat, flatCorners, 0))
+    {
+        printf("Unable to find a %dx%d board in %s\n", board->size().width, board->size().height,
+               boardImage.c_str());
+        exit(-1);
+    }
+    //the flat image is large and sharp, so a wide window pins its corners down well
+    cornerSubPix(flat, flatCorners, Size(11,11), Size(-1,-1),
+                 TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 100, 0.0001));
+
+    Size frameSize(640, 480);
+    vector<Point2f> flatQuad = {Point2f(0, 0), Point2f(flat.cols - 1, 0),
+                                Point2f(flat.cols - 1, flat.rows - 1), Point2f(0, flat.rows - 1)};
+    RNG rng(365);
+    SubPixRefiner cold, warm;
+    cold.warmStart = false;
+    Distances openCVError, coldError, warmError, apart;
+    double openCVTime = 0, coldTime = 0, warmTime = 0, coldIterations = 0, warmIterations = 0;
+    int boards = 0;
+    for (int v = 0; v < numViews; v++)
+    {
+        //a slow drift and wobble, a few pixels per frame like a handheld board
+        float t = v * 0.05f;
+        Point2f shift(20 * sin(t), 15 * sin(1.3f * t));
+        vector<Point2f> quad = {Point2f(90, 70), Point2f(560, 60), Point2f(580, 420), Point2f(70, 400)};
+        for (size_t i = 0; i < quad.size(); i++)
+        {
+            quad[i] += shift + Point2f(12 * sin(t + i), 10 * cos(0.7f * t + i));
+        }
+        Mat homography = getPerspectiveTransform(flatQuad, quad);
+        Mat gray, noise(frameSize, CV_16S);
+        warpPerspective(flat, gray, homography, frameSize, INTER_AREA, BORDER_CONSTANT, Scalar(128));
+        GaussianBlur(gray, gray, Size(0, 0), 0.8);
+        rng.fill(noise, RNG::NORMAL, 0, 3);
+        add(gray, noise, gray, noArray(), CV_8U);
+
+        vector<Point2f> truth, detected;
+        perspectiveTransform(flatCorners, truth, homography);
+        if (!board->detectCorners(gray, detected, 0))
+        {
+            warm.reset();
+            continue;
+        }
+        vector<Point2f> expected = refineOpenCV(gray, detected, openCVTime);
+        vector<Point2f> coldCorners = refineBatch(cold, gray, detected, coldTime, coldIterations);
+        vector<Point2f> warmCorners = refineBatch(warm, gray, detected, warmTime, warmIterations);
+        openCVError.add(truth, expected);
+        coldError.add(truth, coldCorners);
+        warmError.add(truth, warmCorners);
+        apart.add(expected, coldCorners);
+        boards++;
+    }
+    if (boards == 0)
+    {
+        printf("No board found in any rendered view\n");
+        return;
+    }
+
+    printf("%d rendered views of %s (blur 0.8 px, noise 3 levels)\n\n", boards, boardImage.c_str());
+    printf("%-22s %12s %12s %12s %14s\n", "", "mean error", "max error", "ms/board", "iters/corner");
+    printf("%-22s %12.4f %12.4f %12.3f %14s\n", "cornerSubPix",
+           openCVError.mean(), openCVError.max, openCVTime * 1000 / boards, "-");
+    printf("%-22s %12.4f %12.4f %12.3f %14.2f\n", "SubPixRefiner (cold)",
+           coldError.mean(), coldError.max, coldTime * 1000 / boards, coldIterations / boards);
+    printf("%-22s %12.4f %12.4f %12.3f %14.2f\n", "SubPixRefiner (warm)",
+           warmError.mean(), warmError.max, warmTime * 1000 / boards, warmIterations / boards);
+    printf("\ncornerSubPix vs cold SubPixRefiner: mean %.4f px, max %.4f px apart\n",
+           apart.mean(), apart.max);
+}
+
+int main(int argc, char *argv[])
+{
+    const BoardOps *board = findBoardOps(Size(9,6));
+    vector<string> files;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) //-b WxH: board size
+        {
+            board = parseBoardOps(argv[++i]);
+            if (board == NULL)
+            {
+                exit(-1);
+            }
+        }
+        else if (argv[i][0] == '-')
+        {
+            printf("usage: %s [-b WxH] [image...]\n", argv[0]);
+            exit(-1);
+        }
+        else
+        {
+            files.push_back(argv[i]);
+        }
+    }
+
+    if (files.empty())
+    {
+        checkRendered("../data/checkerboard.png", board, 200);
+    }
+    else
+    {
+        checkImages(files, board);
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+/* subPixRefiner.cpp
+ * Batch sub-pixel corner refinement
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include <cmath>
+#include <algorithm>
+#include "subPixRefiner.h"
+
+using namespace std;
+using namespace cv;
+
+SubPixRefiner::SubPixRefiner(int halfWindow, int maxIterations, float epsilon)
+    : warmStart(true), trackRadius(0.5f), halfWindow(halfWindow), regionHalf(halfWindow + 2),
+      maxIterations(maxIterations), epsilon(epsilon), lastMeanIterations(0)
+{
+}
+
+void SubPixRefiner::reset()
+{
+    prevDetected.clear();
+    prevRefined.clear();
+}
+
+/**
+ * Fills in one corner's gradient products over the region around center
+ * (pixels past the image edge repeat the edge, as cornerSubPix does)
+ */
+void SubPixRefiner::precompute(const Mat &gray, int corner, Point center)
+{
+    int side = 2 * regionHalf + 1;
+    int padded = side + 2;
+    patch.resize(padded * padded);
+    int left = center.x - regionHalf - 1;
+    bool inside = left >= 0 && left + padded <= gray.cols;
+    for (int y = 0; y < padded; y++)
+    {
+        int row = min(max(center.y - regionHalf - 1 + y, 0), gray.rows - 1);
+        const uchar *src = gray.ptr<uchar>(row);
+        float *dst = &patch[y * padded];
+        if (inside)
+        {
+            src += left;
+            for (int x = 0; x < padded; x++)
+            {
+                dst[x] = src[x];
+            }
+            continue;
+        }
+        for (int x = 0; x < padded; x++)
+        {
+            dst[x] = src[min(max(left + x, 0), gray.cols - 1)];
+        }
+    }
+
+    size_t base = (size_t)corner * side * side;
+    for (int y = 0; y < side; y++)
+    {
+        const float *up = &patch[y * padded + 1];
+        const float *mid = up + padded;
+        const float *down = mid + padded;
+        size_t row = base + y * side;
+        float *pxx = &gxx[row], *pxy = &gxy[row], *pyy = &gyy[row];
+        float *pbx = &bx[row], *pby = &by[row];
+        float dy = (float)(y - regionHalf);
+        for (int x = 0; x < side; x++)
+        {
+            float gx = (mid[x + 1] - mid[x - 1]) * 0.5f;
+            float gy = (down[x] - up[x]) * 0.5f;
+            float dx = (float)(x - regionHalf);
+            float xx = gx * gx, xy = gx * gy, yy = gy * gy;
+            pxx[x] = xx;
+            pxy[x] = xy;
+            pyy[x] = yy;
+            pbx[x] = xx * dx + xy * dy;
+            pby[x] = xy * dx + yy * dy;
+        }
+    }
+}
+
+void SubPixRefiner::refine(const Mat &gray, vector<Point2f> &corners)
+{
+    CV_Assert(gray.type() == CV_8UC1);
+    int numCorners = (int)corners.size();
+    int side = 2 * regionHalf + 1;
+    int window = 2 * halfWindow + 1;
+    size_t regionPixels = (size_t)side * side;
+    gxx.resize(numCorners * regionPixels);
+    gxy.resize(gxx.size());
+    gyy.resize(gxx.size());
+    bx.resize(gxx.size());
+    by.resize(gxx.size());
+
+    //starting points, relative to each corner's region center
+    bool tracking = warmStart && (int)prevDetected.size() == numCorners;
+    vector<Point> centers(numCorners);
+    vector<Point2f> start(numCorners);
+    vector<Point2f> q(numCorners);
+    vector<int> active(numCorners);
+    for (int k = 0; k < numCorners; k++)
+    {
+        Point2f init = corners[k];
+        if (tracking)
+        {
+            Point2f moved = corners[k] - prevDetected[k];
+            if (moved.dot(moved) < trackRadius * trackRadius)
+            {
+                init = prevRefined[k] + moved;
+            }
+        }
+        centers[k] = Point(cvRound(corners[k].x), cvRound(corners[k].y));
+        start[k] = init - Point2f(centers[k]);
+        q[k] = start[k];
+        active[k] = k;
+        precompute(gray, k, centers[k]);
+    }
+    prevDetected = corners;
+
+    //all corners step together; converged or unstable ones drop out of the batch
+    float invWindow = 1.f / halfWindow;
+    float eps2 = epsilon * epsilon;
+    int drift = regionHalf - halfWindow; //how far the window may move inside the region
+    int iterations = 0;
+    vector<float> wx(window);
+    for (int iter = 0; iter < maxIterations && !active.empty(); iter++)
+    {
+        iterations += (int)active.size();
+        size_t kept = 0;
+        for (size_t n = 0; n < active.size(); n++)
+        {
+            int k = active[n];
+            Point c(cvRound(q[k].x), cvRound(q[k].y));
+            if (abs(c.x) > drift || abs(c.y) > drift)
+            {
+                //rarely the window walks out of the region: move the region along
+                Point2f shift(c);
+                centers[k] += c;
+                start[k] -= shift;
+                q[k] -= shift;
+                c = Point(0, 0);
+                precompute(gray, k, centers[k]);
+            }
+
+            //Gaussian weights centered on the current estimate, separable in x and y
+            for (int i = 0; i < window; i++)
+            {
+                float u = (c.x - halfWindow + i - q[k].x) * invWindow;
+                wx[i] = exp(-u * u);
+            }
+            float a = 0, b = 0, d = 0, rx = 0, ry = 0;
+            size_t base = k * regionPixels;
+            for (int j = 0; j < window; j++)
+            {
+                float v = (c.y - halfWindow + j - q[k].y) * invWindow;
+                float wy = exp(-v * v);
+                size_t row = base + (c.y - halfWindow + j + regionHalf) * side + (c.x - halfWindow + regionHalf);
+                const float *pxx = &gxx[row], *pxy = &gxy[row], *pyy = &gyy[row];
+                const float *pbx = &bx[row], *pby = &by[row];
+                float ra = 0, rb = 0, rd = 0, rrx = 0, rry = 0;
+                for (int i = 0; i < window; i++) //contiguous, fixed length: vectorizes
+                {
+                    ra += wx[i] * pxx[i];
+                    rb += wx[i] * pxy[i];
+                    rd += wx[i] * pyy[i];
+                    rrx += wx[i] * pbx[i];
+                    rry += wx[i] * pby[i];
+                }
+                a += wy * ra;
+                b += wy * rb;
+                d += wy * rd;
+                rx += wy * rrx;
+                ry += wy * rry;
+            }
+
+            float det = a * d - b * b;
+            if (fabs(det) <= 1e-10f * (a * d + 1e-20f))
+            {
+                continue; //flat window, nothing to refine against
+            }
+            Point2f next((d * rx - b * ry) / det, (a * ry - b * rx) / det);
+            Point2f step = next - q[k];
+            q[k] = next;
+            if (step.dot(step) > eps2)
+            {
+                active[kept++] = k;
+            }
+        }
+        active.resize(kept);
+    }
+
+    for (int k = 0; k < numCorners; k++)
+    {
+        Point2f moved = q[k] - start[k];
+        if (fabs(moved.x) > halfWindow || fabs(moved.y) > halfWindow)
+        {
+            q[k] = start[k]; //same sanity check as cornerSubPix
+        }
+        corners[k] = Point2f(centers[k]) + q[k];
+    }
+    prevRefined = corners;
+    lastMeanIterations = numCorners > 0 ? (double)iterations / numCorners : 0;
+}
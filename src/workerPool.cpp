@@ -0,0 +1,144 @@
+/* workerPool.cpp
+ * Work-stealing thread pool
+ *
+ * Melody Mao & Zena Abulhab
+ * CS365 Spring 2019
+ * Project 4
+ */
+
+#include "workerPool.h"
+
+using namespace std;
+
+//index of the worker running on this thread, or -1 for outside threads
+static thread_local int currentWorker = -1;
+static thread_local const WorkerPool *currentPool = NULL;
+
+WorkerPool::WorkerPool(int numThreads)
+    : queued(0), running(0), stopping(false), nextWorker(0)
+{
+    if (numThreads <= 0)
+    {
+        numThreads = max(1, (int)thread::hardware_concurrency());
+    }
+
+    for (int i = 0; i < numThreads; i++)
+    {
+        workers.push_back(unique_ptr<Worker>(new Worker()));
+    }
+    for (int i = 0; i < numThreads; i++)
+    {
+        threads.push_back(thread(&WorkerPool::run, this, i));
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> guard(sleepLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+}
+
+void WorkerPool::submit(function<void()> task)
+{
+    int target;
+    if (currentPool == this)
+    {
+        target = currentWorker; //keep follow-up work local (and cache-warm)
+    }
+    else
+    {
+        target = (int)(nextWorker++ % workers.size());
+    }
+
+    {
+        lock_guard<mutex> guard(workers[target]->lock);
+        workers[target]->tasks.push_back(move(task));
+    }
+    {
+        lock_guard<mutex> guard(sleepLock);
+        queued++;
+    }
+    wake.notify_one();
+}
+
+void WorkerPool::waitIdle()
+{
+    unique_lock<mutex> guard(sleepLock);
+    idle.wait(guard, [this] { return queued == 0 && running == 0; });
+}
+
+/**
+ * Pops the newest task off this worker's deque, or else steals the oldest
+ * task from the next worker that has one
+ */
+bool WorkerPool::takeTask(int index, function<void()> &task)
+{
+    int n = (int)workers.size();
+    for (int k = 0; k < n; k++)
+    {
+        Worker &w = *workers[(index + k) % n];
+        lock_guard<mutex> guard(w.lock);
+        if (!w.tasks.empty())
+        {
+            if (k == 0)
+            {
+                task = move(w.tasks.back());
+                w.tasks.pop_back();
+            }
+            else
+            {
+                task = move(w.tasks.front());
+                w.tasks.pop_front();
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkerPool::run(int index)
+{
+    currentWorker = index;
+    currentPool = this;
+
+    for (;;)
+    {
+        {
+            unique_lock<mutex> guard(sleepLock);
+            wake.wait(guard, [this] { return queued > 0 || stopping; });
+            if (stopping && queued == 0)
+            {
+                return;
+            }
+            //claim one queued task before looking for it, so counts never go negative
+            queued--;
+            running++;
+        }
+
+        //the count guarantees a task for every claim, but another claimant can
+        //take the one this scan was heading for while a newer one lands in a
+        //deque already passed, so scan again until one turns up
+        function<void()> task;
+        while (!takeTask(index, task))
+        {
+            this_thread::yield();
+        }
+        task();
+
+        {
+            lock_guard<mutex> guard(sleepLock);
+            running--;
+            if (queued == 0 && running == 0)
+            {
+                idle.notify_all();
+            }
+        }
+    }
+}